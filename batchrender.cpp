@@ -0,0 +1,300 @@
+#include <QApplication>
+#include <QColor>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QImageReader>
+#include <QRegularExpression>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include "demloader.h"
+#include "helpers.h"
+#include "orthopyramid.h"
+#include "renderer.h"
+
+/**
+ * 无界面批量渲染：DEM与地形网格只读取、上传一次，按相机位姿列表逐帧渲染到帧缓冲对象并写出PNG。
+ *
+ * 用法: DemBatchRender [选项] <DEM文件> <位姿文件>
+ * 位姿文件每行一个位姿: 水平角 天顶角 [球半径 [球心X 球心Y 球心Z]]，角度以度为单位，
+ * 球半径不大于0或省略时使用默认半径，球心省略时为DEM中心；空行与#开头的行被忽略。
+ *
+ * 没有显示服务的服务器上以 -platform offscreen 运行(平台插件需支持OpenGL)，
+ * 或在 xvfb-run 下以Mesa软件光栅化运行。
+ */
+
+namespace {
+
+// 等待纹理上传(及虚拟纹理页加载)的最多帧数
+const int kMaxWarmUpFrames = 600;
+
+QTextStream& out() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream& err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+/**
+ * @brief parseGradient 解析渐变，格式为"位置:颜色,位置:颜色,..."，位置为0~1的小数
+ * @return 颜色转折点，格式错误时为空
+ */
+std::vector<Helpers::ColorStop> parseGradient(QString text) {
+    if(text == "random") return Helpers::randomGradient();
+
+    std::vector<Helpers::ColorStop> gradient;
+    for(const QString& item : text.split(',', Qt::SkipEmptyParts)) {
+        QStringList parts = item.trimmed().split(':');
+        bool ok = false;
+        float percentage = parts.size() == 2 ? parts[0].toFloat(&ok) : 0.0f;
+        QColor color = parts.size() == 2 ? QColor(parts[1]) : QColor();
+        if(!ok || !color.isValid()) return {};
+        gradient.push_back(Helpers::ColorStop(percentage, color.red(), color.green(), color.blue(), 1.0f));
+    }
+    std::sort(gradient.begin(), gradient.end(), [](const auto & a, const auto & b) {
+        return a.percentage < b.percentage;
+    });
+    return gradient;
+}
+
+/**
+ * @brief readPoses 读取位姿文件，缺省项取自默认相机
+ */
+std::vector<OrbitControls> readPoses(QString path, const OrbitControls& defaultPose) {
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) throw "Failed to open the pose file.";
+
+    std::vector<OrbitControls> poses;
+    QTextStream stream(&file);
+    while(!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if(line.isEmpty() || line.startsWith('#')) continue;
+
+        QStringList fields = line.split(QRegularExpression("[\\s,]+"), Qt::SkipEmptyParts);
+        std::vector<float> values;
+        for(const QString& field : fields) {
+            bool ok = false;
+            values.push_back(field.toFloat(&ok));
+            if(!ok) throw "Invalid number in the pose file.";
+        }
+        if(values.size() != 2 && values.size() != 3 && values.size() != 6)
+            throw "A pose needs 2, 3 or 6 values.";
+
+        OrbitControls pose = defaultPose;
+        pose.setPhi(values[0] * Helpers::Pi / 180.0f);
+        pose.setTheta(values[1] * Helpers::Pi / 180.0f);
+        if(values.size() >= 3 && values[2] > 0.0f) pose.setRadius(values[2]);
+        if(values.size() == 6) pose.setCenter(values[3], values[4], values[5]);
+        poses.push_back(pose);
+    }
+    return poses;
+}
+
+/**
+ * @brief loadDem 与界面相同的读取流程(金字塔缓存、存储方式)，在工作线程中读取并生成网格
+ * @param buildNormals 是否计算法向，关闭山体阴影时不需要
+ * @return 是否成功，失败时已输出读取器给出的错误信息
+ */
+bool loadDem(QString path, DigitalElevationModel& dem, TerrainMesh& mesh, bool buildNormals) {
+    auto sourceType = path.endsWith(".demb", Qt::CaseInsensitive) ?
+                      DigitalElevationModel::FromBinary : DigitalElevationModel::FromText;
+    DemLoader loader;
+    loader.setBuildNormals(buildNormals);
+    QEventLoop loop;
+    QString error;
+    QObject::connect(&loader, &DemLoader::loaded, &loop,
+    [&](const DigitalElevationModel & loadedDem, const TerrainMesh & loadedMesh) {
+        dem = loadedDem;
+        mesh = loadedMesh;
+        loop.quit();
+    });
+    QObject::connect(&loader, &DemLoader::failed, &loop, [&](QString message) {
+        error = message;
+        loop.quit();
+    });
+    QObject::connect(&loader, &DemLoader::progressChanged, &loop, [](int percent, QString stage) {
+        err() << "\r" << stage << " " << percent << "%" << Qt::flush;
+    });
+    loader.load(path, sourceType);
+    loop.exec();
+    err() << "\n";
+    if(!error.isEmpty()) {
+        err() << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief attachOrtho 与界面相同的规则选择普通纹理或虚拟纹理
+ */
+void attachOrtho(Renderer& renderer, QString path) {
+    QSize imageSize = QImageReader(path).size();
+    int maxSize = std::min(int(Renderer::VIRTUAL_TEXTURE_MIN_SIZE), renderer.maxTextureSize());
+    if(std::max(imageSize.width(), imageSize.height()) > maxSize) {
+        if(!OrthoPyramid::isCacheValid(path)) {
+            OrthoPyramid::build(path, OrthoPyramid::cachePathFor(path), [](float progress) {
+                err() << "\r正在生成正射影像页金字塔 " << int(progress * 100) << "%" << Qt::flush;
+                return true;
+            });
+            err() << "\n";
+        }
+        OrthoPyramid pyramid = OrthoPyramid::open(OrthoPyramid::cachePathFor(path));
+        if(pyramid.isEmpty()) throw "Failed to open the orthophoto pyramid.";
+        renderer.setVirtualTexture(std::move(pyramid));
+    } else {
+        QImage image(path);
+        if(image.isNull()) throw "Failed to read the orthophoto.";
+        renderer.setOrthoTexture(image.convertToFormat(QImage::Format_RGB888));
+    }
+}
+
+/**
+ * @brief The EncoderQueue struct 正在编码的线程，析构时等待全部结束
+ *
+ * 绘制出错抛出异常时仍会等待已启动的编码，不会析构可连接的std::thread。
+ */
+struct EncoderQueue {
+    std::deque<std::thread> threads{};
+
+    ~EncoderQueue() {
+        joinAll();
+    }
+
+    void joinAll() {
+        for(auto& thread : threads) thread.join();
+        threads.clear();
+    }
+};
+
+/**
+ * @brief renderFrame 绘制到帧缓冲对象，先多绘制几帧使纹理上传完成
+ */
+QImage renderFrame(Renderer& renderer) {
+    for(int i = 0; i < kMaxWarmUpFrames && renderer.hasPendingTextureUploads(); ++i) {
+        renderer.grabFramebuffer();
+        QThread::msleep(1);
+    }
+    return renderer.grabFramebuffer();
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QApplication a(argc, argv);
+    QApplication::setApplicationName("DemBatchRender");
+    Helpers::init();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Render terrain images for a list of camera poses without a window.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("dem", "DEM file (*.asc, *.demb).");
+    parser.addPositionalArgument("poses", "Pose file: phi theta [radius [cx cy cz]] per line, degrees.");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory.", "dir", ".");
+    QCommandLineOption orthoOption("ortho", "Orthophoto draped over the DEM.", "image");
+    QCommandLineOption gradientOption("gradient", "Elevation gradient \"0:#22bfc3,1:#fd5f0a\" or \"random\".",
+                                      "stops");
+    QCommandLineOption sizeOption("size", "Image size.", "WxH", "1024x768");
+    QCommandLineOption orthographicOption("orthographic", "Use an orthographic projection.");
+    QCommandLineOption toleranceOption("lod-tolerance", "LOD screen-space error tolerance in pixels.",
+                                       "pixels");
+    QCommandLineOption noHillshadeOption("no-hillshade", "Disable hillshade lighting.");
+    parser.addOptions({outputOption, orthoOption, gradientOption, sizeOption, orthographicOption,
+                       toleranceOption, noHillshadeOption});
+    parser.process(a);
+
+    const QStringList arguments = parser.positionalArguments();
+    if(arguments.size() != 2) parser.showHelp(1);
+
+    QStringList size = parser.value(sizeOption).split('x');
+    int width = size.size() == 2 ? size[0].toInt() : 0;
+    int height = size.size() == 2 ? size[1].toInt() : 0;
+    if(width <= 0 || height <= 0) {
+        err() << "Invalid image size.\n";
+        return 1;
+    }
+    QDir outputDir(parser.value(outputOption));
+    if(!outputDir.mkpath(".")) {
+        err() << "Failed to create the output directory.\n";
+        return 1;
+    }
+
+    try {
+        QElapsedTimer timer;
+        timer.start();
+
+        // 渲染器不显示，QOpenGLWidget在离屏表面上绘制到自己的帧缓冲对象
+        Renderer renderer(nullptr);
+        renderer.setAttribute(Qt::WA_DontShowOnScreen);
+        renderer.resize(width, height);
+        renderer.grabFramebuffer();
+        if(!renderer.context()) throw "Failed to create an OpenGL context.";
+
+        DigitalElevationModel dem;
+        TerrainMesh mesh;
+        if(!loadDem(arguments[0], dem, mesh, !parser.isSet(noHillshadeOption))) return 1;
+        renderer.setDrawMode(mesh.tin.isEmpty() ? Renderer::QuadtreeLod : Renderer::TinTriangles);
+        if(parser.isSet(orthographicOption)) renderer.switchProjectionType(Renderer::Orthographic);
+        renderer.uploadTerrainMesh(mesh);
+        mesh = TerrainMesh();
+        if(parser.isSet(toleranceOption)) renderer.setLodPixelTolerance(parser.value(toleranceOption).toFloat());
+        if(parser.isSet(noHillshadeOption)) renderer.setHillshade(false);
+        if(parser.isSet(gradientOption)) {
+            std::vector<Helpers::ColorStop> gradient = parseGradient(parser.value(gradientOption));
+            if(gradient.size() < 2) throw "Invalid gradient.";
+            renderer.setGradient(gradient);
+        }
+        if(parser.isSet(orthoOption)) attachOrtho(renderer, parser.value(orthoOption));
+
+        std::vector<OrbitControls> poses = readPoses(arguments[1], renderer.cameraControls());
+        double setupSeconds = timer.nsecsElapsed() / 1e9;
+        out() << dem.getCols() << " x " << dem.getRows() << " DEM ready in "
+              << QString::number(setupSeconds, 'f', 2) << " s, " << poses.size() << " poses\n" << Qt::flush;
+
+        // 绘制在GUI线程，PNG编码交给工作线程，同时进行的编码数不超过线程数
+        const unsigned nEncoders = DigitalElevationModel::loaderThreadCount();
+        std::atomic_int nFailed{0};
+        EncoderQueue encoders;
+        double renderSeconds = 0.0;
+        timer.restart();
+        for(quint64 i = 0; i < poses.size(); ++i) {
+            QElapsedTimer frameTimer;
+            frameTimer.start();
+            renderer.setCameraControls(poses[i]);
+            QImage image = renderFrame(renderer);
+            renderSeconds += frameTimer.nsecsElapsed() / 1e9;
+            if(image.isNull()) throw "Failed to render a frame.";
+
+            if(encoders.threads.size() >= nEncoders) {
+                encoders.threads.front().join();
+                encoders.threads.pop_front();
+            }
+            QString path = outputDir.filePath(QString("%1.png").arg(i, 5, 10, QChar('0')));
+            encoders.threads.emplace_back([image, path, &nFailed]() {
+                if(!image.save(path, "PNG")) ++nFailed;
+            });
+        }
+        encoders.joinAll();
+        double totalSeconds = timer.nsecsElapsed() / 1e9;
+
+        out() << poses.size() << " images in " << QString::number(totalSeconds, 'f', 2) << " s: "
+              << QString::number(poses.size() / std::max(totalSeconds, 1e-9), 'f', 2) << " images/s, "
+              << QString::number(poses.size() / std::max(renderSeconds, 1e-9), 'f', 2)
+              << " frames/s rendering only\n" << Qt::flush;
+        if(nFailed) {
+            err() << nFailed << " images could not be written.\n";
+            return 1;
+        }
+    } catch (const char* message) {
+        err() << message << "\n";
+        return 1;
+    }
+    return 0;
+}
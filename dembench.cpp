@@ -0,0 +1,681 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMatrix4x4>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include "digitalelevationmodel.h"
+#include "dempyramid.h"
+#include "elevationcodec.h"
+#include "frustum.h"
+#include "helpers.h"
+#include "normalmap.h"
+#include "orbitcontrols.h"
+#include "syntheticdem.h"
+#include "terrainmesh.h"
+
+/**
+ * 性能测试：在分形合成DEM上分别计时读取、高程解码、瓦片压缩的解压、渐变插值、相机计算、法向、
+ * 网格生成与细节层次选择，结果以JSON输出，便于比较不同版本。
+ *
+ * 用法: DemBench [选项]
+ * 每项先运行 --warmup 次(不计时)，再计时 --repeat 次，记录每次耗时及最小值、中位数、平均值。
+ * 与格网大小无关的微测试只运行一次，size为0。
+ */
+
+namespace {
+
+// 与格网大小无关的微测试的迭代次数
+const quint64 kMicroIterations = 1 << 20;
+// 细节层次选择测试的相机位姿数
+const int kLodPoses = 64;
+// 量化压缩测试的步长(m)
+const float kQuantStep = 0.01f;
+
+// 防止被测计算被优化掉
+volatile float gSink = 0.0f;
+
+QTextStream& err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+/**
+ * @brief The Runner class 运行并记录各项测试
+ */
+class Runner {
+public:
+    Runner(QString filter, int warmup, int repeat)
+        : mFilter(filter), miWarmup(warmup), miRepeat(repeat) {}
+
+    /**
+     * @brief enabled 测试名称是否匹配过滤条件
+     */
+    bool enabled(QString name) const {
+        return mFilter.isEmpty() || name.contains(mFilter);
+    }
+
+    /**
+     * @brief run 运行一项测试
+     * @param name 名称
+     * @param size 格网边长，与格网无关时为0
+     * @param items 每次运行处理的元素数，用于计算吞吐量
+     * @param function 被测函数
+     * @param extra 附加到结果中的其他字段(如压缩率)
+     */
+    void run(QString name, quint64 size, quint64 items, const std::function<void()>& function,
+             const QJsonObject& extra = QJsonObject()) {
+        if(!enabled(name)) return;
+        err() << name << " " << size << " ..." << Qt::flush;
+
+        for(int i = 0; i < miWarmup; ++i) function();
+        std::vector<double> runs;
+        for(int i = 0; i < miRepeat; ++i) {
+            QElapsedTimer timer;
+            timer.start();
+            function();
+            runs.push_back(timer.nsecsElapsed() / 1e6);
+        }
+
+        std::vector<double> sorted = runs;
+        std::sort(sorted.begin(), sorted.end());
+        double median = sorted.size() % 2 ? sorted[sorted.size() / 2] :
+                        (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2.0;
+        double mean = std::accumulate(runs.begin(), runs.end(), 0.0) / runs.size();
+
+        QJsonArray runsArray;
+        for(double ms : runs) runsArray.append(ms);
+        QJsonObject result;
+        result["name"] = name;
+        result["size"] = qint64(size);
+        result["items"] = qint64(items);
+        result["runsMs"] = runsArray;
+        result["minMs"] = sorted.front();
+        result["medianMs"] = median;
+        result["meanMs"] = mean;
+        result["itemsPerSecond"] = items / std::max(median / 1e3, 1e-12);
+        for(auto it = extra.begin(); it != extra.end(); ++it) result[it.key()] = it.value();
+        mResults.append(result);
+
+        err() << " " << QString::number(median, 'f', 3) << " ms\n" << Qt::flush;
+    }
+
+    const QJsonArray& results() const {
+        return mResults;
+    }
+
+private:
+    QString mFilter;
+    int miWarmup;
+    int miRepeat;
+    QJsonArray mResults{};
+};
+
+/**
+ * @brief loadTextWithQTextStream 按原先的QTextStream逐值读取方式加载ASCII Grid，作为load/text的对照
+ * @return 读取的高程个数
+ */
+quint64 loadTextWithQTextStream(QString path) {
+    QFile file(path);
+    if(!file.open(QFile::ReadOnly)) throw "Failed to open DEM file.";
+    QTextStream stream(file.readAll());
+
+    QString buffer{};
+    int cols = 0, rows = 0;
+    double lowerLeftX, lowerLeftY, cellSize, noData;
+    stream >> buffer >> cols
+           >> buffer >> rows
+           >> buffer >> lowerLeftX
+           >> buffer >> lowerLeftY
+           >> buffer >> cellSize
+           >> buffer >> noData;
+
+    std::vector<float> data{};
+    data.reserve(quint64(cols) * rows);
+    for(quint64 i = 0; i < quint64(cols) * rows; ++i) {
+        float value = 0;
+        stream >> value;
+        data.push_back(value);
+    }
+    return data.size();
+}
+
+/**
+ * @brief sumElevations 按存储类型解码并累加所有格网点高程
+ */
+float sumElevations(const DigitalElevationModel& dem) {
+    float sum = 0.0f;
+    quint64 count = dem.getCols() * dem.getRows();
+    for(quint64 i = 0; i < count; ++i) sum += dem.getElevByIndex(i);
+    return sum;
+}
+
+/**
+ * @brief The EncodedTiles struct 按金字塔瓦片切分后分别压缩的格网
+ */
+struct EncodedTiles {
+    std::vector<QByteArray> tiles{};
+    // 各瓦片的列数与行数(边缘瓦片较小)
+    std::vector<std::pair<quint64, quint64>> sizes{};
+    quint64 encodedBytes{0};
+};
+
+/**
+ * @brief encodeTiles 将格网按tileSize切分，逐个瓦片压缩
+ * @param encode 压缩一个瓦片(行优先，cols * rows 个值)
+ */
+EncodedTiles encodeTiles(const DigitalElevationModel& dem, quint64 tileSize,
+                         const std::function<QByteArray(const float*, quint64, quint64)>& encode) {
+    EncodedTiles result;
+    std::vector<float> buffer;
+    for(quint64 row0 = 0; row0 < dem.getRows(); row0 += tileSize) {
+        for(quint64 col0 = 0; col0 < dem.getCols(); col0 += tileSize) {
+            quint64 cols = std::min(tileSize, dem.getCols() - col0);
+            quint64 rows = std::min(tileSize, dem.getRows() - row0);
+            buffer.resize(cols * rows);
+            for(quint64 y = 0; y < rows; ++y) {
+                for(quint64 x = 0; x < cols; ++x) {
+                    buffer[y * cols + x] = dem.getElev(row0 + y, col0 + x);
+                }
+            }
+            result.tiles.push_back(encode(buffer.data(), cols, rows));
+            result.sizes.emplace_back(cols, rows);
+            result.encodedBytes += result.tiles.back().size();
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief defaultCamera 与渲染器重置相机相同：对准格网中心，天顶角60°，半径为格网对角线长
+ */
+OrbitControls defaultCamera(const TerrainMesh& mesh) {
+    OrbitControls camera(QVector3D(mesh.xyCenter, (mesh.minElev + mesh.maxElev) / 2.0f));
+    camera.setTheta(Helpers::Pi / 3);
+    camera.setRadius(std::sqrt(mesh.xSpan * mesh.xSpan + mesh.ySpan * mesh.ySpan));
+    return camera;
+}
+
+/**
+ * @brief viewProjection 1024x768视口的透视投影与视图矩阵之积
+ */
+QMatrix4x4 viewProjection(OrbitControls& camera, float nearPlane, float farPlane) {
+    QMatrix4x4 matrix;
+    matrix.perspective(60.0f, 1024.0f / 768.0f, nearPlane, farPlane);
+    return matrix * camera.computeViewMatrix();
+}
+
+/**
+ * @brief runMicroBenchmarks 与格网大小无关的测试
+ */
+void runMicroBenchmarks(Runner& runner) {
+    const std::vector<Helpers::ColorStop> gradient{
+        {0.0f, 34, 191, 195, 1.0f}, {0.18f, 123, 227, 62, 1.0f}, {0.45f, 240, 220, 90, 1.0f},
+        {0.7f, 180, 120, 60, 1.0f}, {1.0f, 253, 95, 10, 1.0f}};
+    runner.run("gradient/linear", 0, kMicroIterations, [&]() {
+        float color[4], sum = 0.0f;
+        for(quint64 i = 0; i < kMicroIterations; ++i) {
+            Helpers::linearGradient(gradient, float(i) / kMicroIterations, color);
+            sum += color[0];
+        }
+        gSink = sum;
+    });
+
+    // 拖动相机时每帧的计算：移动、视图投影矩阵、视锥体
+    runner.run("camera/orbit-frustum", 0, kMicroIterations, [&]() {
+        OrbitControls camera(QVector3D(0.0f, 0.0f, 0.0f), 0.0f, Helpers::Pi / 3, 1000.0f);
+        float sum = 0.0f;
+        for(quint64 i = 0; i < kMicroIterations; ++i) {
+            camera.move(0.001f, (i & 1) ? 0.0005f : -0.0005f, 0.0f);
+            Frustum frustum = Frustum::fromMatrix(viewProjection(camera, 1.0f, 10000.0f));
+            sum += frustum.classifyBox(QVector3D(-1.0f, -1.0f, -1.0f), QVector3D(1.0f, 1.0f, 1.0f));
+        }
+        gSink = sum;
+    });
+}
+
+/**
+ * @brief runGridBenchmarks 在一个合成DEM上的各项测试
+ */
+void runGridBenchmarks(Runner& runner, SyntheticDem::Generator generator,
+                       const SyntheticDem::Params& params, const QTemporaryDir& tempDir,
+                       quint64 maxTextSize) {
+    const quint64 size = params.size;
+    const quint64 cells = size * size;
+
+    DigitalElevationModel dem;
+    runner.run("generate/" + SyntheticDem::generatorName(generator), size, cells, [&]() {
+        dem = DigitalElevationModel();
+        dem = SyntheticDem::generate(generator, params);
+    });
+    if(dem.isEmpty()) dem = SyntheticDem::generate(generator, params);
+
+    // 读取：文本格式写文件很慢，只在不超过maxTextSize的格网上测试
+    if(size <= maxTextSize && runner.enabled("load/text")) {
+        QString path = tempDir.filePath("synthetic.asc");
+        SyntheticDem::saveToText(dem, path);
+        runner.run("load/text", size, cells, [&]() {
+            gSink = DigitalElevationModel::loadFromFile(path, DigitalElevationModel::FromText).getCellSize();
+        });
+        runner.run("load/text-qtextstream", size, cells, [&]() {
+            gSink = loadTextWithQTextStream(path);
+        });
+        QFile::remove(path);
+    }
+    if(runner.enabled("load/binary")) {
+        QString path = tempDir.filePath("synthetic.demb");
+        dem.saveToBinary(path);
+        // 映射之后访问全部数据，包括缺页开销
+        runner.run("load/binary", size, cells, [&]() {
+            gSink = sumElevations(DigitalElevationModel::loadFromFile(path, DigitalElevationModel::FromBinary));
+        });
+        QFile::remove(path);
+    }
+
+    // 各存储类型的逐点解码
+    runner.run("decode/float32", size, cells, [&]() {
+        gSink = sumElevations(dem);
+    });
+    if(runner.enabled("decode/int16")) {
+        DigitalElevationModel packed = dem.toValueType(DigitalElevationModel::Int16);
+        runner.run("decode/int16", size, cells, [&]() {
+            gSink = sumElevations(packed);
+        });
+    }
+    if(runner.enabled("decode/float16")) {
+        DigitalElevationModel packed = dem.toValueType(DigitalElevationModel::Float16);
+        runner.run("decode/float16", size, cells, [&]() {
+            gSink = sumElevations(packed);
+        });
+    }
+
+    // 瓦片压缩：与金字塔缓存相同按瓦片切分，单线程解压全部瓦片，与原始float经qCompress(zlib)对比
+    using TileDecoder = std::function<void(const QByteArray&, quint64, quint64)>;
+    const quint64 tileSize = DemPyramid::DEFAULT_TILE_SIZE;
+    const quint64 rawBytes = cells * sizeof(float);
+    const float noData = dem.getNoDataValue();
+    std::vector<float> tileBuffer(tileSize * tileSize);
+    auto runCodec = [&](QString name, const EncodedTiles & encoded, const TileDecoder & decode) {
+        QJsonObject extra;
+        extra["rawBytes"] = qint64(rawBytes);
+        extra["encodedBytes"] = qint64(encoded.encodedBytes);
+        extra["ratio"] = double(rawBytes) / std::max<quint64>(encoded.encodedBytes, 1);
+        runner.run(name, size, cells, [&]() {
+            for(quint64 i = 0; i < encoded.tiles.size(); ++i) {
+                decode(encoded.tiles[i], encoded.sizes[i].first, encoded.sizes[i].second);
+            }
+            gSink = tileBuffer[0];
+        }, extra);
+    };
+    TileDecoder decodeCodec = [&](const QByteArray & tile, quint64 cols, quint64 rows) {
+        ElevationCodec::decode(tile.constData(), tile.size(), tileBuffer.data(), cols, rows);
+    };
+    if(runner.enabled("codec/lossless")) {
+        auto encode = [&](const float * pData, quint64 cols, quint64 rows) {
+            return ElevationCodec::encode(pData, cols, rows, noData);
+        };
+        runCodec("codec/lossless", encodeTiles(dem, tileSize, encode), decodeCodec);
+    }
+    if(runner.enabled("codec/quantized")) {
+        auto encode = [&](const float * pData, quint64 cols, quint64 rows) {
+            return ElevationCodec::encode(pData, cols, rows, noData, kQuantStep);
+        };
+        runCodec("codec/quantized", encodeTiles(dem, tileSize, encode), decodeCodec);
+    }
+    if(runner.enabled("zlib/raw")) {
+        // 与ElevationCodec相同使用qCompress的默认压缩级别6
+        auto encode = [](const float * pData, quint64 cols, quint64 rows) {
+            return qCompress(reinterpret_cast<const uchar*>(pData), int(cols * rows * sizeof(float)), 6);
+        };
+        TileDecoder decode = [&](const QByteArray & tile, quint64 cols, quint64 rows) {
+            QByteArray raw = qUncompress(tile);
+            if(quint64(raw.size()) != cols * rows * sizeof(float)) throw "Corrupt zlib tile.";
+            std::memcpy(tileBuffer.data(), raw.constData(), raw.size());
+        };
+        runCodec("zlib/raw", encodeTiles(dem, tileSize, encode), decode);
+    }
+
+    // 法向(山体阴影)
+    runner.run(QString("normals/build-") + NormalMap::kernelName(), size, cells, [&]() {
+        gSink = float(NormalMap::build(dem).texels.size());
+    });
+
+    // 网格生成(包括最小/最大值扫描与细节层次，法向单独计时)
+    if(!runner.enabled("mesh/build") && !runner.enabled("lod/select")) return;
+    TerrainMesh mesh;
+    runner.run("mesh/build", size, cells, [&]() {
+        mesh = TerrainMesh();
+        mesh = TerrainMesh::build(dem, DigitalElevationModel::ProgressCallback(), false);
+    });
+    if(mesh.isEmpty()) mesh = TerrainMesh::build(dem, DigitalElevationModel::ProgressCallback(), false);
+
+    // 环绕地形一周的细节层次选择(带视锥体裁剪)
+    float maxEdge = std::max(mesh.xSpan, mesh.ySpan);
+    float minEdge = std::min(mesh.xSpan, mesh.ySpan);
+    std::vector<quint32> selected;
+    runner.run("lod/select", size, kLodPoses, [&]() {
+        OrbitControls camera = defaultCamera(mesh);
+        quint64 drawn = 0;
+        for(int i = 0; i < kLodPoses; ++i) {
+            camera.setPhi(2.0f * Helpers::Pi * i / kLodPoses);
+            Frustum frustum = Frustum::fromMatrix(viewProjection(camera, minEdge * 0.01f, maxEdge * 10.0f));
+            TerrainLod::View view;
+            view.eye = camera.position();
+            view.elevScale = 1.0f;
+            view.perspective = true;
+            view.pixelScale = 768.0f / (2.0f * std::tan(Helpers::Pi / 6.0f));
+            view.pixelTolerance = 2.0f;
+            view.pFrustum = &frustum;
+            mesh.lod.select(view, selected);
+            drawn += selected.size();
+        }
+        gSink = float(drawn);
+    });
+}
+
+
+/**
+ * 文本格网分块解析自检：同一文本分别串行解析与按各种分块位置多线程解析，结果(包括错误)必须逐位一致。
+ */
+
+/**
+ * @brief The ParseOutcome struct 一次解析的结果，成功时为格网值，失败时为错误信息
+ */
+struct ParseOutcome {
+    std::vector<float> values{};
+    QString error{};
+
+    bool operator==(const ParseOutcome& other) const {
+        if(error != other.error) return false;
+        return !error.isEmpty() || (values.size() == other.values.size() &&
+                std::memcmp(values.data(), other.values.data(), values.size() * sizeof(float)) == 0);
+    }
+};
+
+ParseOutcome parseGrid(const QByteArray& text, quint64 count, const std::vector<quint64>& splits) {
+    ParseOutcome outcome;
+    try {
+        outcome.values = DigitalElevationModel::parseGridText(text, count, splits);
+    } catch (const char* message) {
+        outcome.error = message;
+    }
+    return outcome;
+}
+
+/**
+ * @brief The GridText struct 自检用的格网文本
+ */
+struct GridText {
+    QString name;
+    QByteArray text;
+    // 需要读取的格网值个数，可多于(截断)或少于(多余尾部记号)文本中的记号数
+    quint64 count;
+};
+
+/**
+ * @brief checkToken 第i个格网值的文本，覆盖整数、小数、指数、超长尾数与无数据值等写法
+ */
+QByteArray checkToken(quint64 i) {
+    quint64 h = (i + 1) * 0x9E3779B97F4A7C15ull;
+    h ^= h >> 29;
+    int value = int(h % 100000) - 50000;
+    switch(i % 8) {
+    case 0: return QByteArray::number(value);
+    case 1: return QByteArray::number(value / 100.0, 'f', 2);
+    case 2: return QByteArray::number(value * 1.0e-3, 'e', 4);
+    case 3: return "-9999";
+    case 4: return "+" + QByteArray::number(std::abs(value) / 7.0, 'f', 6);
+    case 5: return "1234.56789012345678901234";
+    case 6: return "." + QByteArray::number(std::abs(value));
+    default: return QByteArray::number(value) + "E+2";
+    }
+}
+
+/**
+ * @brief checkSeparator 第i个格网值之后的分隔：单个空格、连续空白、CRLF、LF与连续空行
+ */
+QByteArray checkSeparator(quint64 i, quint64 cols) {
+    if((i + 1) % cols == 0) return (i / cols) % 3 == 0 ? "\n" : ((i / cols) % 3 == 1 ? "\r\n" : "  \r\n\r\n\t");
+    switch(i % 5) {
+    case 0: return " ";
+    case 1: return "   \t ";
+    case 2: return "\r\n";
+    case 3: return " \t\t";
+    default: return " ";
+    }
+}
+
+/**
+ * @brief checkTexts 生成自检文本：正常、多余尾部记号、截断、非法记号及其组合
+ */
+std::vector<GridText> checkTexts() {
+    const quint64 kCount = 240, kCols = 12;
+    std::vector<QByteArray> tokens;
+    for(quint64 i = 0; i < kCount; ++i) tokens.push_back(checkToken(i));
+    auto join = [&](const std::vector<QByteArray>& items, QByteArray leading, bool trailing) {
+        QByteArray text = leading;
+        for(quint64 i = 0; i < items.size(); ++i) {
+            text += items[i];
+            if(trailing || i + 1 < items.size()) text += checkSeparator(i, kCols);
+        }
+        return text;
+    };
+
+    std::vector<GridText> texts;
+    texts.push_back({"valid", join(tokens, "", true), kCount});
+    texts.push_back({"valid-no-trailing-newline", join(tokens, " \r\n", false), kCount});
+    texts.push_back({"extra-trailing-tokens", join(tokens, "", true), kCount - 7});
+    texts.push_back({"truncated", join(tokens, "", true), kCount + 3});
+    texts.push_back({"truncated-inside-line", join(std::vector<QByteArray>(tokens.begin(), tokens.end() - 5),
+                                                   "", false), kCount});
+
+    const std::vector<QByteArray> garbage{"12a", "abc", "1e", "--3", "1.2.3", "nan", "-", "."};
+    const std::vector<quint64> positions{0, 1, kCount / 3, kCount / 2, kCount - 1};
+    for(quint64 i = 0; i < garbage.size(); ++i) {
+        std::vector<QByteArray> items = tokens;
+        quint64 position = positions[i % positions.size()];
+        items[position] = garbage[i];
+        texts.push_back({"garbage-" + QString(garbage[i]) + "-at-" + QString::number(position),
+                         join(items, "", true), kCount});
+    }
+    // 多个非法记号时报告第一个，非法记号在需要读取的范围之后时忽略
+    std::vector<QByteArray> items = tokens;
+    items[kCount / 4] = "x1";
+    items[kCount * 3 / 4] = "1x";
+    texts.push_back({"garbage-twice", join(items, "", true), kCount});
+    texts.push_back({"garbage-after-count", join(items, "", true), kCount / 4});
+    texts.push_back({"garbage-then-truncated", join(items, "", true), kCount + 1});
+    return texts;
+}
+
+/**
+ * @brief checkParser 比较串行解析与多线程分块解析
+ *
+ * 对每个文本：2个线程时尝试每个字节位置作为块边界；3 ~ maxThreads个线程时使用均分位置、
+ * 全部落在数值中间、CRLF之间或连续空白中间的位置，以及伪随机位置(可重复、可为首尾)。
+ * @return 不一致的次数
+ */
+int checkParser(unsigned maxThreads) {
+    int failures = 0;
+    quint64 checks = 0;
+    for(const GridText& grid : checkTexts()) {
+        const QByteArray& text = grid.text;
+        const quint64 length = text.size();
+        const ParseOutcome serial = parseGrid(text, grid.count, {});
+
+        auto check = [&](const std::vector<quint64>& splits) {
+            ++checks;
+            ParseOutcome chunked = parseGrid(text, grid.count, splits);
+            if(chunked == serial) return;
+            if(++failures <= 20) {
+                QStringList list;
+                for(quint64 split : splits) list << QString::number(split);
+                err() << "MISMATCH " << grid.name << " splits [" << list.join(',') << "]: serial \""
+                      << (serial.error.isEmpty() ? "ok" : serial.error) << "\", chunked \""
+                      << (chunked.error.isEmpty() ? "ok" : chunked.error) << "\"\n";
+            }
+        };
+
+        for(quint64 split = 0; split <= length; ++split) check({split});
+
+        // 各类边界位置：数值中间、CR与LF之间、连续空白中间
+        auto isBlank = [](char c) {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        };
+        std::vector<quint64> insideNumber, insideCrlf, insideBlanks;
+        for(quint64 i = 1; i < length; ++i) {
+            bool previous = isBlank(text[int(i - 1)]), current = isBlank(text[int(i)]);
+            if(!previous && !current) insideNumber.push_back(i);
+            if(text[int(i - 1)] == '\r' && text[int(i)] == '\n') insideCrlf.push_back(i);
+            if(previous && current) insideBlanks.push_back(i);
+        }
+
+        quint64 state = 0x2545F4914F6CDD1Dull ^ length;
+        auto random = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        for(unsigned nThreads = 3; nThreads <= maxThreads; ++nThreads) {
+            std::vector<quint64> even;
+            for(unsigned i = 1; i < nThreads; ++i) even.push_back(length * i / nThreads);
+            check(even);
+
+            for(const auto* pPositions : {&insideNumber, &insideCrlf, &insideBlanks}) {
+                if(pPositions->empty()) continue;
+                for(quint64 offset = 0; offset < 8; ++offset) {
+                    std::vector<quint64> splits;
+                    for(unsigned i = 1; i < nThreads; ++i) {
+                        quint64 index = (pPositions->size() * i / nThreads + offset) % pPositions->size();
+                        splits.push_back((*pPositions)[index]);
+                    }
+                    std::sort(splits.begin(), splits.end());
+                    check(splits);
+                }
+            }
+
+            for(int round = 0; round < 64; ++round) {
+                std::vector<quint64> splits;
+                for(unsigned i = 1; i < nThreads; ++i) splits.push_back(random() % (length + 1));
+                if(round % 4 == 0) splits.front() = 0;
+                if(round % 4 == 1) splits.back() = length;
+                if(round % 4 == 2) splits.back() = splits.front();
+                std::sort(splits.begin(), splits.end());
+                check(splits);
+            }
+        }
+    }
+    err() << "Grid parser check: " << checks << " chunkings, " << failures << " mismatches\n";
+    return failures;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("DemBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark the terrain pipeline on synthetic fractal DEMs.");
+    parser.addHelpOption();
+    QCommandLineOption outputOption({"o", "output"}, "JSON result file (standard output when omitted).",
+                                    "file");
+    QCommandLineOption sizesOption("sizes", "Comma separated grid sizes.", "list", "256,1024,4096,16384");
+    QCommandLineOption generatorOption("generator", "diamond-square or fbm.", "name", "diamond-square");
+    QCommandLineOption seedOption("seed", "Generator seed.", "n", "1");
+    QCommandLineOption repeatOption("repeat", "Timed runs per benchmark.", "n", "5");
+    QCommandLineOption warmupOption("warmup", "Untimed runs before timing.", "n", "1");
+    QCommandLineOption threadsOption("threads", "Worker threads, 0 for hardware threads.", "n", "0");
+    QCommandLineOption filterOption("filter", "Run only benchmarks whose name contains this text.", "text");
+    QCommandLineOption maxTextSizeOption("max-text-size", "Largest grid for the text loader benchmark.",
+                                         "n", "4096");
+    QCommandLineOption checkParserOption("check-parser",
+                                         "Check that chunked text grid parsing matches serial parsing, then exit.");
+    parser.addOptions({outputOption, sizesOption, generatorOption, seedOption, repeatOption, warmupOption,
+                       threadsOption, filterOption, maxTextSizeOption, checkParserOption});
+    parser.process(a);
+
+    if(parser.isSet(checkParserOption)) {
+        return checkParser(std::max(8u, DigitalElevationModel::loaderThreadCount())) == 0 ? 0 : 1;
+    }
+
+    std::vector<quint64> sizes;
+    for(const QString& item : parser.value(sizesOption).split(',', Qt::SkipEmptyParts)) {
+        quint64 size = item.trimmed().toULongLong();
+        if(size < 2 || !TerrainMesh::fitsVertexFormat(size, size)) {
+            err() << "Invalid grid size: " << item << "\n";
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    QString generatorName = parser.value(generatorOption);
+    if(generatorName != SyntheticDem::generatorName(SyntheticDem::DiamondSquare)
+            && generatorName != SyntheticDem::generatorName(SyntheticDem::FractalBrownian)) {
+        err() << "Unknown generator: " << generatorName << "\n";
+        return 1;
+    }
+    auto generator = generatorName == SyntheticDem::generatorName(SyntheticDem::DiamondSquare) ?
+                     SyntheticDem::DiamondSquare : SyntheticDem::FractalBrownian;
+    int repeat = std::max(1, parser.value(repeatOption).toInt());
+    int warmup = std::max(0, parser.value(warmupOption).toInt());
+    DigitalElevationModel::setLoaderThreadCount(parser.value(threadsOption).toUInt());
+
+    QTemporaryDir tempDir;
+    if(!tempDir.isValid()) {
+        err() << "Failed to create a temporary directory.\n";
+        return 1;
+    }
+
+    Runner runner(parser.value(filterOption), warmup, repeat);
+    try {
+        runMicroBenchmarks(runner);
+        for(quint64 size : sizes) {
+            SyntheticDem::Params params;
+            params.size = size;
+            params.seed = parser.value(seedOption).toUInt();
+            runGridBenchmarks(runner, generator, params, tempDir, parser.value(maxTextSizeOption).toULongLong());
+        }
+    } catch (const char* message) {
+        err() << "\n" << message << "\n";
+        return 1;
+    }
+
+    QJsonObject report;
+    report["generator"] = generatorName;
+    report["seed"] = qint64(parser.value(seedOption).toUInt());
+    report["repeat"] = repeat;
+    report["warmup"] = warmup;
+    report["threads"] = qint64(DigitalElevationModel::loaderThreadCount());
+    report["qtVersion"] = QString(qVersion());
+#ifdef NDEBUG
+    report["buildType"] = "release";
+#else
+    report["buildType"] = "debug";
+#endif
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["benchmarks"] = runner.results();
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if(parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            err() << "Failed to write " << parser.value(outputOption) << "\n";
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json << Qt::flush;
+    }
+    return 0;
+}
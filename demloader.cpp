@@ -0,0 +1,288 @@
+#include "demloader.h"
+#include "demtilecache.h"
+#include <QFileInfo>
+#include <QMetaObject>
+#include <algorithm>
+#include <exception>
+#include <new>
+
+namespace {
+
+// 各阶段在总体进度中所占的区间
+const int kParseBegin = 0;
+const int kParseEnd = 50;
+const int kPyramidBegin = 50;
+const int kPyramidEnd = 70;
+const int kMeshBegin = 70;
+const int kMeshEnd = 100;
+// 重新生成时先转换存储类型
+const int kConvertBegin = 0;
+const int kConvertEnd = 30;
+// 生成不规则三角网时网格生成占用到kTinBegin
+const int kTinBegin = 90;
+const int kTinEnd = 100;
+
+}
+
+DemLoader::DemLoader(QObject *parent) : QObject(parent) {}
+
+DemLoader::~DemLoader() {
+    if(mpCancelFlag) *mpCancelFlag = true;
+    joinWorkers();
+}
+
+void DemLoader::load(QString path, DigitalElevationModel::SourceTypes type) {
+    quint64 maxSamples = muMaxRenderSamples;
+    start([ = ](const Stages & stages) {
+        DigitalElevationModel dem;
+
+        // 已有金字塔缓存且原始格网超出预算时，直接读取满足预算的层级
+        if(DemPyramid::isCacheValid(path)) {
+            try {
+                DemPyramid pyramid = DemPyramid::open(DemPyramid::cachePathFor(path));
+                const auto& base = pyramid.level(0);
+                if(!pyramid.isEmpty() && base.cols * base.rows > maxSamples) {
+                    dem = pyramid.readLevel(pyramid.levelForSampleBudget(maxSamples));
+                }
+            } catch (const char*) {
+                // 缓存损坏或不兼容，重新读取原始文件
+            }
+        }
+        if(!dem.isEmpty()) return dem;
+
+        // 读取
+        auto parseProgress = stages.progress(kParseBegin, kParseEnd, "正在读取DEM");
+        parseProgress(0.0f);
+        dem = DigitalElevationModel::loadFromFile(path, type, parseProgress);
+        if(*stages.pCancelFlag) throw "DEM loading was cancelled.";
+        if(dem.isEmpty()) throw "Failed to open DEM file.";
+
+        // 超出预算时生成金字塔缓存，并改用满足预算的层级
+        if(dem.getCols() * dem.getRows() > maxSamples) {
+            QString cachePath = DemPyramid::cachePathFor(path);
+            try {
+                DemPyramid::build(dem, cachePath, DemPyramid::DEFAULT_TILE_SIZE,
+                                  DemPyramid::CompressedTiles, 0.0f,
+                                  stages.progress(kPyramidBegin, kPyramidEnd, "正在生成金字塔缓存"),
+                                  QFileInfo(path).size());
+                DemPyramid pyramid = DemPyramid::open(cachePath);
+                dem = pyramid.readLevel(pyramid.levelForSampleBudget(maxSamples));
+            } catch (const char*) {
+                // 缓存无法写入时退回原始分辨率，取消则继续向外抛出
+                if(*stages.pCancelFlag) throw;
+            }
+        }
+        return dem;
+    }, kMeshBegin, kMeshBegin, false);
+}
+
+void DemLoader::loadWindow(QString path, quint64 row, quint64 col, quint64 rows, quint64 cols,
+                           const DigitalElevationModel &pagedDem) {
+    quint64 maxSamples = muMaxRenderSamples;
+    start([ = ](const Stages & stages) {
+        stages.progress(kParseBegin, kParseEnd, "正在读取窗口")(0.0f);
+        if(rows == 0 || cols == 0) throw "The window is empty.";
+        if(!DemPyramid::isCacheValid(path)) throw "The pyramid cache of this DEM is missing or out of date.";
+        DemPyramid pyramid = DemPyramid::open(DemPyramid::cachePathFor(path));
+        if(pyramid.isEmpty()) throw "Failed to open the pyramid cache.";
+
+        // 窗口在所选层级中覆盖的格网范围
+        quint32 level = pyramid.levelForWindow(rows, cols, maxSamples);
+        quint64 levelRow = row >> level, levelCol = col >> level;
+        quint64 levelRows = ((row + rows - 1) >> level) - levelRow + 1;
+        quint64 levelCols = ((col + cols - 1) >> level) - levelCol + 1;
+        const DemPyramid::LevelInfo& info = pyramid.level(level);
+        DemTileCache* pCache = pagedDem.tileCache();
+        DigitalElevationModel dem = pCache && pCache->cols() == info.cols && pCache->rows() == info.rows ?
+                                    pCache->readWindow(levelRow, levelCol, levelRows, levelCols) :
+                                    pyramid.readWindow(level, levelRow, levelCol, levelRows, levelCols);
+        if(dem.isEmpty()) throw "The window is outside of the DEM.";
+        return dem;
+    }, kMeshBegin, kMeshBegin, false);
+}
+
+void DemLoader::rebuild(const DigitalElevationModel &dem) {
+    start([dem](const Stages&) {
+        return dem;
+    }, kConvertBegin, kConvertEnd, true);
+}
+
+void DemLoader::start(std::function<DigitalElevationModel(const Stages&)> source, int convertBegin,
+                      int meshBegin, bool rebuild) {
+    // 取消上一个请求，不在GUI线程中等待：旧工作线程持有各自的数据，在下一个检查点退出后再回收
+    cancel();
+    retireWorker();
+
+    quint64 generation = ++muGeneration;
+    auto pCancelFlag = std::make_shared<std::atomic_bool>(false);
+    auto pFinished = std::make_shared<std::atomic_bool>(false);
+    mpCancelFlag = pCancelFlag;
+    mbLoading = true;
+
+    // 将通知投递回DemLoader所在线程，并丢弃过期请求的通知
+    // 析构函数会等待全部工作线程结束，工作线程中使用this是安全的
+    auto post = [this, generation](auto&& notify) {
+        QMetaObject::invokeMethod(this, [this, generation, notify]() {
+            if(muGeneration != generation) return;
+            notify(this);
+        }, Qt::QueuedConnection);
+    };
+
+    Stages stages;
+    stages.pCancelFlag = pCancelFlag;
+    stages.progress = [post, pCancelFlag](int begin, int end, QString stage) {
+        int lastPercent = -1;
+        return DigitalElevationModel::ProgressCallback([ = ](float fraction) mutable {
+            int percent = begin + int((end - begin) * fraction);
+            if(percent != lastPercent) {
+                lastPercent = percent;
+                post([percent, stage](DemLoader * pLoader) {
+                    emit pLoader->progressChanged(percent, stage);
+                });
+            }
+            return !*pCancelFlag;
+        });
+    };
+
+    auto fail = [post, pCancelFlag](QString text) {
+        bool wasCancelled = *pCancelFlag;
+        post([wasCancelled, text](DemLoader * pLoader) {
+            pLoader->mbLoading = false;
+            if(wasCancelled) {
+                emit pLoader->cancelled();
+            } else {
+                emit pLoader->failed(text);
+            }
+        });
+    };
+
+    // 没有进度区间的阶段只检查取消
+    auto checkCancel = [pCancelFlag](float) {
+        return !*pCancelFlag;
+    };
+
+    DigitalElevationModel::ValueType valueType = mValueType;
+    float tinMaxError = mfTinMaxError;
+    bool buildNormals = mbBuildNormals;
+
+    mWorker.pFinished = pFinished;
+    mWorker.thread = std::thread([ = ]() {
+        try {
+            auto pDem = std::make_shared<DigitalElevationModel>(source(stages));
+            if(*pCancelFlag) throw "DEM loading was cancelled.";
+
+            // 转换为紧凑存储
+            DigitalElevationModel::StorageReport report{pDem->storageBytes(), 0.0f, 0.0f};
+            if(pDem->getValueType() != valueType) {
+                auto convertProgress = stages.progress(convertBegin, meshBegin, "正在转换高程存储方式");
+                convertProgress(0.0f);
+                *pDem = pDem->toValueType(valueType, &report, convertProgress);
+            }
+
+            // 建立最小/最大值索引，之后的网格生成与高程自适应直接复用
+            pDem->minMaxIndex(checkCancel);
+            if(*pCancelFlag) throw "DEM loading was cancelled.";
+
+            // 网格生成
+            bool buildTin = tinMaxError > 0.0f;
+            auto pMesh = std::make_shared<TerrainMesh>(
+                             TerrainMesh::build(*pDem, stages.progress(meshBegin,
+                                                buildTin ? kTinBegin : kMeshEnd, "正在生成地形网格"),
+                                                buildNormals));
+            if(*pCancelFlag) throw "DEM loading was cancelled.";
+
+            // 不规则三角网
+            if(buildTin) {
+                pMesh->tin = TinMesh::build(*pDem, tinMaxError,
+                                            stages.progress(kTinBegin, kTinEnd, "正在生成不规则三角网"));
+                if(*pCancelFlag) throw "DEM loading was cancelled.";
+            }
+
+            post([pDem, pMesh, report, rebuild](DemLoader * pLoader) {
+                pLoader->mbLoading = false;
+                if(rebuild) {
+                    emit pLoader->rebuilt(*pDem, *pMesh, report);
+                } else {
+                    emit pLoader->loaded(*pDem, *pMesh);
+                }
+            });
+        } catch (const char* message) {
+            fail(message);
+        } catch (const std::bad_alloc&) {
+            // 异常不能离开工作线程，否则整个程序终止
+            fail("Not enough memory to load the DEM.");
+        } catch (const std::exception& e) {
+            fail(QString::fromLocal8Bit(e.what()));
+        } catch (...) {
+            fail("Unknown error while loading the DEM.");
+        }
+        *pFinished = true;
+    });
+}
+
+void DemLoader::cancel() {
+    if(mpCancelFlag) *mpCancelFlag = true;
+    // 使已投递但尚未处理的通知失效
+    ++muGeneration;
+    if(mbLoading) {
+        mbLoading = false;
+        emit cancelled();
+    }
+}
+
+bool DemLoader::isLoading() const {
+    return mbLoading;
+}
+
+quint64 DemLoader::maxRenderSamples() const {
+    return muMaxRenderSamples;
+}
+
+void DemLoader::setMaxRenderSamples(quint64 maxSamples) {
+    muMaxRenderSamples = maxSamples;
+}
+
+DigitalElevationModel::ValueType DemLoader::valueType() const {
+    return mValueType;
+}
+
+void DemLoader::setValueType(DigitalElevationModel::ValueType type) {
+    mValueType = type;
+}
+
+float DemLoader::tinMaxError() const {
+    return mfTinMaxError;
+}
+
+void DemLoader::setTinMaxError(float maxError) {
+    mfTinMaxError = std::max(maxError, 0.0f);
+}
+
+bool DemLoader::buildNormals() const {
+    return mbBuildNormals;
+}
+
+void DemLoader::setBuildNormals(bool enabled) {
+    mbBuildNormals = enabled;
+}
+
+void DemLoader::retireWorker() {
+    if(mWorker.thread.joinable()) {
+        mRetiredWorkers.push_back(std::move(mWorker));
+        mWorker = Worker();
+    }
+    // 已结束的线程只剩退出过程，join立即返回
+    mRetiredWorkers.erase(std::remove_if(mRetiredWorkers.begin(), mRetiredWorkers.end(), [](Worker & worker) {
+        if(!*worker.pFinished) return false;
+        worker.thread.join();
+        return true;
+    }), mRetiredWorkers.end());
+}
+
+void DemLoader::joinWorkers() {
+    retireWorker();
+    for(Worker& worker : mRetiredWorkers) {
+        worker.thread.join();
+    }
+    mRetiredWorkers.clear();
+}
@@ -0,0 +1,213 @@
+#ifndef DEMLOADER_H
+#define DEMLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "digitalelevationmodel.h"
+#include "dempyramid.h"
+#include "terrainmesh.h"
+
+/**
+ * @brief The DemLoader class
+ *
+ * 在工作线程中依次完成DEM读取、统计与网格(及可选的不规则三角网)生成，GUI线程只负责最后的GPU上传。
+ * 新的读取请求会取消尚未完成的请求，不等待其工作线程退出；信号均在DemLoader所在线程中发出。
+ *
+ * 格网点数超过渲染预算的DEM会生成(或复用)金字塔缓存，并读取满足预算的最精细层级。
+ * 读取结果按设定的高程存储类型转换后交出。
+ *
+ * 已读取的DEM改变存储类型或需要重新上传网格时，同样在工作线程中转换并重新生成网格。
+ */
+class DemLoader : public QObject {
+    Q_OBJECT
+
+public:
+    explicit DemLoader(QObject* parent = nullptr);
+    ~DemLoader();
+
+    /**
+     * @brief load 开始在后台读取DEM文件，取消之前未完成的读取
+     * @param path 文件路径
+     * @param type 数据源类型
+     */
+    void load(QString path, DigitalElevationModel::SourceTypes type);
+
+    /**
+     * @brief loadWindow 开始在后台读取金字塔缓存中的矩形窗口，取消之前未完成的请求
+     *
+     * 窗口以第0级(原始分辨率)格网坐标给出，读取窗口格网点数不超过渲染预算的最精细层级，
+     * 只访问该层级中窗口覆盖的瓦片。金字塔缓存不存在或已过期时失败。
+     * @param path DEM文件路径
+     * @param row 窗口起始行
+     * @param col 窗口起始列
+     * @param rows 窗口行数
+     * @param cols 窗口列数
+     * @param pagedDem 同一金字塔的分页DEM，所选层级即其瓦片缓存的层级时经缓存读取(复用已缓存与预取的瓦片)
+     */
+    void loadWindow(QString path, quint64 row, quint64 col, quint64 rows, quint64 cols,
+                    const DigitalElevationModel& pagedDem = DigitalElevationModel());
+
+    /**
+     * @brief rebuild 开始在后台将已读取的DEM转换为设定的存储类型并重新生成网格，取消之前未完成的请求
+     * @param dem DEM数据，与调用方共享只读存储
+     */
+    void rebuild(const DigitalElevationModel& dem);
+
+    /**
+     * @brief cancel 取消当前读取
+     */
+    void cancel();
+
+    /**
+     * @brief isLoading 是否有读取正在进行
+     * @return
+     */
+    bool isLoading() const;
+
+    /**
+     * @brief maxRenderSamples 获取渲染格网点数预算
+     * @return
+     */
+    quint64 maxRenderSamples() const;
+
+    /**
+     * @brief setMaxRenderSamples 设置渲染格网点数预算，对之后的读取请求生效
+     * @param maxSamples 格网点数上限
+     */
+    void setMaxRenderSamples(quint64 maxSamples);
+
+    /**
+     * @brief valueType 获取读取结果的高程存储类型
+     * @return
+     */
+    DigitalElevationModel::ValueType valueType() const;
+
+    /**
+     * @brief setValueType 设置读取结果的高程存储类型，对之后的读取请求生效
+     * @param type 存储类型
+     */
+    void setValueType(DigitalElevationModel::ValueType type);
+
+    /**
+     * @brief tinMaxError 获取不规则三角网的最大高程误差
+     * @return 误差(m)，0表示不生成
+     */
+    float tinMaxError() const;
+
+    /**
+     * @brief setTinMaxError 设置是否在网格生成后生成不规则三角网，对之后的读取请求生效
+     * @param maxError 最大高程误差(m)，0表示不生成
+     */
+    void setTinMaxError(float maxError);
+
+    /**
+     * @brief buildNormals 获取是否计算地表法向
+     * @return
+     */
+    bool buildNormals() const;
+
+    /**
+     * @brief setBuildNormals 设置网格生成时是否计算地表法向(山体阴影关闭时不需要)，对之后的读取请求生效
+     * @param enabled 是否计算
+     */
+    void setBuildNormals(bool enabled);
+
+signals:
+    /**
+     * @brief progressChanged 读取进度变化
+     * @param percent 总体进度(0~100)
+     * @param stage 当前阶段描述
+     */
+    void progressChanged(int percent, QString stage);
+
+    /**
+     * @brief loaded 读取完成
+     * @param dem DEM数据
+     * @param mesh 地形网格
+     */
+    void loaded(const DigitalElevationModel& dem, const TerrainMesh& mesh);
+
+    /**
+     * @brief rebuilt 重新生成完成
+     * @param dem 转换存储类型后的DEM数据
+     * @param mesh 地形网格
+     * @param report 存储类型转换报告(相对于转换前的数据)，未转换时误差为0
+     */
+    void rebuilt(const DigitalElevationModel& dem, const TerrainMesh& mesh,
+                 const DigitalElevationModel::StorageReport& report);
+
+    /**
+     * @brief failed 读取失败
+     * @param message 错误信息
+     */
+    void failed(QString message);
+
+    /**
+     * @brief cancelled 读取被取消
+     */
+    void cancelled();
+
+private:
+    /**
+     * @brief The Stages struct 工作线程中各阶段共用的进度汇报与取消标记
+     */
+    struct Stages {
+        // 生成在[begin, end]区间内汇报进度的回调，回调返回false表示已取消
+        std::function<DigitalElevationModel::ProgressCallback(int, int, QString)> progress{};
+        std::shared_ptr<std::atomic_bool> pCancelFlag{};
+    };
+
+    /**
+     * @brief start 取消之前的请求，在新的工作线程中取得DEM，再转换存储类型并生成网格
+     * @param source 在工作线程中取得DEM
+     * @param convertBegin 存储类型转换的进度起点
+     * @param meshBegin 网格生成的进度起点(即转换的终点)
+     * @param rebuild 完成时发出rebuilt而不是loaded
+     */
+    void start(std::function<DigitalElevationModel(const Stages&)> source, int convertBegin,
+               int meshBegin, bool rebuild);
+
+    /**
+     * @brief The Worker struct 工作线程及其结束标记
+     */
+    struct Worker {
+        std::thread thread{};
+        std::shared_ptr<std::atomic_bool> pFinished{};
+    };
+
+    /**
+     * @brief retireWorker 将当前工作线程移入待回收列表，并回收其中已结束的线程，不等待未结束的线程
+     */
+    void retireWorker();
+
+    /**
+     * @brief joinWorkers 等待全部工作线程结束
+     */
+    void joinWorkers();
+
+private:
+    // 当前工作线程
+    Worker mWorker{};
+    // 已取消、尚未回收的工作线程，各自持有所需的数据
+    std::vector<Worker> mRetiredWorkers{};
+    // 当前读取请求的取消标记，工作线程持有同一对象
+    std::shared_ptr<std::atomic_bool> mpCancelFlag{};
+    // 请求序号，用于丢弃已被取代的请求发出的通知
+    quint64 muGeneration{0};
+    bool mbLoading{false};
+    // 渲染格网点数预算，默认4096 x 4096
+    quint64 muMaxRenderSamples{4096ull * 4096ull};
+    // 读取结果的高程存储类型
+    DigitalElevationModel::ValueType mValueType{DigitalElevationModel::Float32};
+    // 不规则三角网的最大高程误差，0表示不生成
+    float mfTinMaxError{0.0f};
+    // 是否计算地表法向
+    bool mbBuildNormals{true};
+};
+
+#endif // DEMLOADER_H
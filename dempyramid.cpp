@@ -0,0 +1,462 @@
+#include "dempyramid.h"
+#include <QFileInfo>
+#include <QSaveFile>
+#include <algorithm>
+#include <thread>
+#include "elevationcodec.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+
+/**
+ * 金字塔缓存文件格式
+ *
+ * [PyramidHeader][LevelInfo * levelCount][TileInfo * tileCount][填充至4096字节对齐]
+ * [瓦片数据: 每个瓦片 tileSize * tileSize 个float，越界部分填充无数据值；
+ *  压缩存储时为ElevationCodec编码结果，长度不定]
+ * 缓存只在本机使用，按本机字节序写入，字节序不符时视为无效缓存。
+ * 头部记录生成时原始DEM文件的字节数，与修改时间一起判断缓存是否过期。
+ */
+const char kPyramidMagic[8] = {'D', 'E', 'M', 'P', 'Y', 'R', 'D', '\0'};
+const quint32 kPyramidVersion = 2;
+const quint32 kEndianMarker = 0x01020304;
+const quint64 kPayloadAlignment = 4096;
+
+struct PyramidHeader {
+    char magic[8];
+    quint32 version;
+    quint32 endianMarker;
+    quint32 tileSize;
+    quint32 levelCount;
+    quint32 tileEncoding;
+    float quantStep;
+    quint64 cols;
+    quint64 rows;
+    double lowerLeftX;
+    double lowerLeftY;
+    double cellSize;
+    double noData;
+    quint64 tileCount;
+    // 原始DEM文件字节数，未知时为0
+    quint64 sourceBytes;
+};
+
+quint64 alignUp(quint64 value, quint64 alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief downsample 将格网行列数减半，2x2邻域取有效值均值
+ * @param valueAt 按行优先序号读取源格网的函数
+ */
+template<typename Accessor>
+std::vector<float> downsample(Accessor valueAt, quint64 srcCols, quint64 srcRows,
+                              quint64 dstCols, quint64 dstRows, float noData) {
+    std::vector<float> dst(dstCols * dstRows);
+    for(quint64 y = 0; y < dstRows; ++y) {
+        for(quint64 x = 0; x < dstCols; ++x) {
+            float sum = 0.0f;
+            int count = 0;
+            for(quint64 sy = y * 2; sy < std::min(y * 2 + 2, srcRows); ++sy) {
+                for(quint64 sx = x * 2; sx < std::min(x * 2 + 2, srcCols); ++sx) {
+                    float value = valueAt(sy * srcCols + sx);
+                    if(value == noData) continue;
+                    sum += value;
+                    ++count;
+                }
+            }
+            dst[y * dstCols + x] = count ? sum / count : noData;
+        }
+    }
+    return dst;
+}
+
+}
+
+void DemPyramid::build(const DigitalElevationModel &dem, QString path, quint32 tileSize,
+                       TileEncoding encoding, float quantStep,
+                       const DigitalElevationModel::ProgressCallback &progress, quint64 sourceBytes) {
+    if(dem.isEmpty()) {
+        throw "Cannot build a pyramid for an empty DEM.";
+    }
+    if(tileSize == 0) {
+        throw "Pyramid tile size must be positive.";
+    }
+
+    // 计算各层级尺寸
+    std::vector<LevelInfo> levels{};
+    quint64 cols = dem.getCols(), rows = dem.getRows(), tileCount = 0;
+    while(true) {
+        LevelInfo info{};
+        info.cols = cols;
+        info.rows = rows;
+        info.tilesX = quint32((cols + tileSize - 1) / tileSize);
+        info.tilesY = quint32((rows + tileSize - 1) / tileSize);
+        info.firstTile = tileCount;
+        levels.push_back(info);
+        tileCount += quint64(info.tilesX) * info.tilesY;
+        if(cols <= tileSize && rows <= tileSize) break;
+        cols = (cols + 1) / 2;
+        rows = (rows + 1) / 2;
+    }
+
+    PyramidHeader header{};
+    std::memcpy(header.magic, kPyramidMagic, sizeof(kPyramidMagic));
+    header.version = kPyramidVersion;
+    header.endianMarker = kEndianMarker;
+    header.tileSize = tileSize;
+    header.levelCount = quint32(levels.size());
+    header.tileEncoding = encoding;
+    header.quantStep = quantStep;
+    header.cols = dem.getCols();
+    header.rows = dem.getRows();
+    header.lowerLeftX = dem.getLowerLeftX();
+    header.lowerLeftY = dem.getLowerLeftY();
+    header.cellSize = dem.getCellSize();
+    header.noData = dem.getNoDataValue();
+    header.tileCount = tileCount;
+    header.sourceBytes = sourceBytes;
+
+    quint64 tileTableOffset = sizeof(PyramidHeader) + levels.size() * sizeof(LevelInfo);
+    quint64 payloadOffset = alignUp(tileTableOffset + tileCount * sizeof(TileInfo),
+                                    kPayloadAlignment);
+    quint64 tileBytes = quint64(tileSize) * tileSize * sizeof(float);
+
+    std::vector<TileInfo> tiles(tileCount);
+    quint64 nextOffset = payloadOffset;
+
+    // 写入同目录的临时文件，完整写出后才替换到缓存路径；取消或失败时临时文件随对象析构删除，
+    // 缓存路径上不会出现瓦片表未回填的文件
+    QSaveFile file(path);
+    file.open(QIODevice::WriteOnly);
+    if(!file.isOpen()) {
+        throw "Failed to open pyramid cache file for writing.";
+    }
+
+    auto writeBytes = [&file](const void* pData, quint64 size) {
+        if(file.write(reinterpret_cast<const char*>(pData), size) != qint64(size)) {
+            throw "Failed to write pyramid cache file.";
+        }
+    };
+
+    // 瓦片表在数据写完、最小/最大高程统计完成后回填
+    writeBytes(&header, sizeof(PyramidHeader));
+    writeBytes(levels.data(), levels.size() * sizeof(LevelInfo));
+    std::vector<char> padding(payloadOffset - tileTableOffset, 0);
+    writeBytes(padding.data(), padding.size());
+
+    float noData = dem.getNoDataValue();
+    std::vector<float> tileBuffer(quint64(tileSize) * tileSize);
+    std::vector<float> levelData{};
+    quint64 tilesWritten = 0;
+
+    // 第0级按DEM存储类型解码读取，之后各级读取上一级的降采样结果
+    auto levelValueAt = [&](quint32 l, quint64 index) {
+        return l == 0 ? dem.getElevByIndex(index) : levelData[index];
+    };
+
+    for(quint32 l = 0; l < levels.size(); ++l) {
+        const LevelInfo& info = levels[l];
+        if(l > 0) {
+            const LevelInfo& finer = levels[l - 1];
+            levelData = downsample([&](quint64 index) {
+                return levelValueAt(l - 1, index);
+            }, finer.cols, finer.rows, info.cols, info.rows, noData);
+        }
+
+        for(quint32 ty = 0; ty < info.tilesY; ++ty) {
+            for(quint32 tx = 0; tx < info.tilesX; ++tx) {
+                std::fill(tileBuffer.begin(), tileBuffer.end(), noData);
+                float minElev = std::numeric_limits<float>::max();
+                float maxElev = -minElev;
+
+                quint64 row0 = quint64(ty) * tileSize, col0 = quint64(tx) * tileSize;
+                quint64 rowEnd = std::min(row0 + tileSize, info.rows);
+                quint64 colEnd = std::min(col0 + tileSize, info.cols);
+                for(quint64 y = row0; y < rowEnd; ++y) {
+                    for(quint64 x = col0; x < colEnd; ++x) {
+                        float value = levelValueAt(l, y * info.cols + x);
+                        tileBuffer[(y - row0) * tileSize + (x - col0)] = value;
+                        if(value == noData) continue;
+                        minElev = std::min(minElev, value);
+                        maxElev = std::max(maxElev, value);
+                    }
+                }
+
+                TileInfo& tile = tiles[info.firstTile + quint64(ty) * info.tilesX + tx];
+                tile.minElev = minElev <= maxElev ? minElev : noData;
+                tile.maxElev = minElev <= maxElev ? maxElev : noData;
+                tile.offset = nextOffset;
+                if(encoding == CompressedTiles) {
+                    QByteArray encoded = ElevationCodec::encode(tileBuffer.data(), tileSize, tileSize,
+                                         noData, quantStep);
+                    tile.size = encoded.size();
+                    writeBytes(encoded.constData(), tile.size);
+                } else {
+                    tile.size = tileBytes;
+                    writeBytes(tileBuffer.data(), tileBytes);
+                }
+                nextOffset += tile.size;
+
+                ++tilesWritten;
+                if(progress && !progress(float(tilesWritten) / tileCount)) {
+                    throw "Pyramid generation was cancelled.";
+                }
+            }
+        }
+    }
+
+    if(!file.seek(tileTableOffset)) {
+        throw "Failed to write pyramid cache file.";
+    }
+    writeBytes(tiles.data(), tiles.size() * sizeof(TileInfo));
+    if(!file.commit()) {
+        throw "Failed to write pyramid cache file.";
+    }
+}
+
+DemPyramid DemPyramid::open(QString path) {
+    DemPyramid pyramid;
+    pyramid.mpFile = std::make_shared<QFile>(path);
+    pyramid.mpFile->open(QFile::ReadOnly);
+    if(!pyramid.mpFile->isOpen()) return DemPyramid();
+
+    qint64 fileSize = pyramid.mpFile->size();
+    if(fileSize < qint64(sizeof(PyramidHeader))) {
+        throw "Pyramid cache file is too small to contain a header.";
+    }
+    pyramid.mpMapped = pyramid.mpFile->map(0, fileSize);
+    if(!pyramid.mpMapped) {
+        throw "Failed to map pyramid cache file into memory.";
+    }
+
+    PyramidHeader header;
+    std::memcpy(&header, pyramid.mpMapped, sizeof(PyramidHeader));
+    if(std::memcmp(header.magic, kPyramidMagic, sizeof(kPyramidMagic)) != 0
+            || header.version != kPyramidVersion
+            || header.endianMarker != kEndianMarker) {
+        throw "Not a compatible pyramid cache file.";
+    }
+
+    quint64 tileTableOffset = sizeof(PyramidHeader) + header.levelCount * sizeof(LevelInfo);
+    if(header.tileSize == 0 || header.levelCount == 0
+            || (header.tileEncoding != RawTiles && header.tileEncoding != CompressedTiles)
+            || tileTableOffset + header.tileCount * sizeof(TileInfo) > quint64(fileSize)) {
+        throw "Malformed pyramid cache header.";
+    }
+
+    pyramid.muTileSize = header.tileSize;
+    pyramid.mTileEncoding = TileEncoding(header.tileEncoding);
+    pyramid.muCols = header.cols;
+    pyramid.muRows = header.rows;
+    pyramid.mfLowerLeftX = header.lowerLeftX;
+    pyramid.mfLowerLeftY = header.lowerLeftY;
+    pyramid.mfCellSize = header.cellSize;
+    pyramid.mfNoData = header.noData;
+
+    pyramid.mLevels.resize(header.levelCount);
+    std::memcpy(pyramid.mLevels.data(), pyramid.mpMapped + sizeof(PyramidHeader),
+                header.levelCount * sizeof(LevelInfo));
+    pyramid.mpTiles = reinterpret_cast<const TileInfo*>(pyramid.mpMapped + tileTableOffset);
+
+    // 校验各层级的瓦片均在瓦片表内
+    for(const LevelInfo& info : pyramid.mLevels) {
+        if(info.firstTile > header.tileCount
+                || quint64(info.tilesX) * info.tilesY > header.tileCount - info.firstTile) {
+            throw "Malformed pyramid cache: level tiles outside of the tile table.";
+        }
+    }
+
+    // 校验瓦片数据均位于瓦片表之后、文件之内
+    quint64 payloadBegin = tileTableOffset + header.tileCount * sizeof(TileInfo);
+    quint64 tileBytes = quint64(header.tileSize) * header.tileSize * sizeof(float);
+    for(quint64 i = 0; i < header.tileCount; ++i) {
+        const TileInfo& tile = pyramid.mpTiles[i];
+        if(tile.size == 0 || tile.offset < payloadBegin
+                || tile.offset > quint64(fileSize) || tile.size > quint64(fileSize) - tile.offset
+                || (header.tileEncoding == RawTiles && tile.size != tileBytes)) {
+            throw "Malformed pyramid cache: tile data outside of the file.";
+        }
+    }
+
+    return pyramid;
+}
+
+QString DemPyramid::cachePathFor(QString demPath) {
+    return demPath + ".pyr";
+}
+
+bool DemPyramid::isCacheValid(QString demPath) {
+    QFileInfo cacheInfo(cachePathFor(demPath));
+    QFileInfo demInfo(demPath);
+    if(!cacheInfo.exists() || cacheInfo.lastModified() < demInfo.lastModified()) return false;
+
+    // 修改时间可能早于缓存(如从别处拷贝替换)，再比较生成时记录的文件大小
+    QFile file(cacheInfo.filePath());
+    PyramidHeader header;
+    if(!file.open(QFile::ReadOnly) || file.read(reinterpret_cast<char*>(&header),
+            sizeof(PyramidHeader)) != qint64(sizeof(PyramidHeader))) {
+        return false;
+    }
+    return std::memcmp(header.magic, kPyramidMagic, sizeof(kPyramidMagic)) == 0
+           && header.version == kPyramidVersion && header.endianMarker == kEndianMarker
+           && header.sourceBytes == quint64(demInfo.size());
+}
+
+bool DemPyramid::isEmpty() const {
+    return mLevels.empty();
+}
+
+float DemPyramid::lowerLeftX() const {
+    return mfLowerLeftX;
+}
+
+float DemPyramid::lowerLeftY() const {
+    return mfLowerLeftY;
+}
+
+quint32 DemPyramid::tileSize() const {
+    return muTileSize;
+}
+
+quint32 DemPyramid::levelCount() const {
+    return quint32(mLevels.size());
+}
+
+const DemPyramid::LevelInfo &DemPyramid::level(quint32 level) const {
+    Q_ASSERT(level < mLevels.size());
+    return mLevels[level];
+}
+
+const DemPyramid::TileInfo &DemPyramid::tile(quint32 level, quint32 tileX, quint32 tileY) const {
+    const LevelInfo& info = this->level(level);
+    Q_ASSERT(tileX < info.tilesX && tileY < info.tilesY);
+    return mpTiles[info.firstTile + quint64(tileY) * info.tilesX + tileX];
+}
+
+float DemPyramid::cellSize(quint32 level) const {
+    return mfCellSize * float(1ull << level);
+}
+
+float DemPyramid::noDataValue() const {
+    return mfNoData;
+}
+
+DemPyramid::TileEncoding DemPyramid::tileEncoding() const {
+    return mTileEncoding;
+}
+
+quint32 DemPyramid::levelForSampleBudget(quint64 maxSamples) const {
+    for(quint32 l = 0; l < mLevels.size(); ++l) {
+        if(mLevels[l].cols * mLevels[l].rows <= maxSamples) return l;
+    }
+    return levelCount() - 1;
+}
+
+quint32 DemPyramid::levelForWindow(quint64 rows, quint64 cols, quint64 maxSamples) const {
+    if(rows == 0 || cols == 0) return 0;
+    for(quint32 l = 0; l < mLevels.size(); ++l) {
+        // 窗口起点不对齐时在该层级最多多覆盖一行一列
+        quint64 levelRows = std::min(((rows - 1) >> l) + 2, mLevels[l].rows);
+        quint64 levelCols = std::min(((cols - 1) >> l) + 2, mLevels[l].cols);
+        if(levelRows * levelCols <= maxSamples) return l;
+    }
+    return levelCount() - 1;
+}
+
+quint32 DemPyramid::levelForResolution(float cellSize) const {
+    quint32 result = 0;
+    for(quint32 l = 0; l < mLevels.size(); ++l) {
+        if(this->cellSize(l) <= cellSize) result = l;
+    }
+    return result;
+}
+
+DigitalElevationModel DemPyramid::readWindow(quint32 level, quint64 row, quint64 col,
+        quint64 rows, quint64 cols) const {
+    const LevelInfo& info = this->level(level);
+    if(row >= info.rows || col >= info.cols) return DigitalElevationModel();
+    rows = std::min(rows, info.rows - row);
+    cols = std::min(cols, info.cols - col);
+
+    std::vector<float> data(rows * cols);
+
+    // 只访问窗口覆盖的瓦片
+    quint32 tx0 = quint32(col / muTileSize), tx1 = quint32((col + cols - 1) / muTileSize);
+    quint32 ty0 = quint32(row / muTileSize), ty1 = quint32((row + rows - 1) / muTileSize);
+    quint32 nTilesX = tx1 - tx0 + 1;
+    quint32 nTiles = nTilesX * (ty1 - ty0 + 1);
+
+    // 将瓦片中与窗口重叠的部分拷贝到输出，各瓦片写入区域互不重叠
+    auto copyTile = [&](quint32 tx, quint32 ty, const float* pTile) {
+        quint64 tileRow0 = quint64(ty) * muTileSize, tileCol0 = quint64(tx) * muTileSize;
+        quint64 y0 = std::max(row, tileRow0), y1 = std::min(row + rows, tileRow0 + muTileSize);
+        quint64 x0 = std::max(col, tileCol0), x1 = std::min(col + cols, tileCol0 + muTileSize);
+        for(quint64 y = y0; y < y1; ++y) {
+            std::memcpy(&data[(y - row) * cols + (x0 - col)],
+                        pTile + (y - tileRow0) * muTileSize + (x0 - tileCol0),
+                        (x1 - x0) * sizeof(float));
+        }
+    };
+
+    if(mTileEncoding == RawTiles) {
+        for(quint32 i = 0; i < nTiles; ++i) {
+            quint32 tx = tx0 + i % nTilesX, ty = ty0 + i / nTilesX;
+            copyTile(tx, ty, reinterpret_cast<const float*>(mpMapped + tile(level, tx, ty).offset));
+        }
+    } else {
+        unsigned nThreads = std::min<unsigned>(DigitalElevationModel::loaderThreadCount(), nTiles);
+        std::vector<const char*> errors(nThreads, nullptr);
+        auto decodeTiles = [&](unsigned thread) {
+            std::vector<float> buffer(quint64(muTileSize) * muTileSize);
+            try {
+                for(quint32 i = thread; i < nTiles; i += nThreads) {
+                    quint32 tx = tx0 + i % nTilesX, ty = ty0 + i / nTilesX;
+                    readTile(level, tx, ty, buffer.data());
+                    copyTile(tx, ty, buffer.data());
+                }
+            } catch (const char* message) {
+                errors[thread] = message;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for(unsigned i = 1; i < nThreads; ++i) {
+            workers.emplace_back(decodeTiles, i);
+        }
+        decodeTiles(0);
+        for(auto& worker : workers) worker.join();
+        for(const char* message : errors) {
+            if(message) throw message;
+        }
+    }
+
+    /**
+     * 计算窗口地理参考
+     *
+     * 第0行位于北边界，X轴(北向)由原始格网上边界向下推算窗口下边界。
+     */
+    float levelCellSize = cellSize(level);
+    float topX = mfLowerLeftX + mfCellSize * muRows;
+    float lowerLeftX = topX - levelCellSize * (row + rows);
+    float lowerLeftY = mfLowerLeftY + levelCellSize * col;
+
+    return DigitalElevationModel(cols, rows, lowerLeftX, lowerLeftY, levelCellSize, mfNoData,
+                                 std::move(data));
+}
+
+void DemPyramid::readTile(quint32 level, quint32 tileX, quint32 tileY, float *pOut) const {
+    const TileInfo& info = tile(level, tileX, tileY);
+    if(mTileEncoding == RawTiles) {
+        std::memcpy(pOut, mpMapped + info.offset, info.size);
+    } else {
+        ElevationCodec::decode(reinterpret_cast<const char*>(mpMapped + info.offset),
+                               info.size, pOut, muTileSize, muTileSize);
+    }
+}
+
+DigitalElevationModel DemPyramid::readLevel(quint32 level) const {
+    const LevelInfo& info = this->level(level);
+    return readWindow(level, 0, 0, info.rows, info.cols);
+}
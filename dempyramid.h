@@ -0,0 +1,186 @@
+#ifndef DEMPYRAMID_H
+#define DEMPYRAMID_H
+
+#include <QFile>
+#include <QString>
+#include <memory>
+#include <vector>
+#include "digitalelevationmodel.h"
+
+/**
+ * @brief The DemPyramid class
+ *
+ * DEM多分辨率金字塔缓存文件。
+ * 第0级为原始分辨率，之后每级行列数减半(2x2取有效值均值)，直到单个瓦片可容纳整级。
+ * 每级按固定尺寸切分为瓦片，瓦片表记录每个瓦片的数据偏移与最小/最大高程。
+ * 读取时只映射文件，按需访问请求范围覆盖的瓦片。
+ * 瓦片可用ElevationCodec压缩存储，读取时多线程并行解压。
+ */
+class DemPyramid {
+public:
+    // 默认瓦片边长(格网数)
+    static const quint32 DEFAULT_TILE_SIZE = 256;
+
+    enum TileEncoding : quint32 {
+        // 原始float数据，可直接从映射内存读取
+        RawTiles = 0,
+        // ElevationCodec压缩数据
+        CompressedTiles = 1,
+    };
+
+    /**
+     * @brief The LevelInfo struct 金字塔层级信息
+     */
+    struct LevelInfo {
+        quint64 cols;
+        quint64 rows;
+        quint32 tilesX;
+        quint32 tilesY;
+        // 该级第一个瓦片在瓦片表中的序号
+        quint64 firstTile;
+    };
+
+    /**
+     * @brief The TileInfo struct 瓦片信息
+     */
+    struct TileInfo {
+        // 瓦片数据在文件中的偏移与字节数
+        quint64 offset;
+        quint64 size;
+        // 瓦片内有效高程范围，全部无数据时均为无数据值
+        float minElev;
+        float maxElev;
+    };
+
+public:
+    DemPyramid() = default;
+
+    /**
+     * @brief build 由DEM生成金字塔缓存文件
+     *
+     * 先写入临时文件，完整写出后替换到path，取消或写入失败时path保持不变。
+     * 写入失败时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param path 缓存文件路径
+     * @param tileSize 瓦片边长
+     * @param encoding 瓦片存储方式
+     * @param quantStep 压缩存储时的量化步长(m)，不大于0时无损
+     * @param progress 进度回调，返回false时中止
+     * @param sourceBytes 原始DEM文件的字节数，供isCacheValid判断缓存是否过期
+     */
+    static void build(const DigitalElevationModel& dem, QString path,
+                      quint32 tileSize = DEFAULT_TILE_SIZE,
+                      TileEncoding encoding = CompressedTiles,
+                      float quantStep = 0.0f,
+                      const DigitalElevationModel::ProgressCallback& progress =
+                          DigitalElevationModel::ProgressCallback(),
+                      quint64 sourceBytes = 0);
+
+    /**
+     * @brief open 映射金字塔缓存文件
+     *
+     * 文件格式不符时抛出异常(const char*)。
+     * @param path 缓存文件路径
+     * @return 金字塔，文件无法打开时为空
+     */
+    static DemPyramid open(QString path);
+
+    /**
+     * @brief cachePathFor 获取DEM文件对应的金字塔缓存路径
+     * @param demPath DEM文件路径
+     * @return 缓存文件路径
+     */
+    static QString cachePathFor(QString demPath);
+
+    /**
+     * @brief isCacheValid 判断DEM文件的金字塔缓存是否存在、不早于DEM文件且记录的文件大小与之相同
+     * @param demPath DEM文件路径
+     * @return true/false
+     */
+    static bool isCacheValid(QString demPath);
+
+    bool isEmpty() const;
+    float lowerLeftX() const;
+    float lowerLeftY() const;
+    quint32 tileSize() const;
+    quint32 levelCount() const;
+    const LevelInfo& level(quint32 level) const;
+    const TileInfo& tile(quint32 level, quint32 tileX, quint32 tileY) const;
+    float cellSize(quint32 level) const;
+    float noDataValue() const;
+    TileEncoding tileEncoding() const;
+
+    /**
+     * @brief levelForSampleBudget 选择格网点数不超过预算的最精细层级
+     * @param maxSamples 格网点数上限
+     * @return 层级
+     */
+    quint32 levelForSampleBudget(quint64 maxSamples) const;
+
+    /**
+     * @brief levelForWindow 选择窗口格网点数不超过预算的最精细层级
+     * @param rows 窗口行数(第0级格网)
+     * @param cols 窗口列数(第0级格网)
+     * @param maxSamples 格网点数上限
+     * @return 层级
+     */
+    quint32 levelForWindow(quint64 rows, quint64 cols, quint64 maxSamples) const;
+
+    /**
+     * @brief levelForResolution 选择格网尺寸不超过给定分辨率的最粗层级
+     * @param cellSize 期望的格网尺寸(m)
+     * @return 层级
+     */
+    quint32 levelForResolution(float cellSize) const;
+
+    /**
+     * @brief readWindow 读取某一层级中的矩形窗口
+     *
+     * 只访问窗口覆盖的瓦片，压缩瓦片多线程并行解压，返回带有对应地理参考的DEM。
+     * @param level 层级
+     * @param row 窗口起始行(该层级格网坐标)
+     * @param col 窗口起始列
+     * @param rows 窗口行数
+     * @param cols 窗口列数
+     * @return 窗口DEM
+     */
+    DigitalElevationModel readWindow(quint32 level, quint64 row, quint64 col,
+                                     quint64 rows, quint64 cols) const;
+
+    /**
+     * @brief readLevel 读取整个层级
+     * @param level 层级
+     * @return 该层级的DEM
+     */
+    DigitalElevationModel readLevel(quint32 level) const;
+
+    /**
+     * @brief readTile 读取单个完整瓦片(tileSize * tileSize，越界部分为无数据值)
+     *
+     * 数据损坏时抛出异常(const char*)。可在多个线程中同时调用。
+     * @param level 层级
+     * @param tileX 瓦片列号
+     * @param tileY 瓦片行号
+     * @param pOut 输出缓冲
+     */
+    void readTile(quint32 level, quint32 tileX, quint32 tileY, float* pOut) const;
+
+private:
+    // 映射文件，金字塔拷贝之间共享
+    std::shared_ptr<QFile> mpFile{};
+    const uchar* mpMapped{nullptr};
+
+    quint32 muTileSize{0};
+    TileEncoding mTileEncoding{RawTiles};
+    quint64 muCols{0};
+    quint64 muRows{0};
+    float mfLowerLeftX{0};
+    float mfLowerLeftY{0};
+    float mfCellSize{0};
+    float mfNoData{0};
+
+    std::vector<LevelInfo> mLevels{};
+    const TileInfo* mpTiles{nullptr};
+};
+
+#endif // DEMPYRAMID_H
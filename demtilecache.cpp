@@ -0,0 +1,257 @@
+#include "demtilecache.h"
+#include <algorithm>
+#include <cmath>
+
+DemTileCache::DemTileCache(DemPyramid pyramid, quint32 level, quint64 budgetBytes) :
+    mPyramid(std::move(pyramid)),
+    muLevel(level),
+    muInstanceId(suNextInstanceId++) {
+    Q_ASSERT(!mPyramid.isEmpty() && level < mPyramid.levelCount());
+    muTileBytes = quint64(mPyramid.tileSize()) * mPyramid.tileSize() * sizeof(float);
+    muBudgetBytes = std::max(budgetBytes, muTileBytes);
+    mPrefetchThread = std::thread(&DemTileCache::prefetchLoop, this);
+}
+
+DemTileCache::~DemTileCache() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mbStopping = true;
+    }
+    mPrefetchCondition.notify_all();
+    mPrefetchThread.join();
+}
+
+quint64 DemTileCache::cols() const {
+    return mPyramid.level(muLevel).cols;
+}
+
+quint64 DemTileCache::rows() const {
+    return mPyramid.level(muLevel).rows;
+}
+
+float DemTileCache::cellSize() const {
+    return mPyramid.cellSize(muLevel);
+}
+
+const DemPyramid &DemTileCache::pyramid() const {
+    return mPyramid;
+}
+
+float DemTileCache::getElev(quint64 row, quint64 col) const {
+    Q_ASSERT(row < rows() && col < cols());
+    quint32 tileSize = mPyramid.tileSize();
+    quint32 tileX = quint32(col / tileSize), tileY = quint32(row / tileSize);
+
+    /**
+     * 同一线程的连续访问大多落在同一瓦片内，
+     * 线程局部记录最近一次访问的瓦片以避免每次加锁查表。
+     * 记录持有的瓦片不会被淘汰；取样命中先在线程局部计数，切换瓦片时才写入共享计数。
+     * 切换到另一个缓存实例时原实例可能已析构，其未汇总的计数直接丢弃。
+     */
+    thread_local quint64 lastInstanceId = 0;
+    thread_local quint64 lastKey = 0;
+    thread_local Tile lastTile{};
+    thread_local quint64 pendingSampleHits = 0;
+
+    quint64 key = tileKey(tileX, tileY);
+    if(lastInstanceId != muInstanceId || lastKey != key || !lastTile) {
+        if(lastInstanceId == muInstanceId) muSampleHits += pendingSampleHits;
+        pendingSampleHits = 0;
+        // 先释放旧瓦片使其可被淘汰，查表时新瓦片移到LRU最前
+        lastTile.reset();
+        lastTile = tile(tileX, tileY);
+        lastInstanceId = muInstanceId;
+        lastKey = key;
+    } else {
+        ++pendingSampleHits;
+    }
+    return (*lastTile)[(row % tileSize) * tileSize + col % tileSize];
+}
+
+DemTileCache::Tile DemTileCache::tile(quint32 tileX, quint32 tileY) const {
+    quint64 key = tileKey(tileX, tileY);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mEntries.find(key);
+        if(it != mEntries.end()) {
+            ++muHits;
+            mLru.splice(mLru.begin(), mLru, it->second.lruPosition);
+            return it->second.tile;
+        }
+        ++muMisses;
+    }
+
+    // 读取与解压不持有锁，其他线程可继续访问已缓存的瓦片
+    Tile loaded = loadTile(tileX, tileY);
+    std::lock_guard<std::mutex> lock(mMutex);
+    return insertLocked(key, loaded);
+}
+
+DigitalElevationModel DemTileCache::readWindow(quint64 row, quint64 col, quint64 rows,
+        quint64 cols) const {
+    if(row >= this->rows() || col >= this->cols()) return DigitalElevationModel();
+    rows = std::min(rows, this->rows() - row);
+    cols = std::min(cols, this->cols() - col);
+    std::vector<float> data(rows * cols);
+
+    // 窗口覆盖的瓦片分给多个线程，已缓存的瓦片直接拷贝，其余的读取后放入缓存
+    quint32 tileSize = mPyramid.tileSize();
+    quint32 tx0 = quint32(col / tileSize), tx1 = quint32((col + cols - 1) / tileSize);
+    quint32 ty0 = quint32(row / tileSize), ty1 = quint32((row + rows - 1) / tileSize);
+    quint32 nTilesX = tx1 - tx0 + 1;
+    quint32 nTiles = nTilesX * (ty1 - ty0 + 1);
+    unsigned nThreads = std::min<unsigned>(DigitalElevationModel::loaderThreadCount(), nTiles);
+    std::vector<const char*> errors(nThreads, nullptr);
+
+    auto copyTiles = [&](unsigned thread) {
+        try {
+            for(quint32 i = thread; i < nTiles; i += nThreads) {
+                quint32 tx = tx0 + i % nTilesX, ty = ty0 + i / nTilesX;
+                Tile pTile = tile(tx, ty);
+                quint64 tileRow0 = quint64(ty) * tileSize, tileCol0 = quint64(tx) * tileSize;
+                quint64 y0 = std::max(row, tileRow0), y1 = std::min(row + rows, tileRow0 + tileSize);
+                quint64 x0 = std::max(col, tileCol0), x1 = std::min(col + cols, tileCol0 + tileSize);
+                for(quint64 y = y0; y < y1; ++y) {
+                    std::copy_n(pTile->data() + (y - tileRow0) * tileSize + (x0 - tileCol0), x1 - x0,
+                                &data[(y - row) * cols + (x0 - col)]);
+                }
+            }
+        } catch (const char* message) {
+            errors[thread] = message;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        workers.emplace_back(copyTiles, i);
+    }
+    copyTiles(0);
+    for(auto& worker : workers) worker.join();
+    for(const char* message : errors) {
+        if(message) throw message;
+    }
+
+    // 第0行位于北边界，与DemPyramid::readWindow相同
+    float levelCellSize = cellSize();
+    float topX = mPyramid.lowerLeftX() + mPyramid.cellSize(0) * mPyramid.level(0).rows;
+    return DigitalElevationModel(cols, rows, topX - levelCellSize * (row + rows),
+                                 mPyramid.lowerLeftY() + levelCellSize * col, levelCellSize,
+                                 mPyramid.noDataValue(), std::move(data));
+}
+
+void DemTileCache::prefetchAlong(double row, double col, double dirRow, double dirCol,
+                                 int nTiles) {
+    double length = std::sqrt(dirRow * dirRow + dirCol * dirCol);
+    if(length == 0.0 || nTiles <= 0) return;
+
+    quint32 tileSize = mPyramid.tileSize();
+    const DemPyramid::LevelInfo& info = mPyramid.level(muLevel);
+    dirRow = dirRow / length * tileSize;
+    dirCol = dirCol / length * tileSize;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // 新的视线方向使之前排队的预取失去意义
+        mPrefetchQueue.clear();
+        for(int i = 0; i <= nTiles; ++i) {
+            double r = row + dirRow * i, c = col + dirCol * i;
+            if(r < 0 || c < 0 || r >= info.rows || c >= info.cols) break;
+            quint64 key = tileKey(quint32(c / tileSize), quint32(r / tileSize));
+            if(mEntries.count(key)) continue;
+            mPrefetchQueue.push_back(key);
+        }
+    }
+    mPrefetchCondition.notify_one();
+}
+
+void DemTileCache::setBudgetBytes(quint64 budgetBytes) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    muBudgetBytes = std::max(budgetBytes, muTileBytes);
+    evictLocked();
+}
+
+DemTileCache::Stats DemTileCache::stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Stats stats{};
+    stats.hits = muHits;
+    stats.misses = muMisses;
+    stats.sampleHits = muSampleHits;
+    stats.evictions = muEvictions;
+    stats.prefetches = muPrefetches;
+    stats.residentTiles = mEntries.size();
+    stats.residentBytes = mEntries.size() * muTileBytes;
+    for(const auto& entry : mEntries) {
+        if(entry.second.tile.use_count() > 1) ++stats.pinnedTiles;
+    }
+    stats.budgetBytes = muBudgetBytes;
+    return stats;
+}
+
+void DemTileCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    muHits = muMisses = muSampleHits = muEvictions = muPrefetches = 0;
+}
+
+quint64 DemTileCache::tileKey(quint32 tileX, quint32 tileY) const {
+    return (quint64(tileY) << 32) | tileX;
+}
+
+DemTileCache::Tile DemTileCache::loadTile(quint32 tileX, quint32 tileY) const {
+    auto pTile = std::make_shared<std::vector<float>>(muTileBytes / sizeof(float));
+    mPyramid.readTile(muLevel, tileX, tileY, pTile->data());
+    return pTile;
+}
+
+DemTileCache::Tile DemTileCache::insertLocked(quint64 key, Tile tile) const {
+    // 其他线程可能已先一步读入同一瓦片
+    auto it = mEntries.find(key);
+    if(it != mEntries.end()) {
+        mLru.splice(mLru.begin(), mLru, it->second.lruPosition);
+        return it->second.tile;
+    }
+    mLru.push_front(key);
+    mEntries.emplace(key, Entry{tile, mLru.begin()});
+    evictLocked();
+    return tile;
+}
+
+void DemTileCache::evictLocked() const {
+    // 缓存之外的引用(线程局部记录、tile()的调用者)只在持有锁时增加，看到的引用数不会偏小
+    auto it = mLru.end();
+    while(it != mLru.begin() && mEntries.size() * muTileBytes > muBudgetBytes) {
+        --it;
+        auto entry = mEntries.find(*it);
+        if(entry->second.tile.use_count() > 1) continue;
+        mEntries.erase(entry);
+        it = mLru.erase(it);
+        ++muEvictions;
+    }
+}
+
+void DemTileCache::prefetchLoop() {
+    while(true) {
+        quint64 key;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mPrefetchCondition.wait(lock, [this]() {
+                return mbStopping || !mPrefetchQueue.empty();
+            });
+            if(mbStopping) return;
+            key = mPrefetchQueue.front();
+            mPrefetchQueue.pop_front();
+            if(mEntries.count(key)) continue;
+        }
+
+        Tile loaded;
+        try {
+            loaded = loadTile(quint32(key & 0xffffffffu), quint32(key >> 32));
+        } catch (const char*) {
+            // 预取失败不影响正常访问，访问时会再次读取并报告错误
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        insertLocked(key, loaded);
+        ++muPrefetches;
+    }
+}
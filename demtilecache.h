@@ -0,0 +1,162 @@
+#ifndef DEMTILECACHE_H
+#define DEMTILECACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "dempyramid.h"
+
+/**
+ * @brief The DemTileCache class
+ *
+ * 基于金字塔缓存文件的分页高程访问。
+ * 高程按瓦片从文件读取(必要时解压)，驻留在容量受限的LRU缓存中，
+ * 超出内存预算时淘汰最久未使用的瓦片，使远大于内存的DEM也能按格网点访问。
+ * 仍被持有的瓦片(各线程最近访问的瓦片、tile()返回后未释放的瓦片)不会被淘汰，计入常驻内存，
+ * 因此常驻内存可能超出预算，超出量不超过持有瓦片的线程数个瓦片。
+ * 后台线程可沿相机视线方向预取瓦片。所有公有函数都是线程安全的。
+ */
+class DemTileCache {
+public:
+    // 默认内存预算(字节)
+    static const quint64 DEFAULT_BUDGET_BYTES = 512ull * 1024 * 1024;
+
+    /**
+     * @brief The Stats struct 缓存统计
+     */
+    struct Stats {
+        // 瓦片查找的命中与未命中次数
+        quint64 hits;
+        quint64 misses;
+        // getElev直接由线程局部瓦片取得的格网点数，在各线程切换瓦片时汇总
+        quint64 sampleHits;
+        quint64 evictions;
+        quint64 prefetches;
+        // 常驻瓦片数与字节数，包括仍被持有的瓦片
+        quint64 residentTiles;
+        quint64 residentBytes;
+        // 仍被持有而不能淘汰的瓦片数
+        quint64 pinnedTiles;
+        quint64 budgetBytes;
+    };
+
+    using Tile = std::shared_ptr<const std::vector<float>>;
+
+public:
+    /**
+     * @param pyramid 金字塔缓存
+     * @param level 提供数据的层级
+     * @param budgetBytes 内存预算(字节)，至少保留一个瓦片
+     */
+    explicit DemTileCache(DemPyramid pyramid, quint32 level = 0,
+                          quint64 budgetBytes = DEFAULT_BUDGET_BYTES);
+    ~DemTileCache();
+
+    DemTileCache(const DemTileCache&) = delete;
+    DemTileCache& operator=(const DemTileCache&) = delete;
+
+    quint64 cols() const;
+    quint64 rows() const;
+    float cellSize() const;
+    const DemPyramid& pyramid() const;
+
+    /**
+     * @brief getElev 获取格网点高程，所在瓦片不在缓存中时同步读取
+     * @param row 行号
+     * @param col 列号
+     * @return
+     */
+    float getElev(quint64 row, quint64 col) const;
+
+    /**
+     * @brief tile 获取瓦片，不在缓存中时同步读取
+     *
+     * 返回的瓦片在被持有期间不会被淘汰。
+     * @param tileX 瓦片列号
+     * @param tileY 瓦片行号
+     * @return 瓦片数据，tileSize * tileSize 个值
+     */
+    Tile tile(quint32 tileX, quint32 tileY) const;
+
+    /**
+     * @brief readWindow 经缓存读取矩形窗口，窗口覆盖的瓦片多线程读取并留在缓存中
+     *
+     * 瓦片数据损坏时抛出异常(const char*)。
+     * @param row 窗口起始行
+     * @param col 窗口起始列
+     * @param rows 窗口行数
+     * @param cols 窗口列数
+     * @return 带有对应地理参考的窗口DEM
+     */
+    DigitalElevationModel readWindow(quint64 row, quint64 col, quint64 rows, quint64 cols) const;
+
+    /**
+     * @brief prefetchAlong 沿给定方向预取瓦片
+     *
+     * 从起点所在瓦片开始沿方向每次前进一个瓦片，将尚未缓存的瓦片交给后台线程读取。
+     * @param row 起点行号(格网坐标，可为小数)
+     * @param col 起点列号
+     * @param dirRow 方向行分量
+     * @param dirCol 方向列分量
+     * @param nTiles 预取距离(瓦片数)
+     */
+    void prefetchAlong(double row, double col, double dirRow, double dirCol, int nTiles);
+
+    /**
+     * @brief setBudgetBytes 设置内存预算，超出时立即淘汰
+     * @param budgetBytes 内存预算(字节)
+     */
+    void setBudgetBytes(quint64 budgetBytes);
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+    quint64 tileKey(quint32 tileX, quint32 tileY) const;
+    Tile loadTile(quint32 tileX, quint32 tileY) const;
+    // 插入瓦片并按预算淘汰，需持有锁
+    Tile insertLocked(quint64 key, Tile tile) const;
+    // 从最久未使用的瓦片开始淘汰，跳过仍被持有的瓦片，需持有锁
+    void evictLocked() const;
+    void prefetchLoop();
+
+private:
+    struct Entry {
+        Tile tile;
+        std::list<quint64>::iterator lruPosition;
+    };
+
+    DemPyramid mPyramid;
+    quint32 muLevel{0};
+    quint64 muTileBytes{0};
+
+    mutable std::mutex mMutex;
+    // 最近使用的瓦片在前
+    mutable std::list<quint64> mLru{};
+    mutable std::unordered_map<quint64, Entry> mEntries{};
+    quint64 muBudgetBytes{DEFAULT_BUDGET_BYTES};
+
+    // 实例序号，区分线程局部记录所属的缓存(地址可能被新实例复用)
+    const quint64 muInstanceId;
+    inline static std::atomic<quint64> suNextInstanceId{1};
+
+    mutable quint64 muHits{0};
+    mutable quint64 muMisses{0};
+    mutable std::atomic<quint64> muSampleHits{0};
+    mutable quint64 muEvictions{0};
+    quint64 muPrefetches{0};
+
+    // 后台预取
+    std::deque<quint64> mPrefetchQueue{};
+    std::condition_variable mPrefetchCondition{};
+    bool mbStopping{false};
+    std::thread mPrefetchThread{};
+};
+
+#endif // DEMTILECACHE_H
@@ -1,5 +1,722 @@
 #include "digitalelevationmodel.h"
+#include "demtilecache.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <QtEndian>
+#include <thread>
 
+namespace {
+
+/**
+ * ASCII Grid 原地解析工具
+ *
+ * 所有函数直接在映射的文件内存上移动游标，不分配内存、不拷贝文本。
+ */
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* skipBlanks(const char* p, const char* pEnd) {
+    while(p < pEnd && isBlank(*p)) ++p;
+    return p;
+}
+
+inline const char* skipToken(const char* p, const char* pEnd) {
+    while(p < pEnd && !isBlank(*p)) ++p;
+    return p;
+}
+
+// 10的整数次幂(双精度可精确表示的范围)
+const double kPow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * @brief parseDecimal 解析[p, pEnd)范围内的一个十进制浮点数，标准库不支持浮点std::from_chars时使用
+ *
+ * 与std::from_chars约定相同：成功时返回数值结束位置，失败时返回nullptr。
+ * 尾数取前19位有效数字。尾数不超过2^53且十进制指数在±22以内时只做一次乘除，结果为正确舍入；
+ * 否则会多次舍入，误差在几个ulp以内。DEM文件中常见的写法(如"1234.56")属于前者。
+ * @param p 数值起始位置
+ * @param pEnd 可读范围末尾
+ * @param value 解析结果
+ * @return 数值结束位置或nullptr
+ */
+const char* parseDecimal(const char* p, const char* pEnd, double& value) {
+    bool negative = false;
+    if(p < pEnd && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    quint64 mantissa = 0;
+    int digits = 0;         // 已计入尾数的有效数字个数
+    int exponent = 0;       // 十进制指数修正
+    bool anyDigit = false;
+
+    for(; p < pEnd && *p >= '0' && *p <= '9'; ++p) {
+        anyDigit = true;
+        if(digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if(mantissa) ++digits;
+        } else {
+            ++exponent;
+        }
+    }
+    if(p < pEnd && *p == '.') {
+        ++p;
+        for(; p < pEnd && *p >= '0' && *p <= '9'; ++p) {
+            anyDigit = true;
+            if(digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if(!anyDigit) return nullptr;
+
+    if(p < pEnd && (*p == 'e' || *p == 'E')) {
+        const char* pExp = p + 1;
+        bool expNegative = false;
+        if(pExp < pEnd && (*pExp == '-' || *pExp == '+')) {
+            expNegative = *pExp == '-';
+            ++pExp;
+        }
+        if(pExp < pEnd && *pExp >= '0' && *pExp <= '9') {
+            int e = 0;
+            for(; pExp < pEnd && *pExp >= '0' && *pExp <= '9'; ++pExp) {
+                if(e < 10000) e = e * 10 + (*pExp - '0');
+            }
+            exponent += expNegative ? -e : e;
+            p = pExp;
+        }
+    }
+
+    double result = static_cast<double>(mantissa);
+    if(mantissa != 0) {
+        if(exponent < 0) {
+            while(exponent < -22) {
+                result /= kPow10[22];
+                exponent += 22;
+            }
+            result /= kPow10[-exponent];
+        } else {
+            while(exponent > 22) {
+                result *= kPow10[22];
+                exponent -= 22;
+            }
+            result *= kPow10[exponent];
+        }
+    }
+
+    value = negative ? -result : result;
+    return p;
+}
+
+/**
+ * @brief parseNumber 解析[p, pEnd)范围内的一个十进制浮点数
+ *
+ * 与std::from_chars约定相同：成功时返回数值结束位置，失败时返回nullptr。
+ * 只接受可带正负号的十进制写法，不接受inf与nan。
+ * 标准库支持浮点std::from_chars时直接解析为目标类型，结果为正确舍入；
+ * 否则由parseDecimal解析为double再转换，转换为float时会再舍入一次。
+ * @param p 数值起始位置
+ * @param pEnd 可读范围末尾
+ * @param value 解析结果
+ * @return 数值结束位置或nullptr
+ */
+template<typename T>
+const char* parseNumber(const char* p, const char* pEnd, T& value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    const char* pDigits = p < pEnd && (*p == '+' || *p == '-') ? p + 1 : p;
+    if(pDigits == pEnd || !((*pDigits >= '0' && *pDigits <= '9') || *pDigits == '.')) return nullptr;
+    // from_chars不接受正号
+    auto result = std::from_chars(*p == '+' ? pDigits : p, pEnd, value);
+    if(result.ec == std::errc()) return result.ptr;
+    // 超出目标类型范围时与parseDecimal相同得到无穷大或0
+    if(result.ec != std::errc::result_out_of_range) return nullptr;
+#endif
+    double parsed = 0;
+    const char* pNext = parseDecimal(p, pEnd, parsed);
+    if(pNext) value = static_cast<T>(parsed);
+    return pNext;
+}
+
+/**
+ * @brief keywordEquals 不区分大小写比较文件头关键字
+ */
+bool keywordEquals(const char* p, const char* pEnd, const char* keyword) {
+    std::size_t length = std::strlen(keyword);
+    if(std::size_t(pEnd - p) != length) return false;
+    for(std::size_t i = 0; i < length; ++i) {
+        char c = p[i];
+        if(c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+        if(c != keyword[i]) return false;
+    }
+    return true;
+}
+
+// 每解析该数量的格网值检查一次取消并汇报进度
+const quint64 kProgressBlockCells = 1 << 18;
+
+const char* const kCancelledMessage = "DEM loading was cancelled.";
+
+/**
+ * @brief The ParseMonitor struct 格网解析进度与取消状态，可在多个解析线程间共享
+ *
+ * 进度回调只在调用线程中调用：工作线程每完成一块只累加进度并唤醒调用线程，
+ * 调用线程解析完自己的块后继续等待并汇报，直到全部工作线程结束。
+ * 所有线程每块检查一次取消状态。
+ */
+struct ParseMonitor {
+    const DigitalElevationModel::ProgressCallback* pCallback = nullptr;
+    quint64 total = 0;
+    std::atomic<quint64> done{0};
+    std::atomic_bool cancelled{false};
+    std::mutex mutex{};
+    std::condition_variable changed{};
+
+    /**
+     * @brief poll 以当前进度调用进度回调，回调返回false时标记取消。只在调用线程中使用
+     */
+    void poll() {
+        if(pCallback && *pCallback && !(*pCallback)(float(done) / total)) {
+            cancelled = true;
+        }
+    }
+
+    /**
+     * @brief notify 唤醒在reportWhile中等待的调用线程
+     */
+    void notify() {
+        // 加锁后再通知，避免调用线程检查条件与开始等待之间的通知丢失
+        { std::lock_guard<std::mutex> lock(mutex); }
+        changed.notify_all();
+    }
+
+    /**
+     * @brief advance 记录已完成的格网数，已取消时抛出取消异常
+     * @param cells 新完成的格网数
+     * @param report 是否为调用线程(由其调用进度回调)
+     */
+    void advance(quint64 cells, bool report) {
+        done += cells;
+        if(report) {
+            poll();
+        } else {
+            notify();
+        }
+        if(cancelled) {
+            throw kCancelledMessage;
+        }
+    }
+
+    /**
+     * @brief reportWhile 调用线程等待工作线程期间持续汇报进度
+     * @param running 仍在运行的工作线程数，工作线程结束时递减并调用notify
+     */
+    void reportWhile(const std::atomic<unsigned>& running) {
+        std::unique_lock<std::mutex> lock(mutex);
+        quint64 reported = done;
+        while(running) {
+            changed.wait(lock, [&]() {
+                return !running || done != reported;
+            });
+            reported = done;
+            lock.unlock();
+            poll();
+            lock.lock();
+        }
+    }
+};
+
+/**
+ * @brief parseCells 将[p, pEnd)中的格网数值依次写入pOut
+ * @param count 需要读取的数值个数
+ * @param pMonitor 进度与取消状态，可为空
+ * @param report 是否由当前线程汇报进度
+ * @return 读取结束位置
+ */
+const char* parseCells(const char* p, const char* pEnd, float* pOut, quint64 count,
+                       ParseMonitor* pMonitor = nullptr, bool report = true) {
+    for(quint64 blockBegin = 0; blockBegin < count; blockBegin += kProgressBlockCells) {
+        quint64 blockEnd = std::min(count, blockBegin + kProgressBlockCells);
+        for(quint64 i = blockBegin; i < blockEnd; ++i) {
+            p = skipBlanks(p, pEnd);
+            if(p == pEnd) {
+                throw "DEM file ended before all grid cells were read.";
+            }
+            float value = 0;
+            const char* pNext = parseNumber(p, pEnd, value);
+            if(!pNext || (pNext < pEnd && !isBlank(*pNext))) {
+                throw "Malformed elevation value in DEM file.";
+            }
+            pOut[i] = value;
+            p = pNext;
+        }
+        if(pMonitor) pMonitor->advance(blockEnd - blockBegin, report);
+    }
+    return p;
+}
+
+/**
+ * @brief countTokens 统计[p, pEnd)中以空白分隔的记号个数
+ *
+ * 每统计一块检查一次取消，已取消时提前返回(计数不完整)，由调用者检查pMonitor->cancelled。
+ * @param pMonitor 进度与取消状态，可为空
+ * @param report 是否为调用线程(由其调用进度回调检查取消)
+ */
+quint64 countTokens(const char* p, const char* pEnd,
+                    ParseMonitor* pMonitor = nullptr, bool report = true) {
+    quint64 count = 0;
+    while(true) {
+        p = skipBlanks(p, pEnd);
+        if(p == pEnd) break;
+        p = skipToken(p, pEnd);
+        ++count;
+        if(pMonitor && count % kProgressBlockCells == 0) {
+            if(report) {
+                pMonitor->poll();
+            } else {
+                pMonitor->notify();
+            }
+            if(pMonitor->cancelled) break;
+        }
+    }
+    return count;
+}
+
+// 格网数据小于该字节数时不启用多线程解析
+const qint64 kParallelParseMinBytes = 1 << 20;
+
+/**
+ * @brief parseCellsChunked 按给定的分块位置多线程解析格网数值
+ *
+ * 各块边界推进到下一个空白字符，保证分块不会切断数值；
+ * 先并行统计各块记号数，前缀和得到每块在输出中的偏移，再并行写入各自的切片。
+ * 每个数值仍由parseNumber解析，结果(包括错误)与串行解析逐位一致。
+ * @param splits 各块的起始位置(不含第一块)，递增排列，线程数为 splits.size() + 1
+ * @param pMonitor 进度与取消状态，各块所在线程每块检查取消，进度由调用线程汇报
+ */
+void parseCellsChunked(const char* p, const char* pEnd, float* pOut, quint64 count,
+                       const std::vector<const char*>& splits, ParseMonitor* pMonitor) {
+    const unsigned nThreads = unsigned(splits.size()) + 1;
+
+    // 划分块边界
+    std::vector<const char*> bounds(nThreads + 1);
+    bounds[0] = p;
+    bounds[nThreads] = pEnd;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        const char* pBound = std::clamp(splits[i - 1], bounds[i - 1], pEnd);
+        bounds[i] = skipToken(pBound, pEnd);
+    }
+
+    // 第一块在调用线程中处理，之后调用线程等待其余线程并汇报进度
+    auto runParallel = [nThreads, pMonitor](auto&& job) {
+        std::atomic<unsigned> running{nThreads - 1};
+        std::vector<std::thread> workers;
+        workers.reserve(nThreads - 1);
+        for(unsigned i = 1; i < nThreads; ++i) {
+            workers.emplace_back([&job, &running, pMonitor, i]() {
+                job(i);
+                --running;
+                if(pMonitor) pMonitor->notify();
+            });
+        }
+        job(0);
+        if(pMonitor) pMonitor->reportWhile(running);
+        for(auto& worker : workers) worker.join();
+    };
+
+    // 第一遍：统计各块记号数
+    std::vector<quint64> offsets(nThreads + 1, 0);
+    runParallel([&](unsigned i) {
+        offsets[i + 1] = countTokens(bounds[i], bounds[i + 1], pMonitor, i == 0);
+    });
+    if(pMonitor && pMonitor->cancelled) {
+        throw kCancelledMessage;
+    }
+    for(unsigned i = 0; i < nThreads; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    if(offsets[nThreads] < count) {
+        // 数据不足时串行解析，若不足之前已有非法数值，与串行解析一样报告非法数值
+        parseCells(p, pEnd, pOut, count, pMonitor);
+        throw "DEM file ended before all grid cells were read.";
+    }
+
+    // 第二遍：各块解析到各自的输出切片，多余的尾部记号与串行解析一样忽略
+    std::vector<const char*> errors(nThreads, nullptr);
+    runParallel([&](unsigned i) {
+        if(offsets[i] >= count) return;
+        quint64 chunkCount = std::min(offsets[i + 1], count) - offsets[i];
+        try {
+            parseCells(bounds[i], bounds[i + 1], pOut + offsets[i], chunkCount,
+                       pMonitor, i == 0);
+        } catch (const char* message) {
+            errors[i] = message;
+            // 任一块出错时让其余线程尽早退出
+            if(pMonitor) pMonitor->cancelled = true;
+        }
+    });
+    // 优先报告解析错误而非由其引发的取消
+    const char* pCancelMessage = nullptr;
+    for(const char* message : errors) {
+        if(!message) continue;
+        if(message == kCancelledMessage) {
+            if(!pCancelMessage) pCancelMessage = message;
+            continue;
+        }
+        throw message;
+    }
+    if(pCancelMessage) throw pCancelMessage;
+}
+
+/**
+ * @brief parseCellsParallel 多线程分块解析格网数值，按字节均分为nThreads块
+ * @param nThreads 线程数
+ * @param pMonitor 进度与取消状态
+ */
+void parseCellsParallel(const char* p, const char* pEnd, float* pOut, quint64 count,
+                        unsigned nThreads, ParseMonitor* pMonitor) {
+    if(nThreads <= 1 || pEnd - p < kParallelParseMinBytes) {
+        parseCells(p, pEnd, pOut, count, pMonitor);
+        return;
+    }
+
+    std::vector<const char*> splits(nThreads - 1);
+    qint64 totalBytes = pEnd - p;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        splits[i - 1] = p + totalBytes * i / nThreads;
+    }
+    parseCellsChunked(p, pEnd, pOut, count, splits, pMonitor);
+}
+
+/**
+ * 二进制DEM文件格式
+ *
+ * [BinaryHeader][填充至kBinaryDataAlignment][rows * cols个高程值]
+ * 高程数据按写入端字节序存储，读取端字节序一致时直接使用映射内存。
+ */
+const char kBinaryMagic[8] = {'D', 'E', 'M', 'B', 'I', 'N', '\0', '\0'};
+const quint32 kBinaryVersion = 2;
+const quint32 kEndianMarker = 0x01020304;
+const quint64 kBinaryDataAlignment = 4096;
+
+struct BinaryHeader {
+    char magic[8];
+    quint32 version;
+    quint32 headerSize;
+    quint32 endianMarker;
+    quint32 valueType;
+    quint64 cols;
+    quint64 rows;
+    double lowerLeftX;
+    double lowerLeftY;
+    double cellSize;
+    double noData;
+    quint64 dataOffset;
+    quint64 dataSize;
+    // 版本2起：定点存储的缩放与偏移
+    double valueScale;
+    double valueOffset;
+};
+
+/**
+ * @brief swappedCopy 翻转字节序后拷贝到堆内存
+ */
+template<typename T>
+std::shared_ptr<const std::vector<T>> swappedCopy(const uchar* pSrc, quint64 count) {
+    auto pVector = std::make_shared<std::vector<T>>(count);
+    const T* pValues = reinterpret_cast<const T*>(pSrc);
+    for(quint64 i = 0; i < count; ++i) {
+        (*pVector)[i] = qbswap(pValues[i]);
+    }
+    return pVector;
+}
+
+}
+
+DigitalElevationModel DigitalElevationModel::loadFromBinary(QString path) {
+    auto pFile = std::make_shared<QFile>(path);
+    pFile->open(QFile::ReadOnly);
+    if(!pFile->isOpen()) return DigitalElevationModel();
+
+    qint64 fileSize = pFile->size();
+    if(fileSize < qint64(sizeof(BinaryHeader))) {
+        throw "Binary DEM file is too small to contain a header.";
+    }
+
+    uchar* pMapped = pFile->map(0, fileSize);
+    if(!pMapped) {
+        throw "Failed to map DEM file into memory.";
+    }
+
+    BinaryHeader header;
+    std::memcpy(&header, pMapped, sizeof(BinaryHeader));
+    if(std::memcmp(header.magic, kBinaryMagic, sizeof(kBinaryMagic)) != 0) {
+        throw "Not a binary DEM file.";
+    }
+
+    // 字节序与本机不同时文件头各字段需逐一翻转
+    bool swapped = header.endianMarker != kEndianMarker;
+    if(swapped) {
+        if(qbswap(header.endianMarker) != kEndianMarker) {
+            throw "Malformed binary DEM header: bad endianness marker.";
+        }
+        header.version = qbswap(header.version);
+        header.headerSize = qbswap(header.headerSize);
+        header.valueType = qbswap(header.valueType);
+        header.cols = qbswap(header.cols);
+        header.rows = qbswap(header.rows);
+        header.lowerLeftX = qbswap(header.lowerLeftX);
+        header.lowerLeftY = qbswap(header.lowerLeftY);
+        header.cellSize = qbswap(header.cellSize);
+        header.noData = qbswap(header.noData);
+        header.dataOffset = qbswap(header.dataOffset);
+        header.dataSize = qbswap(header.dataSize);
+        header.valueScale = qbswap(header.valueScale);
+        header.valueOffset = qbswap(header.valueOffset);
+    }
+
+    if(header.version < 1 || header.version > kBinaryVersion) {
+        throw "Unsupported binary DEM version.";
+    }
+    if(header.version < 2) {
+        // 版本1只有单精度存储，文件头之后为零填充
+        header.valueScale = 1.0;
+        header.valueOffset = 0.0;
+    }
+    if(header.valueType != Float32 && header.valueType != Int16 && header.valueType != Float16) {
+        throw "Unsupported binary DEM value type.";
+    }
+    ValueType valueType = ValueType(header.valueType);
+    quint64 bytesPerValue = valueSize(valueType);
+    if(header.cols == 0 || header.rows == 0
+            || header.dataSize != header.cols * header.rows * bytesPerValue
+            || header.dataOffset % bytesPerValue != 0
+            || header.dataOffset + header.dataSize > quint64(fileSize)) {
+        throw "Malformed binary DEM header: data section does not match the file.";
+    }
+
+    const uchar* pMappedData = pMapped + header.dataOffset;
+    DigitalElevationModel dem(header.cols, header.rows, header.lowerLeftX, header.lowerLeftY,
+                              header.cellSize, header.noData);
+    quint64 count = header.cols * header.rows;
+
+    if(swapped) {
+        // 异字节序文件无法直接使用映射数据，翻转后存入堆内存
+        if(valueType == Float32) {
+            auto pVector = swappedCopy<float>(pMappedData, count);
+            dem.setStorage(pVector, pVector->data(), valueType, header.valueScale, header.valueOffset);
+        } else {
+            auto pVector = swappedCopy<quint16>(pMappedData, count);
+            dem.setStorage(pVector, pVector->data(), valueType, header.valueScale, header.valueOffset);
+        }
+        return dem;
+    }
+
+    // 映射随文件对象存活，由所有共享该DEM数据的拷贝共同持有
+    dem.setStorage(pFile, pMappedData, valueType, header.valueScale, header.valueOffset);
+    return dem;
+}
+
+DigitalElevationModel DigitalElevationModel::loadFromFile(QString path, SourceTypes type,
+        const ProgressCallback& progress) {
+    Profiler::Scope scope("DigitalElevationModel::loadFromFile", "io");
+    if(type.testAnyFlag(DigitalElevationModel::FromBinary)) {
+        return loadFromBinary(path);
+    }
+
+    QFile file(path);
+    file.open(QFile::ReadOnly);
+    if(!file.isOpen()) return DigitalElevationModel();
+
+    qint64 fileSize = file.size();
+    if(fileSize <= 0) {
+        throw "DEM file is empty.";
+    }
+
+    // 映射整个文件，在映射内存上原地解析
+    uchar* pMapped = file.map(0, fileSize);
+    if(!pMapped) {
+        throw "Failed to map DEM file into memory.";
+    }
+    const char* p = reinterpret_cast<const char*>(pMapped);
+    const char* pEnd = p + fileSize;
+
+    // 读取元数据
+    double cols = -1, rows = -1, cellSize = -1, noData = -9999;
+    double lowerLeftX = 0, lowerLeftY = 0;
+    bool hasX = false, hasY = false, xIsCenter = false, yIsCenter = false;
+
+    while(true) {
+        p = skipBlanks(p, pEnd);
+        if(p == pEnd) break;
+        // 关键字以字母开头，遇到数值即进入格网数据部分
+        char c = *p;
+        if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) break;
+
+        const char* pKey = p;
+        const char* pKeyEnd = skipToken(p, pEnd);
+        p = skipBlanks(pKeyEnd, pEnd);
+
+        double value = 0;
+        const char* pNext = parseNumber(p, pEnd, value);
+        if(!pNext || (pNext < pEnd && !isBlank(*pNext))) {
+            throw "Malformed DEM header: keyword without numeric value.";
+        }
+        p = pNext;
+
+        if(keywordEquals(pKey, pKeyEnd, "ncols")) {
+            cols = value;
+        } else if(keywordEquals(pKey, pKeyEnd, "nrows")) {
+            rows = value;
+        } else if(keywordEquals(pKey, pKeyEnd, "xllcorner")) {
+            lowerLeftX = value, hasX = true, xIsCenter = false;
+        } else if(keywordEquals(pKey, pKeyEnd, "xllcenter")) {
+            lowerLeftX = value, hasX = true, xIsCenter = true;
+        } else if(keywordEquals(pKey, pKeyEnd, "yllcorner")) {
+            lowerLeftY = value, hasY = true, yIsCenter = false;
+        } else if(keywordEquals(pKey, pKeyEnd, "yllcenter")) {
+            lowerLeftY = value, hasY = true, yIsCenter = true;
+        } else if(keywordEquals(pKey, pKeyEnd, "cellsize")) {
+            cellSize = value;
+        } else if(keywordEquals(pKey, pKeyEnd, "nodata_value")) {
+            noData = value;
+        } else {
+            throw "Malformed DEM header: unknown keyword.";
+        }
+    }
+
+    if(cols <= 0 || rows <= 0 || cellSize <= 0 || !hasX || !hasY) {
+        throw "Malformed DEM header: ncols, nrows, xllcorner, yllcorner and cellsize are required.";
+    }
+    // 先确认在quint64范围内再转换，超出范围的浮点数转整数是未定义行为
+    const double kMaxCount = 18446744073709551616.0;
+    if(cols >= kMaxCount || rows >= kMaxCount || cols != quint64(cols) || rows != quint64(rows)) {
+        throw "Malformed DEM header: ncols and nrows must be integers.";
+    }
+
+    // 统一转换为左下角像素的左下角坐标
+    if(xIsCenter) lowerLeftX -= cellSize / 2.0;
+    if(yIsCenter) lowerLeftY -= cellSize / 2.0;
+
+    // 行列数来自文件，分配前确认乘积不溢出且剩余数据足够容纳：每个格网值至少1个数字加1个分隔符
+    quint64 uCols = quint64(cols), uRows = quint64(rows);
+    quint64 bodyBytes = quint64(pEnd - p);
+    if(uCols > std::numeric_limits<quint64>::max() / uRows
+            || uCols * uRows > (bodyBytes + 1) / 2) {
+        throw "Malformed DEM header: ncols * nrows exceeds the grid data in the file.";
+    }
+    std::vector<float> data(uCols * uRows);
+
+    // 读取格网高程数据
+    ParseMonitor monitor;
+    monitor.pCallback = &progress;
+    monitor.total = data.size();
+    parseCellsParallel(p, pEnd, data.data(), data.size(), loaderThreadCount(), &monitor);
+
+    file.unmap(pMapped);
+
+    return DigitalElevationModel(uCols, uRows, lowerLeftX, lowerLeftY, cellSize,
+                                 noData,
+                                 std::move(data));
+}
+
+void DigitalElevationModel::saveToBinary(QString path) const {
+    if(isEmpty()) {
+        throw "Cannot save an empty DEM.";
+    }
+
+    BinaryHeader header{};
+    std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+    header.version = kBinaryVersion;
+    header.headerSize = sizeof(BinaryHeader);
+    header.endianMarker = kEndianMarker;
+    // 分页DEM逐行解码为单精度写出
+    header.valueType = pTileCache ? Float32 : eValueType;
+    header.valueScale = dValueScale;
+    header.valueOffset = dValueOffset;
+    header.cols = uCols;
+    header.rows = uRows;
+    header.lowerLeftX = dLowerLeftX;
+    header.lowerLeftY = dLowerLeftY;
+    header.cellSize = dCellSize;
+    header.noData = dNoData;
+    header.dataOffset = kBinaryDataAlignment;
+    header.dataSize = uCols * uRows * valueSize(ValueType(header.valueType));
+
+    QFile file(path);
+    file.open(QFile::WriteOnly | QFile::Truncate);
+    if(!file.isOpen()) {
+        throw "Failed to open binary DEM file for writing.";
+    }
+
+    std::vector<char> padding(header.dataOffset - sizeof(BinaryHeader), 0);
+    bool ok = file.write(reinterpret_cast<const char*>(&header), sizeof(BinaryHeader))
+              == qint64(sizeof(BinaryHeader));
+    ok = ok && file.write(padding.data(), padding.size()) == qint64(padding.size());
+    if(pTileCache) {
+        std::vector<float> rowBuffer(uCols);
+        for(quint64 row = 0; ok && row < uRows; ++row) {
+            for(quint64 col = 0; col < uCols; ++col) {
+                rowBuffer[col] = getElevByIndex(row * uCols + col);
+            }
+            ok = file.write(reinterpret_cast<const char*>(rowBuffer.data()), uCols * sizeof(float))
+                 == qint64(uCols * sizeof(float));
+        }
+    } else {
+        ok = ok && file.write(reinterpret_cast<const char*>(pData), header.dataSize)
+             == qint64(header.dataSize);
+    }
+    if(!ok) {
+        throw "Failed to write binary DEM file.";
+    }
+}
+
+void DigitalElevationModel::convertTextToBinary(QString textPath, QString binaryPath) {
+    DigitalElevationModel dem = loadFromFile(textPath, FromText);
+    if(dem.isEmpty()) {
+        throw "Failed to open ASCII DEM file.";
+    }
+    dem.saveToBinary(binaryPath);
+}
+
+std::vector<float> DigitalElevationModel::parseGridText(const QByteArray& text, quint64 count,
+        const std::vector<quint64>& splits) {
+    const char* p = text.constData();
+    const char* pEnd = p + text.size();
+    std::vector<float> data(count);
+    if(splits.empty()) {
+        parseCells(p, pEnd, data.data(), count);
+    } else {
+        std::vector<const char*> pSplits;
+        for(quint64 split : splits) pSplits.push_back(p + std::min<quint64>(split, text.size()));
+        parseCellsChunked(p, pEnd, data.data(), count, pSplits, nullptr);
+    }
+    return data;
+}
+
+unsigned DigitalElevationModel::loaderThreadCount() {
+    if(suLoaderThreads != 0) return suLoaderThreads;
+    unsigned hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads ? hardwareThreads : 1;
+}
+
+void DigitalElevationModel::setLoaderThreadCount(unsigned nThreads) {
+    suLoaderThreads = nThreads;
+}
 
 quint64 DigitalElevationModel::getRows() const {
     return uRows;
@@ -21,8 +738,164 @@ float DigitalElevationModel::getNoDataValue() const {
     return dNoData;
 }
 
-const std::vector<float>& DigitalElevationModel::getData() const {
-    return data;
+DigitalElevationModel::ValueType DigitalElevationModel::getValueType() const {
+    return eValueType;
+}
+
+const float* DigitalElevationModel::getData() const {
+    return eValueType == Float32 ? static_cast<const float*>(pData) : nullptr;
+}
+
+float DigitalElevationModel::getPagedElev(quint64 index) const {
+    return pTileCache->getElev(index / uCols, index % uCols);
+}
+
+DigitalElevationModel DigitalElevationModel::fromTileCache(std::shared_ptr<DemTileCache> pCache) {
+    const DemPyramid& pyramid = pCache->pyramid();
+    const DemPyramid::LevelInfo& base = pyramid.level(0);
+
+    // 层级格网与原始格网上边界对齐，由上边界推算层级的左下角坐标
+    float topX = pyramid.lowerLeftX() + pyramid.cellSize(0) * base.rows;
+    DigitalElevationModel dem(pCache->cols(), pCache->rows(),
+                              topX - pCache->cellSize() * pCache->rows(),
+                              pyramid.lowerLeftY(), pCache->cellSize(), pyramid.noDataValue());
+    dem.pTileCache = pCache.get();
+    dem.pStorage = pCache;
+    dem.pData = nullptr;
+    return dem;
+}
+
+DemTileCache* DigitalElevationModel::tileCache() const {
+    return pTileCache;
+}
+
+struct DigitalElevationModel::MinMaxIndex {
+    std::once_flag built;
+    MinMaxQuadtree tree;
+};
+
+std::shared_ptr<DigitalElevationModel::MinMaxIndex> DigitalElevationModel::newMinMaxIndex() {
+    return std::make_shared<MinMaxIndex>();
+}
+
+const MinMaxQuadtree& DigitalElevationModel::minMaxIndex(const ProgressCallback& progress) const {
+    MinMaxIndex& index = *pMinMaxIndex;
+    // 建立时抛出异常不会标记为已完成
+    std::call_once(index.built, [&]() {
+        index.tree = MinMaxQuadtree::build(*this, progress);
+    });
+    return index.tree;
+}
+
+MinMaxQuadtree::Stats DigitalElevationModel::getElevRange() const {
+    return minMaxIndex().total();
+}
+
+MinMaxQuadtree::Stats DigitalElevationModel::getElevRange(quint64 row, quint64 col,
+        quint64 rows, quint64 cols) const {
+    return minMaxIndex().query(*this, row, col, rows, cols);
+}
+
+const void* DigitalElevationModel::getRawData() const {
+    return pData;
+}
+
+void DigitalElevationModel::setStorage(std::shared_ptr<const void> storage, const void* data,
+                                       ValueType type, float scale, float offset) {
+    pTileCache = nullptr;
+    pMinMaxIndex = newMinMaxIndex();
+    pStorage = std::move(storage);
+    pData = data;
+    eValueType = type;
+    dValueScale = scale;
+    dValueOffset = offset;
+    dPackedNoData = type == Float16 ? float(qfloat16(dNoData)) : dNoData;
+}
+
+quint64 DigitalElevationModel::valueSize(ValueType type) {
+    switch(type) {
+    case Int16:
+        return sizeof(qint16);
+    case Float16:
+        return sizeof(qfloat16);
+    default:
+        return sizeof(float);
+    }
+}
+
+quint64 DigitalElevationModel::storageBytes() const {
+    if(pTileCache) return pTileCache->stats().residentBytes;
+    return uCols * uRows * valueSize(eValueType);
+}
+
+DigitalElevationModel DigitalElevationModel::toValueType(ValueType type,
+        StorageReport* pReport, const ProgressCallback& progress) const {
+    DigitalElevationModel dem(uCols, uRows, dLowerLeftX, dLowerLeftY, dCellSize, dNoData);
+    quint64 count = uCols * uRows;
+
+    // 每kProgressBlockCells个格网点汇报一次进度并检查取消，Int16需要遍历格网两次
+    const int passes = type == Int16 ? 2 : 1;
+    auto checkpoint = [&](int pass, quint64 i) {
+        if(progress && i % kProgressBlockCells == 0 && !progress((pass + float(i) / count) / passes)) {
+            throw "DEM conversion was cancelled.";
+        }
+    };
+
+    if(type == Int16) {
+        // 按有效高程范围确定定点参数，编码-32767~32767，-32768留给无数据
+        float minElev = std::numeric_limits<float>::max(), maxElev = -minElev;
+        for(quint64 i = 0; i < count; ++i) {
+            checkpoint(0, i);
+            float value = getElevByIndex(i);
+            if(value == dNoData) continue;
+            minElev = std::min(minElev, value);
+            maxElev = std::max(maxElev, value);
+        }
+        if(minElev > maxElev) minElev = maxElev = 0.0f;
+        float scale = maxElev > minElev ? (maxElev - minElev) / 65534.0f : 1.0f;
+
+        auto pVector = std::make_shared<std::vector<qint16>>(count);
+        for(quint64 i = 0; i < count; ++i) {
+            checkpoint(1, i);
+            float value = getElevByIndex(i);
+            (*pVector)[i] = value == dNoData ? qint16(-32768) :
+                            qint16(std::clamp<long>(std::lround((value - minElev) / scale), 0, 65534) - 32767);
+        }
+        dem.setStorage(pVector, pVector->data(), Int16, scale, minElev);
+    } else if(type == Float16) {
+        auto pVector = std::make_shared<std::vector<qfloat16>>(count);
+        for(quint64 i = 0; i < count; ++i) {
+            checkpoint(0, i);
+            (*pVector)[i] = qfloat16(getElevByIndex(i));
+        }
+        dem.setStorage(pVector, pVector->data(), Float16, 1.0f, 0.0f);
+    } else {
+        auto pVector = std::make_shared<std::vector<float>>(count);
+        for(quint64 i = 0; i < count; ++i) {
+            checkpoint(0, i);
+            (*pVector)[i] = getElevByIndex(i);
+        }
+        dem.setStorage(pVector, pVector->data(), Float32, 1.0f, 0.0f);
+    }
+
+    if(pReport) {
+        // 统计有效格网点的转换误差
+        double maxError = 0.0, sumSquares = 0.0;
+        quint64 validCount = 0;
+        for(quint64 i = 0; i < count; ++i) {
+            float original = getElevByIndex(i);
+            if(original == dNoData) continue;
+            double error = std::abs(double(dem.getElevByIndex(i)) - original);
+            maxError = std::max(maxError, error);
+            sumSquares += error * error;
+            ++validCount;
+        }
+        pReport->bytes = dem.storageBytes();
+        pReport->maxError = float(maxError);
+        pReport->rmsError = validCount ? float(std::sqrt(sumSquares / validCount)) : 0.0f;
+    }
+
+    return dem;
 }
 
 quint64 DigitalElevationModel::getCols() const {
@@ -1,12 +1,18 @@
 #ifndef DIGITALELEVATIONMODEL_H
 #define DIGITALELEVATIONMODEL_H
 
+#include <QByteArray>
 #include <QFile>
+#include <QFloat16>
 #include <QString>
-#include <QTextStream>
 #include <QVector3D>
+#include "minmaxquadtree.h"
+#include <functional>
+#include <memory>
 #include <vector>
 
+class DemTileCache;
+
 /**
  * @brief The DigitalElevationModel class
  */
@@ -23,7 +29,78 @@ private:
     float dCellSize = 0;
     // 无数据格网点的值
     float dNoData = 0;
-    std::vector<float> data {};
+    // 高程数据存储的所有者(堆内存或文件映射)，DEM拷贝之间共享只读数据
+    std::shared_ptr<const void> pStorage {};
+    // 高程数据首地址，行优先排列，类型由eValueType决定
+    const void* pData = nullptr;
+
+    // 文本解析线程数，0表示使用硬件线程数
+    inline static unsigned suLoaderThreads = 0;
+
+    /**
+     * @brief loadFromBinary 映射二进制DEM文件
+     * @param path 文件路径
+     * @return DEM数据结构体，文件无法打开时为空
+     */
+    static DigitalElevationModel loadFromBinary(QString path);
+
+public:
+    /**
+     * 高程存储类型
+     */
+    enum ValueType {
+        // 单精度浮点
+        Float32 = 0,
+        // 16位定点整数，高程 = 偏移 + 缩放 * (编码 + 32767)，-32768表示无数据
+        Int16 = 1,
+        // IEEE半精度浮点
+        Float16 = 2,
+    };
+
+    /**
+     * @brief The StorageReport struct 存储类型转换报告
+     */
+    struct StorageReport {
+        // 高程数据占用字节数
+        quint64 bytes;
+        // 有效格网点的最大与均方根高程误差(m)
+        float maxError;
+        float rmsError;
+    };
+
+private:
+    // 高程存储类型及定点解码参数
+    ValueType eValueType = Float32;
+    float dValueScale = 1.0f;
+    float dValueOffset = 0.0f;
+    // 紧凑存储中表示无数据的值(半精度时为无数据值舍入后的结果)
+    float dPackedNoData = 0.0f;
+    // 分页存储：高程经瓦片缓存按需读取，由pStorage持有
+    DemTileCache* pTileCache = nullptr;
+
+    // 最小/最大值索引，首次使用时建立，共享同一存储的DEM拷贝之间共享
+    struct MinMaxIndex;
+    std::shared_ptr<MinMaxIndex> pMinMaxIndex = newMinMaxIndex();
+
+    static std::shared_ptr<MinMaxIndex> newMinMaxIndex();
+
+    /**
+     * @brief getPagedElev 经瓦片缓存读取格网点高程
+     * @param index 序号(row * cols + col)
+     * @return
+     */
+    float getPagedElev(quint64 index) const;
+
+    /**
+     * @brief setStorage 替换高程数据存储
+     * @param storage 存储所有者
+     * @param data 高程数据首地址
+     * @param type 存储类型
+     * @param scale 定点缩放
+     * @param offset 定点偏移
+     */
+    void setStorage(std::shared_ptr<const void> storage, const void* data, ValueType type,
+                    float scale, float offset);
 
 public:
     enum SourceType {
@@ -32,6 +109,11 @@ public:
     };
     Q_DECLARE_FLAGS(SourceTypes, SourceType);
 
+    /**
+     * 进度回调，参数为完成比例(0~1)，返回false时中止当前操作
+     */
+    using ProgressCallback = std::function<bool(float)>;
+
 public:
     DigitalElevationModel(quint64 cols = 0, quint64 rows = 0,
                           float lowerLeftX = 0,
@@ -39,7 +121,10 @@ public:
                           float cellSize = 0,
                           float noData = 0, std::vector<float>&& data = std::vector<float>()):
         uCols(cols), uRows(rows), dLowerLeftX(lowerLeftX), dLowerLeftY(lowerLeftY),
-        dCellSize(cellSize), dNoData(noData), data(data) {
+        dCellSize(cellSize), dNoData(noData) {
+        auto pVector = std::make_shared<const std::vector<float>>(std::move(data));
+        pData = pVector->data();
+        pStorage = pVector;
         // 预计算地理坐标映射常数
         affineConstantX = lowerLeftX + cellSize * (rows - 0.5);
         affineConstantY = lowerLeftY + cellSize * 0.5;
@@ -48,47 +133,130 @@ public:
 
 
     /**
-     * @brief loadDEMFromText 从ASCII编码的DEM文件读取数据
+     * @brief loadFromFile 从DEM文件读取数据
+     *
+     * 文本格式(ESRI ASCII Grid)通过内存映射原地解析，不产生整文件拷贝；
+     * 较大的格网数据按空白边界分块后多线程解析。
+     * 二进制格式直接映射到内存，高程数据不拷贝到堆上。
+     * 文件头不完整、数值非法或格网数据不足时抛出异常(const char*)。
      * @param path 文件路径
-     * @return DEM数据结构体
+     * @param type 数据源类型
+     * @param progress 格网解析进度回调，只在调用线程中调用；返回false时抛出取消异常
+     * @return DEM数据结构体，文件无法打开时为空
      */
-    static DigitalElevationModel loadFromFile(QString path, SourceTypes type) {
-        if(type.testAnyFlag(DigitalElevationModel::FromBinary)) {
-            throw "Binary DEM source is not currently supported.";
-        }
+    static DigitalElevationModel loadFromFile(QString path, SourceTypes type,
+            const ProgressCallback& progress = ProgressCallback());
 
-        QFile file(path);
-        file.open(QFile::ReadOnly);
-        if(!file.isOpen()) return DigitalElevationModel();
-        QTextStream stream(file.readAll());
-
-        // 读取元数据
-        QString buffer{};
-        int cols, rows;
-        double lowerLeftX, lowerLeftY, cellSize, noData ;
-        stream >> buffer >> cols
-               >> buffer >> rows
-               >> buffer >> lowerLeftX
-               >> buffer >> lowerLeftY
-               >> buffer >> cellSize
-               >> buffer >> noData;
-
-        std::vector<float> data{};
-        data.reserve(cols * rows);
-
-        // 读取格网高程数据
-        for(int x = 0; x < cols; ++x) {
-            for(int y = 0; y < rows; ++y) {
-                float value = 0;
-                stream >> value;
-                data.push_back(value);
-            }
-        }
+    /**
+     * @brief parseGridText 解析ASCII Grid的格网数据部分，用于校验多线程分块解析
+     *
+     * 分块位置不做调整直接使用(边界仍会推进到数值之后)，可将块边界放在数值、换行或连续空白中间。
+     * 数据不足或数值非法时抛出异常(const char*)。
+     * @param text 格网数据文本(不含文件头)
+     * @param count 格网值个数
+     * @param splits 各块的起始字节位置(不含第一块)，递增排列；为空时串行解析
+     * @return 格网值
+     */
+    static std::vector<float> parseGridText(const QByteArray& text, quint64 count,
+                                            const std::vector<quint64>& splits);
 
-        return DigitalElevationModel(cols, rows, lowerLeftX, lowerLeftY, cellSize,
-                                     noData,
-                                     std::move(data));
-    }
+    /**
+     * @brief loaderThreadCount 获取文本格网解析使用的线程数
+     * @return 线程数
+     */
+    static unsigned loaderThreadCount();
+
+    /**
+     * @brief setLoaderThreadCount 设置文本格网解析使用的线程数
+     * @param nThreads 线程数，0表示使用硬件线程数，1表示串行解析
+     */
+    static void setLoaderThreadCount(unsigned nThreads);
+
+    /**
+     * @brief saveToBinary 将DEM保存为二进制格式
+     *
+     * 文件由定长文件头与按页对齐的原始高程数据组成，读取时可直接映射。
+     * 写入失败时抛出异常(const char*)。
+     * @param path 文件路径
+     */
+    void saveToBinary(QString path) const;
+
+    /**
+     * @brief convertTextToBinary 将ASCII格式DEM文件转换为二进制格式
+     * @param textPath ASCII格式DEM文件路径
+     * @param binaryPath 二进制DEM文件输出路径
+     */
+    static void convertTextToBinary(QString textPath, QString binaryPath);
+
+    /**
+     * @brief fromTileCache 创建以瓦片缓存为后端的分页DEM
+     *
+     * 高程按需从金字塔缓存读取，常驻内存受缓存预算限制。
+     * 分页DEM的getData()与getRawData()为空。
+     * @param pCache 瓦片缓存
+     * @return 分页DEM
+     */
+    static DigitalElevationModel fromTileCache(std::shared_ptr<DemTileCache> pCache);
+
+    /**
+     * @brief tileCache 获取分页DEM的瓦片缓存
+     * @return 瓦片缓存，非分页DEM时为空
+     */
+    DemTileCache* tileCache() const;
+
+    /**
+     * @brief toValueType 转换高程存储类型
+     *
+     * Int16按有效高程范围计算缩放与偏移，最大误差为缩放量的一半；
+     * Float16误差随高程绝对值增大，超出半精度范围的值会溢出。
+     * 取消时抛出异常(const char*)。
+     * @param type 目标存储类型
+     * @param pReport 转换报告，可为空
+     * @param progress 进度回调，返回false时中止
+     * @return 新的DEM，与当前DEM不共享数据
+     */
+    DigitalElevationModel toValueType(ValueType type, StorageReport* pReport = nullptr,
+                                      const ProgressCallback& progress = ProgressCallback()) const;
+
+    /**
+     * @brief valueSize 获取存储类型单个高程值的字节数
+     * @param type 存储类型
+     * @return 字节数
+     */
+    static quint64 valueSize(ValueType type);
+
+    /**
+     * @brief storageBytes 获取高程数据占用字节数
+     * @return 字节数
+     */
+    quint64 storageBytes() const;
+
+    /**
+     * @brief minMaxIndex 获取最小/最大值四叉树索引
+     *
+     * 首次调用时建立(线程安全)，之后各拷贝直接复用。
+     * 建立时被取消则抛出异常(const char*)，下次调用重新建立。
+     * @param progress 建立索引的进度回调，返回false时中止
+     * @return 索引
+     */
+    const MinMaxQuadtree& minMaxIndex(const ProgressCallback& progress = ProgressCallback()) const;
+
+    /**
+     * @brief getElevRange 获取整个格网的有效高程范围与无数据点个数
+     * @return
+     */
+    MinMaxQuadtree::Stats getElevRange() const;
+
+    /**
+     * @brief getElevRange 获取矩形窗口的有效高程范围与无数据点个数
+     * @param row 窗口起始行
+     * @param col 窗口起始列
+     * @param rows 窗口行数
+     * @param cols 窗口列数
+     * @return
+     */
+    MinMaxQuadtree::Stats getElevRange(quint64 row, quint64 col, quint64 rows,
+                                       quint64 cols) const;
 
     /**
      * @brief 判断DEM是否无数据
@@ -104,7 +272,40 @@ public:
     float getLowerLeftY() const;
     float getCellSize() const;
     float getNoDataValue() const;
-    const std::vector<float>& getData() const;
+    ValueType getValueType() const;
+
+    /**
+     * @brief getData 获取单精度高程数据
+     * @return 行优先排列的高程数据，存储类型不是Float32或为分页DEM时为空
+     */
+    const float* getData() const;
+
+    /**
+     * @brief getRawData 获取按存储类型排列的原始高程数据
+     * @return
+     */
+    const void* getRawData() const;
+
+    /**
+     * @brief getElevByIndex 按行优先序号获取格网点高程，按存储类型解码
+     * @param index 序号(row * cols + col)
+     * @return
+     */
+    inline float getElevByIndex(quint64 index)const {
+        if(pTileCache) return getPagedElev(index);
+        switch(eValueType) {
+        case Int16: {
+            qint16 code = static_cast<const qint16*>(pData)[index];
+            return code == -32768 ? dNoData : dValueOffset + dValueScale * (int(code) + 32767);
+        }
+        case Float16: {
+            float value = static_cast<const qfloat16*>(pData)[index];
+            return value == dPackedNoData ? dNoData : value;
+        }
+        default:
+            return static_cast<const float*>(pData)[index];
+        }
+    }
 
     /**
      * @brief getElev 获取格网点高程
@@ -114,7 +315,7 @@ public:
      */
     inline float getElev(quint64 row, quint64 col)const {
         Q_ASSERT(!isEmpty() && row < uRows && col < uCols);
-        return data[row * uCols + col];
+        return getElevByIndex(row * uCols + col);
     }
 
     /**
@@ -145,7 +346,7 @@ public:
         return QVector3D(
                    affineConstantX - dCellSize * row,
                    dCellSize * col + affineConstantY,
-                   data[row * uCols + col]
+                   getElevByIndex(row * uCols + col)
                );
     }
 };
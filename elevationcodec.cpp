@@ -0,0 +1,171 @@
+#include "elevationcodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+
+const char kCodecMagic[4] = {'D', 'E', 'M', 'C'};
+const quint8 kCodecVersion = 1;
+
+struct CodecHeader {
+    char magic[4];
+    quint8 version;
+    quint8 mode;
+    quint16 reserved;
+    quint32 cols;
+    quint32 rows;
+    float noData;
+    float quantStep;
+    double quantOffset;
+};
+
+/**
+ * 浮点数位模式与保序无符号整数的互相转换
+ *
+ * 正数置最高位，负数按位取反，使整数大小关系与浮点数一致，相邻高程的整数表示也相近。
+ */
+inline quint32 floatToOrdered(float value) {
+    quint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+inline float orderedToFloat(quint32 ordered) {
+    quint32 bits = (ordered & 0x80000000u) ? (ordered & 0x7fffffffu) : ~ordered;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline quint32 zigzag(quint32 residual) {
+    qint32 signedResidual = qint32(residual);
+    return (quint32(signedResidual) << 1) ^ quint32(signedResidual >> 31);
+}
+
+inline quint32 unzigzag(quint32 value) {
+    return (value >> 1) ^ (0u - (value & 1u));
+}
+
+/**
+ * @brief predict 平面预测，首行用左邻点，首列用上邻点，整数按模2^32运算
+ */
+inline quint32 predict(const quint32* pValues, quint64 x, quint64 y, quint64 cols) {
+    if(y == 0) return x == 0 ? 0u : pValues[x - 1];
+    const quint32* pRow = pValues + y * cols;
+    const quint32* pUp = pRow - cols;
+    if(x == 0) return pUp[0];
+    return pRow[x - 1] + pUp[x] - pUp[x - 1];
+}
+
+}
+
+QByteArray ElevationCodec::encode(const float *pData, quint64 cols, quint64 rows, float noData,
+                                  float quantStep, int compressionLevel) {
+    CodecHeader header{};
+    std::memcpy(header.magic, kCodecMagic, sizeof(kCodecMagic));
+    header.version = kCodecVersion;
+    header.mode = quantStep > 0.0f ? Quantized : Lossless;
+    header.cols = quint32(cols);
+    header.rows = quint32(rows);
+    header.noData = noData;
+    header.quantStep = quantStep > 0.0f ? quantStep : 0.0f;
+
+    quint64 count = cols * rows;
+    std::vector<quint32> values(count);
+
+    if(header.mode == Quantized) {
+        // 以最小有效高程为零点，0保留给无数据
+        double minElev = std::numeric_limits<double>::max();
+        double maxElev = std::numeric_limits<double>::lowest();
+        for(quint64 i = 0; i < count; ++i) {
+            if(pData[i] == noData) continue;
+            minElev = std::min(minElev, double(pData[i]));
+            maxElev = std::max(maxElev, double(pData[i]));
+        }
+        header.quantOffset = minElev <= maxElev ? minElev : 0.0;
+        // 舍入后加1须能以32位无符号整数表示(不超过0xFFFFFFFF)
+        if(minElev <= maxElev && !((maxElev - minElev) / quantStep < 4294967294.5)) {
+            throw "Quantization step is too small for the elevation range.";
+        }
+        for(quint64 i = 0; i < count; ++i) {
+            values[i] = pData[i] == noData ? 0u :
+                        quint32(std::llround((pData[i] - header.quantOffset) / quantStep)) + 1u;
+        }
+    } else {
+        for(quint64 i = 0; i < count; ++i) {
+            values[i] = floatToOrdered(pData[i]);
+        }
+    }
+
+    // 残差变长编码，每字节低7位为数据，最高位表示后续还有字节
+    QByteArray residuals;
+    residuals.reserve(count * 2);
+    for(quint64 y = 0; y < rows; ++y) {
+        for(quint64 x = 0; x < cols; ++x) {
+            quint32 value = zigzag(values[y * cols + x] - predict(values.data(), x, y, cols));
+            while(value >= 0x80u) {
+                residuals.append(char((value & 0x7fu) | 0x80u));
+                value >>= 7;
+            }
+            residuals.append(char(value));
+        }
+    }
+
+    QByteArray encoded(reinterpret_cast<const char*>(&header), sizeof(CodecHeader));
+    encoded.append(qCompress(residuals, compressionLevel));
+    return encoded;
+}
+
+void ElevationCodec::decode(const char *pEncoded, quint64 size, float *pOut, quint64 cols,
+                            quint64 rows) {
+    CodecHeader header;
+    if(size < sizeof(CodecHeader)) {
+        throw "Compressed elevation data is truncated.";
+    }
+    std::memcpy(&header, pEncoded, sizeof(CodecHeader));
+    if(std::memcmp(header.magic, kCodecMagic, sizeof(kCodecMagic)) != 0
+            || header.version != kCodecVersion) {
+        throw "Unsupported compressed elevation data.";
+    }
+    if(header.cols != cols || header.rows != rows) {
+        throw "Compressed elevation data does not match the expected size.";
+    }
+
+    QByteArray residuals = qUncompress(reinterpret_cast<const uchar*>(pEncoded + sizeof(CodecHeader)),
+                                       int(size - sizeof(CodecHeader)));
+    const uchar* p = reinterpret_cast<const uchar*>(residuals.constData());
+    const uchar* pEnd = p + residuals.size();
+
+    quint64 count = cols * rows;
+    std::vector<quint32> values(count);
+    for(quint64 y = 0; y < rows; ++y) {
+        for(quint64 x = 0; x < cols; ++x) {
+            quint32 value = 0;
+            int shift = 0;
+            while(true) {
+                if(p == pEnd || shift > 28) {
+                    throw "Compressed elevation data is corrupted.";
+                }
+                uchar byte = *p++;
+                value |= quint32(byte & 0x7fu) << shift;
+                if(!(byte & 0x80u)) break;
+                shift += 7;
+            }
+            values[y * cols + x] = unzigzag(value) + predict(values.data(), x, y, cols);
+        }
+    }
+
+    if(header.mode == Quantized) {
+        for(quint64 i = 0; i < count; ++i) {
+            pOut[i] = values[i] == 0 ? header.noData :
+                      float(header.quantOffset + double(values[i] - 1u) * header.quantStep);
+        }
+    } else {
+        for(quint64 i = 0; i < count; ++i) {
+            pOut[i] = orderedToFloat(values[i]);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ELEVATIONCODEC_H
+#define ELEVATIONCODEC_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/**
+ * @brief The ElevationCodec class
+ *
+ * 高程栅格压缩编码。
+ * 每个格网值先由左、上、左上邻点做平面预测(left + up - upLeft)，
+ * 残差经zigzag映射为无符号整数并以变长字节写出，最后交由qCompress做熵编码。
+ *
+ * 无损模式在浮点数的保序整数表示上预测，解码结果与原数据逐位一致；
+ * 量化模式按给定步长将高程转为定点整数，最大误差为步长的一半，无数据值保持不变。
+ */
+class ElevationCodec {
+public:
+    enum Mode : quint8 {
+        Lossless = 0,
+        Quantized = 1,
+    };
+
+    /**
+     * @brief encode 压缩高程栅格
+     *
+     * 量化步长过小、高程范围除以步长超出32位整数时抛出异常(const char*)。
+     * @param pData 高程数据，行优先
+     * @param cols 列数
+     * @param rows 行数
+     * @param noData 无数据值
+     * @param quantStep 量化步长(m)，不大于0时无损压缩
+     * @param compressionLevel qCompress压缩级别
+     * @return 压缩数据
+     */
+    static QByteArray encode(const float* pData, quint64 cols, quint64 rows, float noData,
+                             float quantStep = 0.0f, int compressionLevel = 6);
+
+    /**
+     * @brief decode 解压高程栅格
+     *
+     * 数据损坏或尺寸不符时抛出异常(const char*)。可在多个线程中同时调用。
+     * @param pEncoded 压缩数据
+     * @param size 压缩数据字节数
+     * @param pOut 输出缓冲，需容纳 cols * rows 个值
+     * @param cols 期望的列数
+     * @param rows 期望的行数
+     */
+    static void decode(const char* pEncoded, quint64 size, float* pOut, quint64 cols, quint64 rows);
+};
+
+#endif // ELEVATIONCODEC_H
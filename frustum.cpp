@@ -0,0 +1,40 @@
+#include "frustum.h"
+#include <cmath>
+
+Frustum Frustum::fromMatrix(const QMatrix4x4 &matrix) {
+    Frustum frustum;
+    // 裁剪空间中 -w <= x, y, z <= w，各裁剪面为矩阵第4行与前3行之和或差
+    for(int axis = 0; axis < 3; ++axis) {
+        for(int side = 0; side < 2; ++side) {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            float* plane = frustum.mPlanes[axis * 2 + side];
+            for(int col = 0; col < 4; ++col) {
+                plane[col] = matrix(3, col) + sign * matrix(axis, col);
+            }
+
+            // 归一化法向，便于调试时读取距离
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if(length > 0.0f) {
+                for(int col = 0; col < 4; ++col) plane[col] /= length;
+            }
+        }
+    }
+    return frustum;
+}
+
+Frustum::Containment Frustum::classifyBox(const QVector3D &boxMin, const QVector3D &boxMax) const {
+    Containment result = Inside;
+    for(const float* plane : mPlanes) {
+        // 沿法向最远(p)与最近(n)的角点
+        float px = plane[0] >= 0.0f ? boxMax.x() : boxMin.x();
+        float py = plane[1] >= 0.0f ? boxMax.y() : boxMin.y();
+        float pz = plane[2] >= 0.0f ? boxMax.z() : boxMin.z();
+        float nx = plane[0] >= 0.0f ? boxMin.x() : boxMax.x();
+        float ny = plane[1] >= 0.0f ? boxMin.y() : boxMax.y();
+        float nz = plane[2] >= 0.0f ? boxMin.z() : boxMax.z();
+
+        if(plane[0] * px + plane[1] * py + plane[2] * pz + plane[3] < 0.0f) return Outside;
+        if(plane[0] * nx + plane[1] * ny + plane[2] * nz + plane[3] < 0.0f) result = Intersecting;
+    }
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+/**
+ * @brief The Frustum class
+ *
+ * 由视图投影矩阵提取的视锥体(6个裁剪面)，用于包围盒可见性测试。
+ */
+class Frustum {
+public:
+    /**
+     * 包围盒与视锥体的关系
+     */
+    enum Containment {
+        Outside = 0,
+        Intersecting = 1,
+        Inside = 2,
+    };
+
+public:
+    Frustum() = default;
+
+    /**
+     * @brief fromMatrix 从视图投影矩阵提取裁剪面
+     *
+     * 裁剪面位于矩阵的输入坐标系中，法向指向视锥体内侧。
+     * @param matrix 视图投影矩阵
+     * @return 视锥体
+     */
+    static Frustum fromMatrix(const QMatrix4x4& matrix);
+
+    /**
+     * @brief classifyBox 测试轴对齐包围盒与视锥体的关系
+     *
+     * 保守测试：与视锥体不相交但跨越多个裁剪面的包围盒可能被判为相交。
+     * @param boxMin 包围盒最小角点
+     * @param boxMax 包围盒最大角点
+     * @return
+     */
+    Containment classifyBox(const QVector3D& boxMin, const QVector3D& boxMax) const;
+
+private:
+    // 裁剪面 ax + by + cz + d >= 0 为内侧，按左右下上近远排列
+    float mPlanes[6][4]{};
+};
+
+#endif // FRUSTUM_H
@@ -1,6 +1,7 @@
 #include <QString>
 #include <QFile>
 #include <QMatrix4x4>
+#include <QRandomGenerator>
 #include "helpers.h"
 
 QString Helpers::readFile(QString path) {
@@ -20,42 +21,61 @@ std::vector<float> Helpers::ColorStop::getColor() const {
     return std::vector<float> {r / 255.0f, g / 255.0f, b / 255.0f, a};
 }
 
+void Helpers::ColorStop::getColor(float *pColor) const {
+    pColor[0] = r / 255.0f;
+    pColor[1] = g / 255.0f;
+    pColor[2] = b / 255.0f;
+    pColor[3] = a;
+}
+
 std::vector<float> Helpers::linearGradient(const std::vector<ColorStop> &stops,
         float interpPercentage) {
-    if(stops.empty())throw "Unexpected stops for linear gradient.";
-    if(stops.size() == 1)return stops[0].getColor();
+    std::vector<float> color(4);
+    linearGradient(stops, interpPercentage, color.data());
+    return color;
+}
 
-    std::vector<float> color{0.0f, 0.0f, 0.0f, 0.0f};
-    bool foundInside = false;
+void Helpers::linearGradient(const std::vector<ColorStop> &stops, float interpPercentage,
+                             float *pColor) {
+    if(stops.empty())throw "Unexpected stops for linear gradient.";
 
     for(quint64 i = 0; i < stops.size(); ++i) {
         const ColorStop &cur = stops[i];
         if(interpPercentage > cur.percentage) continue;
         if(i == 0) {
-            color = cur.getColor();
+            cur.getColor(pColor);
         } else {
-            auto& last = stops.at(i - 1);
-            auto lastColor = last.getColor();
-            auto curColor = cur.getColor();
+            const ColorStop &last = stops[i - 1];
+            float lastColor[4], curColor[4];
+            last.getColor(lastColor);
+            cur.getColor(curColor);
 
-            for(quint64 i = 0 ; i < color.size(); ++i) {
-                color[i] = (curColor[i] - lastColor[i]) *
-                           (interpPercentage - last.percentage) /
-                           (cur.percentage - last.percentage) +
-                           lastColor[i];
+            for(quint64 i = 0 ; i < 4; ++i) {
+                pColor[i] = (curColor[i] - lastColor[i]) *
+                            (interpPercentage - last.percentage) /
+                            (cur.percentage - last.percentage) +
+                            lastColor[i];
             }
         }
-
-        foundInside = true;
-        break;
-
+        return;
     }
 
-    if(!foundInside) {
-        return stops.back().getColor();
-    }
+    // 超出最后一个转折点
+    stops.back().getColor(pColor);
+}
 
-    return color;
+std::vector<Helpers::ColorStop> Helpers::randomGradient() {
+    std::vector<ColorStop> gradient{};
+    int nStops = QRandomGenerator::global()->bounded(2, 6);
+    for(int i = 0; i <= nStops; ++i) {
+        gradient.push_back(ColorStop(i / float(nStops),
+                                     QRandomGenerator::global()->bounded(0, 256),
+                                     QRandomGenerator::global()->bounded(0, 256),
+                                     QRandomGenerator::global()->bounded(0, 256),
+                                     1.0f
+                                    ));
+    }
+    return gradient;
 }
 
 QMatrix4x4 Helpers::eulerMatrix(float zR, float yR, float xR) {
@@ -1,10 +1,12 @@
 #ifndef HELPERS_H
 #define HELPERS_H
-#include <QApplication>
+#include <QCoreApplication>
 #include <QString>
 #include <QFile>
 #include <QTextStream>
 #include <QDir>
+#include <QMatrix4x4>
+#include <vector>
 
 struct Helpers {
 
@@ -31,6 +33,12 @@ struct Helpers {
                   quint8 b, float a);
 
         std::vector<float> getColor()const;
+
+        /**
+         * @brief getColor 将RGBA颜色写入调用方提供的缓冲区
+         * @param pColor 4个元素的缓冲区
+         */
+        void getColor(float* pColor)const;
     };
 
 
@@ -44,6 +52,21 @@ struct Helpers {
     static std::vector<float> linearGradient(const std::vector<ColorStop>& stops,
             float interpPercentage);
 
+    /**
+     * @brief linearGradient 线性渐变插值函数，结果直接写入缓冲区，不分配内存
+     * @param stops 颜色转折点列表，按位置百分比排序
+     * @param interpPercentage 插值位置百分比（小数）
+     * @param pColor 4个元素的输出缓冲区
+     */
+    static void linearGradient(const std::vector<ColorStop>& stops,
+                               float interpPercentage, float* pColor);
+
+    /**
+     * @brief randomGradient 生成随机的线性渐变
+     * @return 颜色转折点列表，按位置百分比排序
+     */
+    static std::vector<ColorStop> randomGradient();
+
     inline static QString applicationDir{};
 
     inline static float Pi{static_cast<float>(std::atan2(0, -1))};
@@ -60,13 +83,13 @@ struct Helpers {
     // 初始化
     inline static void init() {
 #ifdef Q_OS_MACOS
-        QDir dir(QApplication::applicationDirPath());
+        QDir dir(QCoreApplication::applicationDirPath());
         dir.cdUp();
         dir.cdUp();
         dir.cdUp();
         Helpers::applicationDir = dir.absolutePath();
 #elif Q_OS_WINDOWS
-        Helpers::applicationDir = QApplication::applicationDirPath();
+        Helpers::applicationDir = QCoreApplication::applicationDirPath();
 #endif
     }
 };
@@ -1,22 +1,115 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
+#include "orthopyramid.h"
+#include "profiler.h"
+#include "vertexcache.h"
 
+#include <QActionGroup>
+#include <QApplication>
 #include <QFileDialog>
+#include <QInputDialog>
+#include <QImageReader>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <algorithm>
+#include <cmath>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow) {
     ui->setupUi(this);
 
+    // 读取进度
+    mpLoadStageLabel = new QLabel(this);
+    mpLoadProgressBar = new QProgressBar(this);
+    mpLoadProgressBar->setRange(0, 100);
+    mpLoadProgressBar->setMaximumWidth(200);
+    ui->statusbar->addPermanentWidget(mpLoadStageLabel);
+    ui->statusbar->addPermanentWidget(mpLoadProgressBar);
+    mpLoadStageLabel->hide();
+    mpLoadProgressBar->hide();
+
+    // 绘制统计
+    mpFrameStatsLabel = new QLabel(this);
+    ui->statusbar->addPermanentWidget(mpFrameStatsLabel);
+
+    // DEM读取
+    connect(&mDemLoader, &DemLoader::progressChanged, this, &MainWindow::onDemLoadProgress);
+    connect(&mDemLoader, &DemLoader::loaded, this, &MainWindow::onDemLoaded);
+    connect(&mDemLoader, &DemLoader::rebuilt, this, &MainWindow::onDemRebuilt);
+    connect(&mDemLoader, &DemLoader::failed, this, &MainWindow::onDemLoadFailed);
+    connect(&mDemLoader, &DemLoader::cancelled, this, &MainWindow::onDemLoadCancelled);
+    connect(ui->centralwidget, &Renderer::cameraChanged, this, &MainWindow::onCameraChanged);
+    mDemLoader.setBuildNormals(ui->mActionHillshade->isChecked());
+
+    // 正射影像读取
+    connect(&mOrthoLoader, &OrthoImageLoader::loaded, this, &MainWindow::onOrthoImageLoaded);
+    connect(&mOrthoLoader, &OrthoImageLoader::failed, this, &MainWindow::onOrthoImageLoadFailed);
+
+    // 高程存储方式
+    auto pStorageGroup = new QActionGroup(this);
+    pStorageGroup->addAction(ui->mActionStorageFloat32);
+    pStorageGroup->addAction(ui->mActionStorageInt16);
+    pStorageGroup->addAction(ui->mActionStorageFloat16);
+    connect(ui->mActionStorageFloat32, &QAction::triggered, this, [this]() {
+        onStorageTypeSelected(DigitalElevationModel::Float32);
+    });
+    connect(ui->mActionStorageInt16, &QAction::triggered, this, [this]() {
+        onStorageTypeSelected(DigitalElevationModel::Int16);
+    });
+    connect(ui->mActionStorageFloat16, &QAction::triggered, this, [this]() {
+        onStorageTypeSelected(DigitalElevationModel::Float16);
+    });
+
     // Renderer
+    connect(ui->centralwidget, &Renderer::frameRendered, this, &MainWindow::onFrameRendered);
+    connect(ui->mActionFrustumCulling, &QAction::triggered, ui->centralwidget,
+            &Renderer::setFrustumCulling);
     connect(ui->mActionAutoFitElevation, &QAction::triggered, ui->centralwidget,
             &Renderer::onSetAutoFitElevation);
     connect(ui->mActionResetCamera, &QAction::triggered, ui->centralwidget,
             &Renderer::onResetCameraControl);
     connect(ui->mActionEnableOrthoImageTexture, &QAction::triggered, ui->centralwidget,
             &Renderer::onEnableTextureRender);
+    connect(ui->mActionHillshade, &QAction::triggered, this, [this](bool enabled) {
+        // 山体阴影关闭时读取不计算法向，打开时为当前网格补算
+        mDemLoader.setBuildNormals(enabled);
+        Renderer* pRenderer = ui->centralwidget;
+        if(enabled && !pRenderer->hasNormalMap() && !mDem.isEmpty()) {
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            pRenderer->setNormalMap(NormalMap::build(mDem));
+            QApplication::restoreOverrideCursor();
+        }
+        pRenderer->setHillshade(enabled);
+    });
+    connect(ui->mActionLightDirection, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        double azimuth = QInputDialog::getDouble(this, "光源方向", "方位角(度，自北顺时针):",
+                                                 ui->centralwidget->lightAzimuth(), 0.0, 360.0, 0, &ok);
+        if(!ok) return;
+        double altitude = QInputDialog::getDouble(this, "光源方向", "高度角(度):",
+                                                  ui->centralwidget->lightAltitude(), 0.0, 90.0, 0, &ok);
+        if(ok) ui->centralwidget->setLightDirection(azimuth, altitude);
+    });
     // UI
     connect(ui->mActionOpen, &QAction::triggered, this, &MainWindow::onActionOpenTriggered);
+    connect(ui->mActionLoadViewWindow, &QAction::triggered, this,
+            &MainWindow::onActionLoadViewWindowTriggered);
+    connect(ui->mActionLoadFullDem, &QAction::triggered, this, [this]() {
+        auto sourceType = mDemPath.endsWith(".demb", Qt::CaseInsensitive) ?
+                          DigitalElevationModel::FromBinary : DigitalElevationModel::FromText;
+        mDemLoader.load(mDemPath, sourceType);
+    });
+    connect(ui->mActionSaveBinary, &QAction::triggered, this,
+            &MainWindow::onActionSaveBinaryTriggered);
+    connect(ui->mActionTileCacheBudget, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        int megabytes = QInputDialog::getInt(this, "瓦片缓存", "内存预算(MB):",
+                                             int(muTileCacheBudget / 1048576), 16, 1048576, 64, &ok);
+        if(!ok) return;
+        muTileCacheBudget = quint64(megabytes) * 1048576;
+        if(mPagedDem.tileCache()) mPagedDem.tileCache()->setBudgetBytes(muTileCacheBudget);
+    });
     connect(ui->mActionOrthographic, &QAction::triggered, this,
             &MainWindow::onActionOrthoProjTriggered);
     connect(ui->mActionPerspective, &QAction::triggered, this, &MainWindow::onActionPerspProjTriggered);
@@ -30,6 +123,69 @@ MainWindow::MainWindow(QWidget *parent)
             &MainWindow::onActionDecElevScaleTriggered);
     connect(ui->mActionResetElevScale, &QAction::triggered, this,
             &MainWindow::onActionResetElevScaleTriggered);
+
+    // 地形提交方式
+    auto pDrawModeGroup = new QActionGroup(this);
+    pDrawModeGroup->addAction(ui->mActionDrawQuadtreeLod);
+    pDrawModeGroup->addAction(ui->mActionDrawStitchedStrip);
+    pDrawModeGroup->addAction(ui->mActionPerRowDraws);
+    pDrawModeGroup->addAction(ui->mActionDrawHeightmapTexture);
+    connect(ui->mActionDrawQuadtreeLod, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::QuadtreeLod);
+    });
+    connect(ui->mActionDrawStitchedStrip, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::StitchedStrip);
+    });
+    connect(ui->mActionPerRowDraws, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::PerRowStrips);
+    });
+    connect(ui->mActionDrawHeightmapTexture, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::HeightmapTexture);
+    });
+    pDrawModeGroup->addAction(ui->mActionDrawCacheTriangles);
+    connect(ui->mActionDrawCacheTriangles, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::CacheOptimizedTriangles);
+    });
+    pDrawModeGroup->addAction(ui->mActionDrawTin);
+    connect(ui->mActionDrawTin, &QAction::triggered, this, [this]() {
+        onDrawModeSelected(Renderer::TinTriangles);
+    });
+    connect(ui->mActionLodTolerance, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        double pixels = QInputDialog::getDouble(this, "细节层次误差容限", "屏幕空间误差容限(像素):",
+                                                ui->centralwidget->lodPixelTolerance(), 0.1, 64.0, 1, &ok);
+        if(ok) ui->centralwidget->setLodPixelTolerance(pixels);
+    });
+    connect(ui->mActionFrameBudget, &QAction::triggered, this, [this]() {
+        bool ok = false;
+        double budget = QInputDialog::getDouble(this, "交互帧时间预算",
+                                                "移动相机时的帧时间预算(ms)，超出时降低画质:",
+                                                ui->centralwidget->frameBudget(), 1.0, 1000.0, 1, &ok);
+        if(ok) ui->centralwidget->setFrameBudget(budget);
+    });
+    connect(ui->mActionBenchmarkDrawModes, &QAction::triggered, this,
+            &MainWindow::onActionBenchmarkDrawModesTriggered);
+
+    // 不规则三角网
+    connect(ui->mActionBuildTin, &QAction::triggered, this, &MainWindow::onActionBuildTinTriggered);
+    connect(ui->mActionCompareTinThresholds, &QAction::triggered, this,
+            &MainWindow::onActionCompareTinThresholdsTriggered);
+
+    // 顶点缓存
+    connect(ui->mActionCompareVertexCache, &QAction::triggered, this,
+            &MainWindow::onActionCompareVertexCacheTriggered);
+
+    // 性能分析
+    connect(ui->mActionProfilerOverlay, &QAction::triggered, ui->centralwidget,
+            &Renderer::setProfilerOverlay);
+    connect(ui->mActionExportTrace, &QAction::triggered, this, [this]() {
+        QString path = QFileDialog::getSaveFileName(this, "导出性能跟踪", "trace.json",
+                       "Chrome跟踪文件 (*.json)");
+        if(path.isEmpty()) return;
+        if(!Profiler::instance().exportChromeTrace(path)) {
+            QMessageBox::warning(this, "导出性能跟踪", "无法写入文件: " + path);
+        }
+    });
 }
 
 MainWindow::~MainWindow() {
@@ -39,20 +195,216 @@ MainWindow::~MainWindow() {
 
 void MainWindow::onActionOpenTriggered() {
     QString filepath = QFileDialog::getOpenFileName(this,
-                       "请选择要打开的DEM文件(文本格式)", Helpers::applicationDir, "DEM (*.asc)");
+                       "请选择要打开的DEM文件", Helpers::applicationDir,
+                       "DEM (*.asc *.demb);;ASCII DEM (*.asc);;Binary DEM (*.demb)");
     if(filepath.size() == 0)return;
 
-    mDem = DigitalElevationModel::loadFromFile(filepath, DigitalElevationModel::FromText);
-    ui->centralwidget->setupRenderer(&mDem);
+    auto sourceType = filepath.endsWith(".demb", Qt::CaseInsensitive) ?
+                      DigitalElevationModel::FromBinary : DigitalElevationModel::FromText;
+
+    // 后台读取，打开新文件时取消尚未完成的读取
+    mDemPath = filepath;
+    mPagedDem = DigitalElevationModel();
+    mDemLoader.load(filepath, sourceType);
+}
+
+void MainWindow::onDemLoadProgress(int percent, QString stage) {
+    mpLoadStageLabel->setText(stage);
+    mpLoadProgressBar->setValue(percent);
+    mpLoadStageLabel->show();
+    mpLoadProgressBar->show();
+}
+
+void MainWindow::onDemLoaded(const DigitalElevationModel &dem, const TerrainMesh &mesh) {
+    mpLoadStageLabel->hide();
+    mpLoadProgressBar->hide();
+
+    // 等待网格重新生成的操作属于之前的DEM
+    mAfterMeshRebuilt = nullptr;
+    mDem = dem;
+
+    // 金字塔缓存存在时，原始分辨率数据经瓦片缓存按需访问；同一文件的窗口读取之间保留缓存的瓦片
+    bool hasPyramid = DemPyramid::isCacheValid(mDemPath);
+    if(!hasPyramid) mPagedDem = DigitalElevationModel();
+    if(hasPyramid && mPagedDem.isEmpty()) {
+        try {
+            DemPyramid pyramid = DemPyramid::open(DemPyramid::cachePathFor(mDemPath));
+            if(!pyramid.isEmpty()) {
+                mPagedDem = DigitalElevationModel::fromTileCache(
+                                std::make_shared<DemTileCache>(std::move(pyramid), 0, muTileCacheBudget));
+            }
+        } catch (const char*) {
+            // 缓存不可用时仅使用已读取的DEM
+        }
+    }
+
+    ui->centralwidget->setGradient(ui->centralwidget->defaultGradient());
+    // 正射影像属于上一个DEM
+    mOrthoLoader.cancel();
+    ui->centralwidget->releaseOrthoTexture();
+    ui->centralwidget->uploadTerrainMesh(mesh);
+
+    // 打开时生成了不规则三角网则以其绘制
+    ui->mActionDrawTin->setEnabled(!mesh.tin.isEmpty());
+    if(!mesh.tin.isEmpty()) {
+        ui->mActionDrawTin->setChecked(true);
+        ui->centralwidget->setDrawMode(Renderer::TinTriangles);
+    } else if(ui->centralwidget->drawMode() == Renderer::TinTriangles) {
+        ui->mActionDrawQuadtreeLod->setChecked(true);
+        ui->centralwidget->setDrawMode(Renderer::QuadtreeLod);
+    }
+    updateTerrainResources();
+
+    QString message = QString("%1 x %2, 高程数据占用 %3 MB")
+                      .arg(mDem.getCols()).arg(mDem.getRows())
+                      .arg(mDem.storageBytes() / 1048576.0, 0, 'f', 1);
+    if(!mesh.tin.isEmpty()) {
+        message += QString(", 不规则三角网(误差 %1 m): %2 个三角形 / 全格网 %3 个, 生成 %4 ms")
+                   .arg(mesh.tin.maxError).arg(mesh.tin.triangleCount())
+                   .arg(2 * (mesh.cols - 1) * (mesh.rows - 1))
+                   .arg(mesh.tin.buildMilliseconds, 0, 'f', 0);
+    }
+    statusBar()->showMessage(message);
 
     ui->mActionRandomizeGradient->setEnabled(true);
     ui->mActionAutoFitElevation->setEnabled(true);
     ui->mActionIncElevScale->setEnabled(true);
     ui->mActionDecElevScale->setEnabled(true);
     ui->mActionOpenOrthoImage->setEnabled(true);
+    ui->mActionSaveBinary->setEnabled(true);
+    ui->mActionLoadViewWindow->setEnabled(hasPyramid);
+    ui->mActionLoadFullDem->setEnabled(hasPyramid);
+    ui->mActionBenchmarkDrawModes->setEnabled(true);
+    ui->mActionCompareTinThresholds->setEnabled(true);
+    ui->mActionCompareVertexCache->setEnabled(true);
+    ui->mActionDrawHeightmapTexture->setEnabled(ui->centralwidget->heightmapTextureSupported());
 
     ui->mActionEnableOrthoImageTexture->setEnabled(false);
     ui->mActionEnableOrthoImageTexture->setChecked(false);
+
+    // 读取期间选择了其他存储方式
+    if(mDem.getValueType() != mDemLoader.valueType()) mDemLoader.rebuild(mDem);
+}
+
+void MainWindow::onDemRebuilt(const DigitalElevationModel &dem, const TerrainMesh &mesh,
+                              const DigitalElevationModel::StorageReport &report) {
+    mpLoadStageLabel->hide();
+    mpLoadProgressBar->hide();
+
+    quint64 bytesBefore = mDem.storageBytes();
+    bool converted = dem.getValueType() != mDem.getValueType();
+    mDem = dem;
+    ui->centralwidget->uploadTerrainMesh(mesh);
+
+    if(mDem.getValueType() != mDemLoader.valueType()) {
+        // 生成期间又选择了其他存储方式
+        mDemLoader.rebuild(mDem);
+    } else if(mAfterMeshRebuilt) {
+        // 在按提交方式释放网格缓冲区之前执行等待中的操作
+        auto action = std::move(mAfterMeshRebuilt);
+        mAfterMeshRebuilt = nullptr;
+        action();
+    }
+    updateTerrainResources();
+
+    if(converted) {
+        // 内存占用与精度损失相对于转换前的数据
+        QMessageBox::information(this, "高程存储方式",
+                                 QString("高程数据占用: %1 MB -> %2 MB\n最大误差: %3 m\n均方根误差: %4 m")
+                                 .arg(bytesBefore / 1048576.0, 0, 'f', 1)
+                                 .arg(report.bytes / 1048576.0, 0, 'f', 1)
+                                 .arg(report.maxError, 0, 'g', 4)
+                                 .arg(report.rmsError, 0, 'g', 4));
+    }
+}
+
+void MainWindow::onDemLoadFailed(QString message) {
+    mAfterMeshRebuilt = nullptr;
+    mpLoadStageLabel->hide();
+    mpLoadProgressBar->hide();
+    QMessageBox::warning(this, "DEM读取失败", message);
+}
+
+void MainWindow::onDemLoadCancelled() {
+    mAfterMeshRebuilt = nullptr;
+    mpLoadStageLabel->hide();
+    mpLoadProgressBar->hide();
+}
+
+void MainWindow::onCameraChanged(QVector3D eye, QVector3D center) {
+    mViewEye = eye;
+    mViewCenter = center;
+    if(mPagedDem.isEmpty()) return;
+
+    /**
+     * 沿视线在地面上的投影方向预取瓦片
+     *
+     * 世界坐标系X轴为地理参考Y轴(东)，Y轴为地理参考X轴(北)，
+     * 列号随东向增大，行号随北向减小。
+     */
+    float cellSize = mPagedDem.getCellSize();
+    float topX = mPagedDem.getLowerLeftX() + cellSize * mPagedDem.getRows();
+    double col = (center.x() - mPagedDem.getLowerLeftY()) / cellSize;
+    double row = (topX - center.y()) / cellSize;
+    QVector3D direction = center - eye;
+
+    mPagedDem.tileCache()->prefetchAlong(row, col, -direction.y(), direction.x(), 8);
+}
+
+void MainWindow::onActionLoadViewWindowTriggered() {
+    /**
+     * 由视图中心与相机距离估计可见范围(垂直视场角60度)，
+     * 读取该范围在金字塔缓存中满足渲染预算的最精细层级
+     */
+    DemPyramid pyramid;
+    try {
+        pyramid = DemPyramid::open(DemPyramid::cachePathFor(mDemPath));
+    } catch (const char* message) {
+        QMessageBox::warning(this, "读取视图范围", message);
+        return;
+    }
+    if(pyramid.isEmpty()) return;
+
+    const DemPyramid::LevelInfo& base = pyramid.level(0);
+    float cellSize = pyramid.cellSize(0);
+    float topX = pyramid.lowerLeftX() + cellSize * base.rows;
+    double centerCol = (mViewCenter.x() - pyramid.lowerLeftY()) / cellSize;
+    double centerRow = (topX - mViewCenter.y()) / cellSize;
+    double halfRows = mViewEye.distanceToPoint(mViewCenter) * std::tan(Helpers::Pi / 6.0) / cellSize;
+    double halfCols = halfRows * ui->centralwidget->width() / std::max(ui->centralwidget->height(), 1);
+
+    double row0 = std::max(centerRow - halfRows, 0.0);
+    double col0 = std::max(centerCol - halfCols, 0.0);
+    double rowEnd = std::min(centerRow + halfRows, double(base.rows));
+    double colEnd = std::min(centerCol + halfCols, double(base.cols));
+    if(rowEnd - row0 < 2.0 || colEnd - col0 < 2.0) {
+        QMessageBox::warning(this, "读取视图范围", "视图中心不在DEM范围内。");
+        return;
+    }
+    // 原始分辨率的窗口经瓦片缓存读取，复用沿视线预取的瓦片
+    mDemLoader.loadWindow(mDemPath, quint64(row0), quint64(col0),
+                          quint64(rowEnd) - quint64(row0), quint64(colEnd) - quint64(col0), mPagedDem);
+}
+
+void MainWindow::onStorageTypeSelected(DigitalElevationModel::ValueType type) {
+    mDemLoader.setValueType(type);
+    // 读取或重新生成完成时会按新的存储方式再次转换
+    if(mDem.isEmpty() || mDemLoader.isLoading() || mDem.getValueType() == type) return;
+
+    // 在后台转换当前DEM并重新生成网格，完成后报告内存占用与精度损失
+    mDemLoader.rebuild(mDem);
+}
+
+void MainWindow::onActionSaveBinaryTriggered() {
+    QString filepath = QFileDialog::getSaveFileName(this,
+                       "请选择二进制DEM文件的保存位置", Helpers::applicationDir, "Binary DEM (*.demb)");
+    if(filepath.size() == 0)return;
+
+    try {
+        mDem.saveToBinary(filepath);
+    } catch (const char* message) {
+        QMessageBox::warning(this, "DEM保存失败", message);
+    }
 }
 
 void MainWindow::onActionOrthoProjTriggered(bool checked) {
@@ -66,23 +418,70 @@ void MainWindow::onActionPerspProjTriggered(bool checked) {
 }
 
 void MainWindow::onActionRandomizeGradientTriggered() {
-    ui->centralwidget->setupRenderer(&mDem, mTextureImage.isNull() ? nullptr : &mTextureImage, true);
+    // 只替换渐变查找纹理，无需重新生成网格
+    ui->centralwidget->setGradient(Helpers::randomGradient());
     ui->mActionEnableOrthoImageTexture->setChecked(false);
     ui->centralwidget->onEnableTextureRender(false);
 }
 
 void MainWindow::onActionOpenOrthoImageTriggered() {
     QString filepath = QFileDialog::getOpenFileName(this,
-                       "请选择要打开的纹理图像", Helpers::applicationDir, "image (*.jpg)");
+                       "请选择要打开的纹理图像", Helpers::applicationDir,
+                       "image (*.jpg *.jpeg *.png *.tif *.tiff)");
     if(filepath.size() == 0)return;
 
-    mTextureImage = QImage(filepath);
+    // 超过单张纹理限制的影像改用虚拟纹理，按需加载页金字塔中的页
+    Renderer* pRenderer = ui->centralwidget;
+    QSize imageSize = QImageReader(filepath).size();
+    int maxSize = std::min(int(Renderer::VIRTUAL_TEXTURE_MIN_SIZE), pRenderer->maxTextureSize());
+    if(maxSize > 0 && std::max(imageSize.width(), imageSize.height()) > maxSize) {
+        try {
+            if(!OrthoPyramid::isCacheValid(filepath)) {
+                QProgressDialog progressDialog("正在生成正射影像页金字塔...", "取消", 0, 1000, this);
+                progressDialog.setWindowModality(Qt::WindowModal);
+                progressDialog.setMinimumDuration(0);
+                OrthoPyramid::build(filepath, OrthoPyramid::cachePathFor(filepath), [&](float progress) {
+                    progressDialog.setValue(int(progress * 1000));
+                    QApplication::processEvents();
+                    return !progressDialog.wasCanceled();
+                });
+            }
+            OrthoPyramid pyramid = OrthoPyramid::open(OrthoPyramid::cachePathFor(filepath));
+            if(pyramid.isEmpty()) throw "Failed to open the orthophoto pyramid.";
+            mOrthoLoader.cancel();
+            mpLoadStageLabel->hide();
+            pRenderer->setVirtualTexture(std::move(pyramid));
+        } catch (const char* message) {
+            QMessageBox::warning(this, "正射影像", message);
+            return;
+        }
+        ui->mActionEnableOrthoImageTexture->setEnabled(true);
+        ui->mActionEnableOrthoImageTexture->setChecked(true);
+    } else {
+        // 在工作线程中解码，完成后由渲染器分片上传，地形网格不变
+        mOrthoLoader.load(filepath);
+        mpLoadStageLabel->setText("正在读取正射影像");
+        mpLoadStageLabel->show();
+    }
+}
 
-    ui->centralwidget->setupRenderer(&mDem, &mTextureImage);
+void MainWindow::onOrthoImageLoaded(const QImage &image) {
+    mpLoadStageLabel->hide();
+    try {
+        ui->centralwidget->setOrthoTexture(image);
+    } catch (const char* message) {
+        QMessageBox::warning(this, "正射影像", message);
+        return;
+    }
     ui->mActionEnableOrthoImageTexture->setEnabled(true);
     ui->mActionEnableOrthoImageTexture->setChecked(true);
 }
 
+void MainWindow::onOrthoImageLoadFailed(QString message) {
+    mpLoadStageLabel->hide();
+    QMessageBox::warning(this, "正射影像", message);
+}
+
 void MainWindow::onActionIncElevScaleTriggered() {
     ui->centralwidget->setElevationScale(ui->centralwidget->elevationScale() + 0.10);
 }
@@ -95,6 +494,227 @@ void MainWindow::onActionResetElevScaleTriggered() {
     ui->centralwidget->setElevationScale(1.0);
 }
 
+void MainWindow::onActionBenchmarkDrawModesTriggered() {
+    // 在当前视角下分别测量各提交方式的帧时间，测量期间网格缓冲区与高程纹理同时驻留
+    const int nFrames = 50;
+    Renderer* pRenderer = ui->centralwidget;
+    // 网格缓冲区已释放时在后台重新生成，完成后再测量
+    auto retry = [this]() {
+        onActionBenchmarkDrawModesTriggered();
+    };
+    if(!ensureTerrainMesh(retry)) return;
+    Renderer::DrawMode mode = pRenderer->drawMode();
+    QString heightmapResult = "不支持";
+    if(pRenderer->heightmapTextureSupported()) {
+        try {
+            if(!pRenderer->hasHeightmap()) pRenderer->uploadHeightmap(mDem);
+            pRenderer->setDrawMode(Renderer::HeightmapTexture);
+            heightmapResult = QString("%1 ms").arg(pRenderer->measureFrameTime(nFrames), 0, 'f', 2);
+        } catch (const char* message) {
+            heightmapResult = message;
+        }
+    }
+
+    pRenderer->setDrawMode(Renderer::QuadtreeLod);
+    double lodTime = pRenderer->measureFrameTime(nFrames);
+    pRenderer->setDrawMode(Renderer::StitchedStrip);
+    double stitchedTime = pRenderer->measureFrameTime(nFrames);
+    pRenderer->setDrawMode(Renderer::PerRowStrips);
+    double perRowTime = pRenderer->measureFrameTime(nFrames);
+    pRenderer->uploadCacheOptimizedIndices();
+    pRenderer->setDrawMode(Renderer::CacheOptimizedTriangles);
+    double cacheTrianglesTime = pRenderer->measureFrameTime(nFrames);
+    QString tinResult = "未生成";
+    if(pRenderer->hasTin()) {
+        pRenderer->setDrawMode(Renderer::TinTriangles);
+        tinResult = QString("%1 ms").arg(pRenderer->measureFrameTime(nFrames), 0, 'f', 2);
+    }
+    pRenderer->setDrawMode(mode);
+    updateTerrainResources();
+
+    QMessageBox::information(this, "地形提交方式帧时间",
+                             QString("%1 x %2, %3 帧平均\n"
+                                     "四叉树细节层次: %4 ms\n"
+                                     "全分辨率单次绘制: %5 ms\n"
+                                     "全分辨率逐行绘制(%6 次): %7 ms\n"
+                                     "全分辨率缓存优化三角形: %8 ms\n"
+                                     "高程纹理位移: %9\n"
+                                     "不规则三角网: %10")
+                             .arg(mDem.getCols()).arg(mDem.getRows()).arg(nFrames)
+                             .arg(lodTime, 0, 'f', 2)
+                             .arg(stitchedTime, 0, 'f', 2)
+                             .arg(mDem.getRows() - 1)
+                             .arg(perRowTime, 0, 'f', 2)
+                             .arg(cacheTrianglesTime, 0, 'f', 2)
+                             .arg(heightmapResult)
+                             .arg(tinResult));
+}
+
+void MainWindow::onActionBuildTinTriggered(bool checked) {
+    // 对之后打开的文件生效
+    if(!checked) {
+        mDemLoader.setTinMaxError(0.0f);
+        return;
+    }
+
+    bool ok = false;
+    double current = mDemLoader.tinMaxError() > 0.0f ? mDemLoader.tinMaxError() : 1.0;
+    double maxError = QInputDialog::getDouble(this, "不规则三角网", "最大高程误差(m):", current,
+                                              0.01, 10000.0, 2, &ok);
+    if(!ok) {
+        ui->mActionBuildTin->setChecked(false);
+        return;
+    }
+    mDemLoader.setTinMaxError(maxError);
+}
+
+void MainWindow::onActionCompareTinThresholdsTriggered() {
+    // 对当前DEM依次以各阈值生成不规则三角网，报告三角形数与生成耗时
+    const float thresholds[] = {0.1f, 0.5f, 1.0f, 2.0f, 5.0f, 10.0f, 20.0f};
+    quint64 gridTriangles = 2 * (mDem.getCols() - 1) * (mDem.getRows() - 1);
+    QString report = QString("%1 x %2, 全格网 %3 个三角形\n")
+                     .arg(mDem.getCols()).arg(mDem.getRows()).arg(gridTriangles);
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    for(float threshold : thresholds) {
+        TinMesh tin = TinMesh::build(mDem, threshold);
+        report += QString("误差 %1 m: %2 个三角形 (%3%), %4 ms\n")
+                  .arg(threshold).arg(tin.triangleCount())
+                  .arg(100.0 * tin.triangleCount() / gridTriangles, 0, 'f', 2)
+                  .arg(tin.buildMilliseconds, 0, 'f', 0);
+    }
+    QApplication::restoreOverrideCursor();
+
+    QMessageBox::information(this, "不规则三角网误差阈值对比", report);
+}
+
+void MainWindow::onActionCompareVertexCacheTriggered() {
+    /**
+     * 以FIFO缓存模拟统计各索引布局的ACMR(每个三角形的平均顶点着色次数，理想格网约为0.5)，
+     * 缓存优化布局按默认容量生成，在不同容量下模拟以反映其对硬件缓存大小的敏感程度；
+     * 再在当前视角下测量全分辨率各布局的帧时间。
+     */
+    const int cacheSizes[] = {16, 32, 64};
+    quint64 cols = mDem.getCols(), rows = mDem.getRows();
+    QString report = QString("%1 x %2, 缓存优化布局按 %3 个顶点的缓存生成\n")
+                     .arg(cols).arg(rows).arg(VertexCache::DEFAULT_CACHE_SIZE);
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    TinMesh tin;
+    if(mDemLoader.tinMaxError() > 0.0f) tin = TinMesh::build(mDem, mDemLoader.tinMaxError());
+    for(int cacheSize : cacheSizes) {
+        report += QString("\n缓存 %1 个顶点:\n").arg(cacheSize);
+        report += QString("  逐行条带: %1\n")
+                  .arg(VertexCache::measureGridStrips(cols, rows, true, cacheSize).acmr(), 0, 'f', 3);
+        report += QString("  单条带: %1\n")
+                  .arg(VertexCache::measureGridStrips(cols, rows, false, cacheSize).acmr(), 0, 'f', 3);
+        report += QString("  缓存优化三角形: %1\n")
+                  .arg(VertexCache::measureGridTriangles(cols, rows, cacheSize).acmr(), 0, 'f', 3);
+        if(!tin.isEmpty()) {
+            VertexCache::Simulator simulator(cacheSize);
+            simulator.triangles(tin.indices.data(), tin.indices.size());
+            report += QString("  不规则三角网(误差 %1 m): %2\n")
+                      .arg(tin.maxError).arg(simulator.stats().acmr(), 0, 'f', 3);
+        }
+    }
+    QApplication::restoreOverrideCursor();
+
+    // 网格缓冲区已释放时在后台重新生成，完成后再测量帧时间
+    auto measure = [this, report]() {
+        measureVertexCacheFrameTimes(report);
+    };
+    if(ensureTerrainMesh(measure)) measure();
+}
+
+void MainWindow::measureVertexCacheFrameTimes(QString report) {
+    const int nFrames = 50;
+    Renderer* pRenderer = ui->centralwidget;
+    Renderer::DrawMode mode = pRenderer->drawMode();
+    pRenderer->uploadCacheOptimizedIndices();
+    const std::pair<Renderer::DrawMode, const char*> modes[] = {
+        {Renderer::PerRowStrips, "逐行条带"},
+        {Renderer::StitchedStrip, "单条带"},
+        {Renderer::CacheOptimizedTriangles, "缓存优化三角形"},
+    };
+    report += QString("\n帧时间(%1 帧平均):\n").arg(nFrames);
+    for(const auto& [drawMode, name] : modes) {
+        pRenderer->setDrawMode(drawMode);
+        report += QString("  %1: %2 ms\n").arg(name)
+                  .arg(pRenderer->measureFrameTime(nFrames), 0, 'f', 2);
+    }
+    pRenderer->setDrawMode(mode);
+    updateTerrainResources();
+
+    QMessageBox::information(this, "顶点缓存命中率(ACMR)对比", report);
+}
+
+void MainWindow::onFrameRendered() {
+    const TerrainLod::SelectStats& stats = ui->centralwidget->frameStats();
+    QString text = QString("绘制 %1 块 / 裁剪 %2 块, 三角形 %3 / %4, 显存 %5 MB")
+                   .arg(stats.drawnNodes).arg(stats.culledNodes)
+                   .arg(stats.drawnTriangles).arg(stats.culledTriangles)
+                   .arg(ui->centralwidget->gpuMemoryBytes() / 1048576.0, 0, 'f', 1);
+    if(ui->centralwidget->qualityLevel() > 0) {
+        text += QString(", 交互画质降低 %1 级").arg(ui->centralwidget->qualityLevel());
+    }
+    if(mPagedDem.tileCache()) {
+        DemTileCache::Stats cacheStats = mPagedDem.tileCache()->stats();
+        text += QString(", 瓦片缓存 命中 %1 / 未命中 %2 / 淘汰 %3 / 预取 %4, 常驻 %5 / %6 MB")
+                .arg(cacheStats.hits).arg(cacheStats.misses).arg(cacheStats.evictions)
+                .arg(cacheStats.prefetches)
+                .arg(cacheStats.residentBytes / 1048576.0, 0, 'f', 0)
+                .arg(cacheStats.budgetBytes / 1048576.0, 0, 'f', 0);
+    }
+    if(ui->centralwidget->hasVirtualTexture()) {
+        VirtualTexture::Stats vtStats = ui->centralwidget->virtualTextureStats();
+        text += QString(", 影像页 %1 / %2 (待加载 %3)")
+                .arg(vtStats.residentPages).arg(vtStats.slots).arg(vtStats.pendingPages);
+    }
+    mpFrameStatsLabel->setText(text);
+}
+
+void MainWindow::onDrawModeSelected(Renderer::DrawMode mode) {
+    ui->centralwidget->setDrawMode(mode);
+    updateTerrainResources();
+}
+
+void MainWindow::updateTerrainResources() {
+    /**
+     * 只保留当前提交方式需要的GPU资源：
+     * 高程纹理位移只需高程纹理(每个格网点4字节)与细节层次节点，释放网格缓冲区；
+     * 其余方式需要网格缓冲区，已释放时在后台重新生成，完成前保留高程纹理。
+     */
+    Renderer* pRenderer = ui->centralwidget;
+    if(mDem.isEmpty()) return;
+
+    if(pRenderer->drawMode() == Renderer::HeightmapTexture) {
+        try {
+            if(!pRenderer->hasHeightmap()) pRenderer->uploadHeightmap(mDem);
+            pRenderer->releaseTerrainMesh();
+            return;
+        } catch (const char* message) {
+            QMessageBox::warning(this, "高程纹理位移", message);
+            ui->mActionDrawQuadtreeLod->setChecked(true);
+            pRenderer->setDrawMode(Renderer::QuadtreeLod);
+        }
+    }
+
+    if(!ensureTerrainMesh(nullptr)) return;
+    pRenderer->releaseHeightmap();
+    // 缓存优化三角形的索引是条带的3倍，只在选择该方式时上传
+    if(pRenderer->drawMode() == Renderer::CacheOptimizedTriangles) {
+        pRenderer->uploadCacheOptimizedIndices();
+    }
+}
+
+bool MainWindow::ensureTerrainMesh(std::function<void()> action) {
+    if(ui->centralwidget->hasTerrainMesh()) return true;
+    // 正在读取或重新生成时等待其完成，完成时会上传网格
+    if(action) mAfterMeshRebuilt = std::move(action);
+    if(!mDemLoader.isLoading()) mDemLoader.rebuild(mDem);
+    return false;
+}
+
 bool MainWindow::eventFilter(QObject *watched, QEvent *event) {
     if(event->type() == QEvent::KeyPress) {
         return true;
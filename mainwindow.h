@@ -1,8 +1,15 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "demloader.h"
+#include "demtilecache.h"
 #include "digitalelevationmodel.h"
+#include "orthoimageloader.h"
+#include "renderer.h"
+#include <QLabel>
 #include <QMainWindow>
+#include <QProgressBar>
+#include <functional>
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -19,19 +26,73 @@ public:
 
 private slots:
     void onActionOpenTriggered();
+    void onActionSaveBinaryTriggered();
+    void onDemLoadProgress(int percent, QString stage);
+    void onDemLoaded(const DigitalElevationModel& dem, const TerrainMesh& mesh);
+    void onDemRebuilt(const DigitalElevationModel& dem, const TerrainMesh& mesh,
+                      const DigitalElevationModel::StorageReport& report);
+    void onDemLoadFailed(QString message);
+    void onDemLoadCancelled();
+    void onActionLoadViewWindowTriggered();
+    void onStorageTypeSelected(DigitalElevationModel::ValueType type);
+    void onCameraChanged(QVector3D eye, QVector3D center);
     void onActionOrthoProjTriggered(bool checked);
     void onActionPerspProjTriggered(bool checked);
     void onActionRandomizeGradientTriggered();
     void onActionOpenOrthoImageTriggered();
+    void onOrthoImageLoaded(const QImage& image);
+    void onOrthoImageLoadFailed(QString message);
     void onActionIncElevScaleTriggered();
     void onActionDecElevScaleTriggered();
     void onActionResetElevScaleTriggered();
+    void onActionBenchmarkDrawModesTriggered();
+    void onActionBuildTinTriggered(bool checked);
+    void onActionCompareTinThresholdsTriggered();
+    void onActionCompareVertexCacheTriggered();
+    void onFrameRendered();
+
+private:
+    void onDrawModeSelected(Renderer::DrawMode mode);
+    void updateTerrainResources();
+
+    /**
+     * @brief ensureTerrainMesh 网格缓冲区已释放(高程纹理位移方式)时在后台重新生成
+     * @param action 重新生成并上传后执行的操作，可为空
+     * @return 网格缓冲区是否已上传，为false时稍后执行action
+     */
+    bool ensureTerrainMesh(std::function<void()> action);
+
+    /**
+     * @brief measureVertexCacheFrameTimes 在当前视角下测量全分辨率各索引布局的帧时间并显示报告
+     * @param report 已生成的ACMR报告
+     */
+    void measureVertexCacheFrameTimes(QString report);
 
 private:
     Ui::MainWindow *ui;
 
     DigitalElevationModel mDem{};
-    QImage mTextureImage{};
+
+    // 当前DEM文件路径
+    QString mDemPath{};
+    // 最近的相机位置与视图中心(世界坐标)
+    QVector3D mViewEye{};
+    QVector3D mViewCenter{};
+    // 存在金字塔缓存时，以瓦片缓存按需访问的原始分辨率DEM
+    DigitalElevationModel mPagedDem{};
+    // 瓦片缓存的内存预算(字节)
+    quint64 muTileCacheBudget{DemTileCache::DEFAULT_BUDGET_BYTES};
+
+    // 后台DEM读取
+    DemLoader mDemLoader{};
+    // 等待网格缓冲区在后台重新生成后执行的操作
+    std::function<void()> mAfterMeshRebuilt{};
+    // 后台正射影像解码
+    OrthoImageLoader mOrthoLoader{};
+    QLabel* mpLoadStageLabel{nullptr};
+    QProgressBar* mpLoadProgressBar{nullptr};
+    // 绘制统计
+    QLabel* mpFrameStatsLabel{nullptr};
 
 private:
     // QObject interface
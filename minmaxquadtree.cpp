@@ -0,0 +1,171 @@
+#include "minmaxquadtree.h"
+#include "digitalelevationmodel.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace {
+
+MinMaxQuadtree::Stats emptyStats() {
+    return MinMaxQuadtree::Stats{std::numeric_limits<float>::max(),
+                                 -std::numeric_limits<float>::max(), 0};
+}
+
+inline void merge(MinMaxQuadtree::Stats& target, const MinMaxQuadtree::Stats& other) {
+    target.minElev = std::min(target.minElev, other.minElev);
+    target.maxElev = std::max(target.maxElev, other.maxElev);
+    target.noDataCount += other.noDataCount;
+}
+
+}
+
+MinMaxQuadtree MinMaxQuadtree::build(const DigitalElevationModel &dem,
+                                     const std::function<bool(float)> &progress) {
+    MinMaxQuadtree tree;
+    if(dem.isEmpty()) return tree;
+
+    tree.muCols = dem.getCols();
+    tree.muRows = dem.getRows();
+    float noData = dem.getNoDataValue();
+
+    // 叶节点层，按节点行分配给各线程
+    Level leaves;
+    leaves.nodesX = (tree.muCols + LEAF_SIZE - 1) / LEAF_SIZE;
+    leaves.nodesY = (tree.muRows + LEAF_SIZE - 1) / LEAF_SIZE;
+    leaves.nodes.assign(leaves.nodesX * leaves.nodesY, emptyStats());
+
+    // 第0个线程报告进度，各线程每个叶节点行之后检查取消
+    std::atomic<quint64> nodeRowsDone{0};
+    std::atomic_bool cancelled{false};
+    auto buildLeafRows = [&](unsigned thread, unsigned nThreads) {
+        for(quint64 ny = thread; ny < leaves.nodesY && !cancelled; ny += nThreads) {
+            quint64 rowEnd = std::min(tree.muRows, (ny + 1) * LEAF_SIZE);
+            for(quint64 row = ny * LEAF_SIZE; row < rowEnd; ++row) {
+                for(quint64 col = 0; col < tree.muCols; ++col) {
+                    Stats& leaf = leaves.nodes[ny * leaves.nodesX + col / LEAF_SIZE];
+                    float elev = dem.getElevByIndex(row * tree.muCols + col);
+                    if(elev == noData) {
+                        ++leaf.noDataCount;
+                        continue;
+                    }
+                    leaf.minElev = std::min(leaf.minElev, elev);
+                    leaf.maxElev = std::max(leaf.maxElev, elev);
+                }
+            }
+            quint64 done = ++nodeRowsDone;
+            if(thread == 0 && progress && !progress(float(done) / leaves.nodesY)) {
+                cancelled = true;
+            }
+        }
+    };
+
+    unsigned nThreads = std::max(1u, std::min<unsigned>(DigitalElevationModel::loaderThreadCount(),
+                                 unsigned(leaves.nodesY)));
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        workers.emplace_back(buildLeafRows, i, nThreads);
+    }
+    buildLeafRows(0, nThreads);
+    for(auto& worker : workers) worker.join();
+    if(cancelled) {
+        throw "Min/max index generation was cancelled.";
+    }
+    tree.mLevels.push_back(std::move(leaves));
+
+    // 逐层合并2x2节点直到只剩根节点
+    while(tree.mLevels.back().nodesX > 1 || tree.mLevels.back().nodesY > 1) {
+        const Level& finer = tree.mLevels.back();
+        Level coarser;
+        coarser.nodesX = (finer.nodesX + 1) / 2;
+        coarser.nodesY = (finer.nodesY + 1) / 2;
+        coarser.nodes.assign(coarser.nodesX * coarser.nodesY, emptyStats());
+        for(quint64 ny = 0; ny < finer.nodesY; ++ny) {
+            for(quint64 nx = 0; nx < finer.nodesX; ++nx) {
+                merge(coarser.nodes[(ny / 2) * coarser.nodesX + nx / 2],
+                      finer.nodes[ny * finer.nodesX + nx]);
+            }
+        }
+        tree.mLevels.push_back(std::move(coarser));
+    }
+
+    return tree;
+}
+
+bool MinMaxQuadtree::isEmpty() const {
+    return mLevels.empty();
+}
+
+MinMaxQuadtree::Stats MinMaxQuadtree::total() const {
+    return isEmpty() ? emptyStats() : mLevels.back().nodes[0];
+}
+
+MinMaxQuadtree::Stats MinMaxQuadtree::query(const DigitalElevationModel &dem, quint64 row,
+        quint64 col, quint64 rows, quint64 cols) const {
+    Stats result = emptyStats();
+    if(isEmpty() || row >= muRows || col >= muCols) return result;
+    quint64 row1 = std::min(muRows, row + rows), col1 = std::min(muCols, col + cols);
+    if(row1 <= row || col1 <= col) return result;
+
+    queryNode(dem, levelCount() - 1, 0, 0, row, col, row1, col1, result);
+    return result;
+}
+
+quint32 MinMaxQuadtree::levelCount() const {
+    return quint32(mLevels.size());
+}
+
+const MinMaxQuadtree::Stats &MinMaxQuadtree::node(quint32 level, quint64 nodeX,
+        quint64 nodeY) const {
+    const Level& info = mLevels[level];
+    Q_ASSERT(nodeX < info.nodesX && nodeY < info.nodesY);
+    return info.nodes[nodeY * info.nodesX + nodeX];
+}
+
+quint64 MinMaxQuadtree::nodeSpan(quint32 level) const {
+    return quint64(LEAF_SIZE) << level;
+}
+
+void MinMaxQuadtree::queryNode(const DigitalElevationModel &dem, quint32 level,
+                               quint64 nodeX, quint64 nodeY,
+                               quint64 row0, quint64 col0, quint64 row1, quint64 col1,
+                               Stats &result) const {
+    const Level& info = mLevels[level];
+    if(nodeX >= info.nodesX || nodeY >= info.nodesY) return;
+
+    quint64 span = nodeSpan(level);
+    quint64 nodeRow0 = nodeY * span, nodeCol0 = nodeX * span;
+    quint64 nodeRow1 = std::min(muRows, nodeRow0 + span);
+    quint64 nodeCol1 = std::min(muCols, nodeCol0 + span);
+
+    // 不相交
+    if(nodeRow0 >= row1 || nodeCol0 >= col1 || nodeRow1 <= row0 || nodeCol1 <= col0) return;
+
+    // 完全包含
+    if(nodeRow0 >= row0 && nodeCol0 >= col0 && nodeRow1 <= row1 && nodeCol1 <= col1) {
+        merge(result, info.nodes[nodeY * info.nodesX + nodeX]);
+        return;
+    }
+
+    // 与窗口边界相交的叶节点逐格网点统计
+    if(level == 0) {
+        float noData = dem.getNoDataValue();
+        for(quint64 row = std::max(row0, nodeRow0); row < std::min(row1, nodeRow1); ++row) {
+            for(quint64 col = std::max(col0, nodeCol0); col < std::min(col1, nodeCol1); ++col) {
+                float elev = dem.getElevByIndex(row * muCols + col);
+                if(elev == noData) {
+                    ++result.noDataCount;
+                    continue;
+                }
+                result.minElev = std::min(result.minElev, elev);
+                result.maxElev = std::max(result.maxElev, elev);
+            }
+        }
+        return;
+    }
+
+    for(quint64 child = 0; child < 4; ++child) {
+        queryNode(dem, level - 1, nodeX * 2 + child % 2, nodeY * 2 + child / 2,
+                  row0, col0, row1, col1, result);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef MINMAXQUADTREE_H
+#define MINMAXQUADTREE_H
+
+#include <QtGlobal>
+#include <functional>
+#include <vector>
+
+class DigitalElevationModel;
+
+/**
+ * @brief The MinMaxQuadtree class
+ *
+ * 高程格网的最小/最大值四叉树索引。
+ * 叶节点覆盖 LEAF_SIZE x LEAF_SIZE 个格网点，记录有效高程范围与无数据点个数；
+ * 上层节点合并下层2x2个节点，直到根节点覆盖整个格网。
+ * 矩形窗口查询只下降到与窗口边界相交的节点，完全包含的节点直接取其统计量。
+ * 索引不持有高程数据，查询时需传入建立索引所用的DEM。
+ */
+class MinMaxQuadtree {
+public:
+    // 叶节点边长(格网数)
+    static const quint32 LEAF_SIZE = 16;
+
+    /**
+     * @brief The Stats struct 区域统计量
+     */
+    struct Stats {
+        // 有效高程范围，区域内全部无数据时minElev > maxElev
+        float minElev;
+        float maxElev;
+        // 无数据格网点个数
+        quint64 noDataCount;
+
+        bool hasData() const {
+            return minElev <= maxElev;
+        }
+    };
+
+public:
+    MinMaxQuadtree() = default;
+
+    /**
+     * @brief build 为DEM建立索引
+     *
+     * 叶节点统计在多个线程中并行计算，取消时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param progress 进度回调，每个叶节点行之后调用，返回false时中止
+     * @return 索引
+     */
+    static MinMaxQuadtree build(const DigitalElevationModel& dem,
+                                const std::function<bool(float)>& progress = std::function<bool(float)>());
+
+    bool isEmpty() const;
+
+    /**
+     * @brief total 获取整个格网的统计量
+     * @return
+     */
+    Stats total() const;
+
+    /**
+     * @brief query 查询矩形窗口的统计量
+     * @param dem 建立索引所用的DEM，用于统计与窗口边界相交的叶节点
+     * @param row 窗口起始行
+     * @param col 窗口起始列
+     * @param rows 窗口行数
+     * @param cols 窗口列数
+     * @return 窗口统计量，窗口超出格网的部分被裁掉
+     */
+    Stats query(const DigitalElevationModel& dem, quint64 row, quint64 col, quint64 rows, quint64 cols) const;
+
+    /**
+     * @brief levelCount 获取层数，第0层为叶节点
+     * @return
+     */
+    quint32 levelCount() const;
+
+    /**
+     * @brief node 获取节点统计量
+     * @param level 层号
+     * @param nodeX 节点列号
+     * @param nodeY 节点行号
+     * @return
+     */
+    const Stats& node(quint32 level, quint64 nodeX, quint64 nodeY) const;
+
+    /**
+     * @brief nodeSpan 获取某层节点覆盖的格网边长
+     * @param level 层号
+     * @return
+     */
+    quint64 nodeSpan(quint32 level) const;
+
+private:
+    struct Level {
+        quint64 nodesX;
+        quint64 nodesY;
+        std::vector<Stats> nodes;
+    };
+
+    void queryNode(const DigitalElevationModel& dem, quint32 level, quint64 nodeX,
+                   quint64 nodeY, quint64 row0, quint64 col0, quint64 row1, quint64 col1,
+                   Stats& result) const;
+
+private:
+    quint64 muCols{0};
+    quint64 muRows{0};
+    std::vector<Level> mLevels{};
+};
+
+#endif // MINMAXQUADTREE_H
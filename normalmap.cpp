@@ -0,0 +1,267 @@
+#include "normalmap.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NORMALMAP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NORMALMAP_SSE2
+#endif
+
+namespace {
+
+// 多线程计算时每个任务的纹素行数
+const quint64 kBandRows = 64;
+
+/**
+ * @brief encode 编码值(0 ~ 255)舍入为8位，与向量路径一样舍入到最近的偶数
+ */
+inline quint8 encode(float value) {
+    return quint8(std::clamp(std::nearbyint(value), 0.0f, 255.0f));
+}
+
+/**
+ * @brief scalarTexel 计算一个纹素
+ *
+ * pUp、pMid、pDown指向3x3窗口各行的第一个值，无数据为NaN。
+ * @param invDistance 1 / (8 * 相邻取样点距离)
+ */
+inline void scalarTexel(const float* pUp, const float* pMid, const float* pDown, float invDistance,
+                        quint8* pTexel) {
+    float e = pMid[1];
+    if(std::isnan(e)) {
+        pTexel[0] = pTexel[1] = encode(127.5f);
+        return;
+    }
+    auto value = [e](float v) {
+        return std::isnan(v) ? e : v;
+    };
+    float a = value(pUp[0]), b = value(pUp[1]), c = value(pUp[2]);
+    float d = value(pMid[0]), f = value(pMid[2]);
+    float g = value(pDown[0]), h = value(pDown[1]), k = value(pDown[2]);
+
+    // 第0行为北，列号向东增大
+    float gx = ((c + 2.0f * f + k) - (a + 2.0f * d + g)) * invDistance;
+    float gy = ((a + 2.0f * b + c) - (g + 2.0f * h + k)) * invDistance;
+    float scale = 127.5f / std::sqrt(gx * gx + gy * gy + 1.0f);
+    pTexel[0] = encode(-gx * scale + 127.5f);
+    pTexel[1] = encode(-gy * scale + 127.5f);
+}
+
+/**
+ * @brief kernelRow 计算一行纹素
+ *
+ * 三行输入各有 width + 2 个值(两端各多一个邻点)，无数据为NaN。
+ * 向量路径中含NaN的纹素交给标量路径重新计算。
+ */
+void kernelRow(const float* pUp, const float* pMid, const float* pDown, quint64 width,
+               float invDistance, quint8* pOut) {
+    quint64 i = 0;
+#if defined(NORMALMAP_AVX2)
+    const __m256 two = _mm256_set1_ps(2.0f), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+    const __m256 inv = _mm256_set1_ps(invDistance), half = _mm256_set1_ps(127.5f);
+    for(; i + 8 <= width; i += 8) {
+        __m256 a = _mm256_loadu_ps(pUp + i), b = _mm256_loadu_ps(pUp + i + 1), c = _mm256_loadu_ps(pUp + i + 2);
+        __m256 d = _mm256_loadu_ps(pMid + i), e = _mm256_loadu_ps(pMid + i + 1), f = _mm256_loadu_ps(pMid + i + 2);
+        __m256 g = _mm256_loadu_ps(pDown + i), h = _mm256_loadu_ps(pDown + i + 1),
+               k = _mm256_loadu_ps(pDown + i + 2);
+        __m256 gx = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(c, _mm256_mul_ps(two, f)), k),
+                                                _mm256_add_ps(_mm256_add_ps(a, _mm256_mul_ps(two, d)), g)), inv);
+        __m256 gy = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(a, _mm256_mul_ps(two, b)), c),
+                                                _mm256_add_ps(_mm256_add_ps(g, _mm256_mul_ps(two, h)), k)), inv);
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, gx),
+                                       _mm256_mul_ps(gy, gy)), one));
+        __m256 scale = _mm256_div_ps(half, length);
+        __m256i ix = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(zero, gx), scale), half));
+        __m256i iy = _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(zero, gy), scale), half));
+        // 交错为(x, y)并压缩为字节，解包与压缩都在各128位通道内进行，低通道为纹素0~3，高通道为4~7
+        __m256i words = _mm256_packs_epi32(_mm256_unpacklo_epi32(ix, iy), _mm256_unpackhi_epi32(ix, iy));
+        __m256i bytes = _mm256_packus_epi16(words, words);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut + i * 2), _mm256_castsi256_si128(bytes));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut + i * 2 + 8), _mm256_extracti128_si256(bytes, 1));
+
+        // Horn算子不读取中心格网点，中心为无数据时同样交给标量路径
+        int nanMask = _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(gx, gy, _CMP_UNORD_Q),
+                                         _mm256_cmp_ps(e, e, _CMP_UNORD_Q)));
+        for(int lane = 0; nanMask; ++lane, nanMask >>= 1) {
+            if(nanMask & 1) scalarTexel(pUp + i + lane, pMid + i + lane, pDown + i + lane, invDistance,
+                                            pOut + (i + lane) * 2);
+        }
+    }
+#elif defined(NORMALMAP_SSE2)
+    const __m128 two = _mm_set1_ps(2.0f), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    const __m128 inv = _mm_set1_ps(invDistance), half = _mm_set1_ps(127.5f);
+    for(; i + 4 <= width; i += 4) {
+        __m128 a = _mm_loadu_ps(pUp + i), b = _mm_loadu_ps(pUp + i + 1), c = _mm_loadu_ps(pUp + i + 2);
+        __m128 d = _mm_loadu_ps(pMid + i), e = _mm_loadu_ps(pMid + i + 1), f = _mm_loadu_ps(pMid + i + 2);
+        __m128 g = _mm_loadu_ps(pDown + i), h = _mm_loadu_ps(pDown + i + 1), k = _mm_loadu_ps(pDown + i + 2);
+        __m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(c, _mm_mul_ps(two, f)), k),
+                                          _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, d)), g)), inv);
+        __m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_add_ps(a, _mm_mul_ps(two, b)), c),
+                                          _mm_add_ps(_mm_add_ps(g, _mm_mul_ps(two, h)), k)), inv);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), one));
+        __m128 scale = _mm_div_ps(half, length);
+        __m128i ix = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(zero, gx), scale), half));
+        __m128i iy = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(zero, gy), scale), half));
+        // 交错为(x, y)并压缩为8个字节
+        __m128i words = _mm_packs_epi32(_mm_unpacklo_epi32(ix, iy), _mm_unpackhi_epi32(ix, iy));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pOut + i * 2), _mm_packus_epi16(words, words));
+
+        // Horn算子不读取中心格网点，中心为无数据时同样交给标量路径
+        int nanMask = _mm_movemask_ps(_mm_or_ps(_mm_cmpunord_ps(gx, gy), _mm_cmpunord_ps(e, e)));
+        for(int lane = 0; nanMask; ++lane, nanMask >>= 1) {
+            if(nanMask & 1) scalarTexel(pUp + i + lane, pMid + i + lane, pDown + i + lane, invDistance,
+                                            pOut + (i + lane) * 2);
+        }
+    }
+#endif
+    for(; i < width; ++i) {
+        scalarTexel(pUp + i, pMid + i, pDown + i, invDistance, pOut + i * 2);
+    }
+}
+
+/**
+ * @brief computeRows 计算纹素窗口的若干行，输入行按滚动方式每行只解码一次
+ * @param rowBegin 起始纹素行
+ * @param rowEnd 结束纹素行(不含)
+ * @param colBegin 起始纹素列
+ * @param width 纹素列数
+ * @param pOut 输出，第rowBegin行的首地址
+ * @param outStride 输出每行字节数
+ */
+void computeRows(const DigitalElevationModel& dem, quint64 step, quint64 rowBegin, quint64 rowEnd,
+                 quint64 colBegin, quint64 width, quint8* pOut, quint64 outStride) {
+    const qint64 demCols = qint64(dem.getCols()), demRows = qint64(dem.getRows());
+    const float noData = dem.getNoDataValue();
+    const float invDistance = 1.0f / (8.0f * step * dem.getCellSize());
+
+    // 窗口两端各多解码一个取样点，超出格网的取样点取边界格网点
+    std::vector<qint64> columns(width + 2);
+    for(quint64 i = 0; i < width + 2; ++i) {
+        columns[i] = std::clamp<qint64>((qint64(colBegin + i) - 1) * qint64(step), 0, demCols - 1);
+    }
+    std::vector<float> buffers[3];
+    for(auto& buffer : buffers) buffer.resize(width + 2);
+    auto decodeRow = [&](qint64 texelRow, float* pRow) {
+        quint64 offset = std::clamp<qint64>(texelRow * qint64(step), 0, demRows - 1) * demCols;
+        for(quint64 i = 0; i < width + 2; ++i) {
+            float elev = dem.getElevByIndex(offset + columns[i]);
+            pRow[i] = elev == noData ? std::numeric_limits<float>::quiet_NaN() : elev;
+        }
+    };
+
+    float* pUp = buffers[0].data();
+    float* pMid = buffers[1].data();
+    float* pDown = buffers[2].data();
+    decodeRow(qint64(rowBegin) - 1, pUp);
+    decodeRow(qint64(rowBegin), pMid);
+    for(quint64 row = rowBegin; row < rowEnd; ++row) {
+        decodeRow(qint64(row) + 1, pDown);
+        kernelRow(pUp, pMid, pDown, width, invDistance, pOut + (row - rowBegin) * outStride);
+        std::swap(pUp, pMid);
+        std::swap(pMid, pDown);
+    }
+}
+
+}
+
+quint64 NormalMap::stepFor(quint64 demCols, quint64 demRows, quint64 maxSize) {
+    quint64 longEdge = std::max(demCols, demRows);
+    return std::max<quint64>(1, (longEdge + maxSize - 1) / maxSize);
+}
+
+NormalMap NormalMap::build(const DigitalElevationModel &dem, quint64 maxSize,
+                           const DigitalElevationModel::ProgressCallback &progress) {
+    Profiler::Scope scope("NormalMap::build", "mesh");
+    NormalMap map;
+    if(dem.isEmpty()) return map;
+
+    map.step = stepFor(dem.getCols(), dem.getRows(), maxSize);
+    map.cols = (dem.getCols() + map.step - 1) / map.step;
+    map.rows = (dem.getRows() + map.step - 1) / map.step;
+    map.texels.resize(map.cols * map.rows * 2);
+
+    // 按行带动态分配给各线程，调用线程同时负责报告进度，每个行带之后检查取消
+    std::atomic<quint64> nextBand{0};
+    std::atomic<quint64> rowsDone{0};
+    std::atomic_bool cancelled{false};
+    auto computeBands = [&](bool reportProgress) {
+        for(quint64 band = nextBand++; band * kBandRows < map.rows && !cancelled; band = nextBand++) {
+            quint64 rowBegin = band * kBandRows;
+            quint64 rowEnd = std::min(map.rows, rowBegin + kBandRows);
+            computeRows(dem, map.step, rowBegin, rowEnd, 0, map.cols,
+                        map.texels.data() + rowBegin * map.cols * 2, map.cols * 2);
+            quint64 done = rowsDone += rowEnd - rowBegin;
+            if(reportProgress && progress && !progress(float(done) / map.rows)) {
+                cancelled = true;
+            }
+        }
+    };
+
+    unsigned nThreads = std::max<quint64>(1, std::min<quint64>(
+            DigitalElevationModel::loaderThreadCount(), (map.rows + kBandRows - 1) / kBandRows));
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        workers.emplace_back(computeBands, false);
+    }
+    computeBands(true);
+    for(auto& worker : workers) worker.join();
+
+    if(cancelled) {
+        throw "Normal map generation was cancelled.";
+    }
+    return map;
+}
+
+void NormalMap::computeWindow(const DigitalElevationModel &dem, quint64 step, const QRect &window,
+                              quint8 *pTexels) {
+    if(window.isEmpty()) return;
+    computeRows(dem, step, quint64(window.top()), quint64(window.bottom()) + 1, quint64(window.left()),
+                quint64(window.width()), pTexels, quint64(window.width()) * 2);
+}
+
+QRect NormalMap::affectedWindow(quint64 row, quint64 col, quint64 nRows, quint64 nCols) const {
+    if(isEmpty() || nRows == 0 || nCols == 0) return QRect();
+    // 纹素j读取格网点(j - 1) * step ~ (j + 1) * step
+    quint64 rowBegin = row / step, colBegin = col / step;
+    if(rowBegin > 0) --rowBegin;
+    if(colBegin > 0) --colBegin;
+    quint64 rowEnd = std::min(rows, (row + nRows - 1) / step + 2);
+    quint64 colEnd = std::min(cols, (col + nCols - 1) / step + 2);
+    if(rowBegin >= rowEnd || colBegin >= colEnd) return QRect();
+    return QRect(int(colBegin), int(rowBegin), int(colEnd - colBegin), int(rowEnd - rowBegin));
+}
+
+NormalMap NormalMap::downsampled(quint64 factor) const {
+    if(factor <= 1) return *this;
+    NormalMap map;
+    map.step = step * factor;
+    map.cols = (cols + factor - 1) / factor;
+    map.rows = (rows + factor - 1) / factor;
+    map.texels.resize(map.cols * map.rows * 2);
+    quint8* pTexel = map.texels.data();
+    for(quint64 y = 0; y < map.rows; ++y) {
+        for(quint64 x = 0; x < map.cols; ++x, pTexel += 2) {
+            const quint8* pSource = &texels[(y * factor * cols + x * factor) * 2];
+            pTexel[0] = pSource[0];
+            pTexel[1] = pSource[1];
+        }
+    }
+    return map;
+}
+
+const char *NormalMap::kernelName() {
+#if defined(NORMALMAP_AVX2)
+    return "AVX2";
+#elif defined(NORMALMAP_SSE2)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
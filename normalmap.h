@@ -0,0 +1,90 @@
+#ifndef NORMALMAP_H
+#define NORMALMAP_H
+
+#include <QRect>
+#include <QtGlobal>
+#include <vector>
+#include "digitalelevationmodel.h"
+
+/**
+ * @brief The NormalMap struct
+ *
+ * 由DEM格网以Horn算子(3x3加权差分)计算的地表单位法向，用于着色器中的山体阴影光照。
+ * 每个纹素存储高程缩放量为1时法向的东、北分量，各8位(分量 * 127.5 + 127.5)，向上分量由单位长度恢复。
+ * 高程缩放量为s时法向为 normalize(s * nx, s * ny, nz)，由着色器换算，改变缩放量时无需重新计算。
+ * 差分核心按编译目标使用AVX2、SSE2或标量实现，各行带在多个线程中计算。
+ */
+struct NormalMap {
+    // 法向纹理每个方向的最大纹素数，格网更大时按间隔取样
+    static const quint64 MAX_SIZE = 16384;
+
+    // 纹素列数与行数
+    quint64 cols = 0;
+    quint64 rows = 0;
+    // 取样间隔(格网点数)，纹素(i, j)对应格网点(i * step, j * step)
+    quint64 step = 1;
+    // 行优先排列，每个纹素2字节
+    std::vector<quint8> texels{};
+
+    bool isEmpty() const {
+        return cols * rows == 0;
+    }
+
+    /**
+     * @brief stepFor 获取格网对应的取样间隔，使纹素数不超过maxSize
+     * @param demCols 格网列数
+     * @param demRows 格网行数
+     * @param maxSize 每个方向的最大纹素数
+     * @return
+     */
+    static quint64 stepFor(quint64 demCols, quint64 demRows, quint64 maxSize = MAX_SIZE);
+
+    /**
+     * @brief build 计算整个格网的法向
+     *
+     * 边界上缺少的邻点取边界格网点，无数据邻点取中心格网点，无数据格网点的法向竖直向上。
+     * 取消时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param maxSize 每个方向的最大纹素数
+     * @param progress 进度回调，每个行带之后调用，返回false时中止
+     * @return 法向纹理数据
+     */
+    static NormalMap build(const DigitalElevationModel& dem, quint64 maxSize = MAX_SIZE,
+                           const DigitalElevationModel::ProgressCallback& progress =
+                               DigitalElevationModel::ProgressCallback());
+
+    /**
+     * @brief computeWindow 重新计算一个纹素窗口，用于局部高程修改后的增量更新
+     * @param dem DEM数据
+     * @param step 取样间隔
+     * @param window 纹素窗口
+     * @param pTexels 输出，窗口行优先排列，每行 window.width() * 2 字节
+     */
+    static void computeWindow(const DigitalElevationModel& dem, quint64 step, const QRect& window,
+                              quint8* pTexels);
+
+    /**
+     * @brief affectedWindow 获取格网窗口内高程改变后需要重新计算的纹素窗口
+     * @param row 格网窗口起始行
+     * @param col 格网窗口起始列
+     * @param nRows 格网窗口行数
+     * @param nCols 格网窗口列数
+     * @return 纹素窗口，已截断到纹理范围
+     */
+    QRect affectedWindow(quint64 row, quint64 col, quint64 nRows, quint64 nCols) const;
+
+    /**
+     * @brief downsampled 按间隔抽取纹素，用于超出最大纹理尺寸时上传
+     * @param factor 抽取间隔
+     * @return
+     */
+    NormalMap downsampled(quint64 factor) const;
+
+    /**
+     * @brief kernelName 获取编译时选择的差分核心
+     * @return "AVX2"、"SSE2"或"scalar"
+     */
+    static const char* kernelName();
+};
+
+#endif // NORMALMAP_H
@@ -51,6 +51,12 @@ QString OrbitControls::toString() const {
     return output;
 }
 
+QVector3D OrbitControls::position() const {
+    float sinT = sin(mTheta), cosT = cos(mTheta),
+          sinP = sin(mPhi), cosP = cos(mPhi);
+    return mCenter + mRadius * QVector3D(sinT * cosP, sinT * sinP, cosT);
+}
+
 void OrbitControls::setCenter(const QVector3D &newCenter) {
     mCenter = newCenter;
 }
@@ -97,6 +97,12 @@ public:
 
     QString toString() const;
 
+    /**
+     * @brief position 获取相机在世界坐标系中的位置
+     * @return
+     */
+    QVector3D position() const;
+
     /**
      * @brief center 获取相机中心点位置
      * @return
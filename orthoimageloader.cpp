@@ -0,0 +1,70 @@
+#include "orthoimageloader.h"
+#include "profiler.h"
+#include <QImageReader>
+#include <QMetaObject>
+
+OrthoImageLoader::OrthoImageLoader(QObject *parent) : QObject(parent) {}
+
+OrthoImageLoader::~OrthoImageLoader() {
+    joinWorker();
+}
+
+void OrthoImageLoader::load(QString path) {
+    // 使正在解码的请求的结果失效，工作线程忙时只记住最新的请求
+    ++muGeneration;
+    mbLoading = true;
+    if(mbRunning) {
+        mPendingPath = path;
+        return;
+    }
+    start(path);
+}
+
+void OrthoImageLoader::cancel() {
+    ++muGeneration;
+    mPendingPath.clear();
+    mbLoading = false;
+}
+
+bool OrthoImageLoader::isLoading() const {
+    return mbLoading;
+}
+
+void OrthoImageLoader::start(QString path) {
+    mbRunning = true;
+    quint64 generation = muGeneration;
+
+    // 析构函数会等待工作线程结束，工作线程中使用this是安全的
+    mWorker = std::thread([this, path, generation]() {
+        Profiler::Scope scope("ortho decode", "io");
+        QImageReader reader(path);
+        QImage image = reader.read();
+        QString error = image.isNull() ? reader.errorString() : QString();
+        // 转换也在工作线程中完成，上传时按行直接读取
+        if(!image.isNull() && image.format() != QImage::Format_RGB888) {
+            image = image.convertToFormat(QImage::Format_RGB888);
+        }
+
+        QMetaObject::invokeMethod(this, [this, generation, image, error]() {
+            joinWorker();
+            mbRunning = false;
+            if(!mPendingPath.isEmpty()) {
+                QString next = mPendingPath;
+                mPendingPath.clear();
+                start(next);
+                return;
+            }
+            if(generation != muGeneration) return;
+            mbLoading = false;
+            if(image.isNull()) {
+                emit failed(error);
+            } else {
+                emit loaded(image);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void OrthoImageLoader::joinWorker() {
+    if(mWorker.joinable()) mWorker.join();
+}
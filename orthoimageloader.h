@@ -0,0 +1,70 @@
+#ifndef ORTHOIMAGELOADER_H
+#define ORTHOIMAGELOADER_H
+
+#include <QImage>
+#include <QObject>
+#include <QString>
+#include <thread>
+
+/**
+ * @brief The OrthoImageLoader class
+ *
+ * 在工作线程中解码正射影像并转换为RGB888，GUI线程只负责把结果交给渲染器分片上传。
+ * 解码无法中途停止：新的请求使未完成请求的结果失效，并在其解码结束后才开始，GUI线程不等待。
+ * 信号均在OrthoImageLoader所在线程中发出。
+ */
+class OrthoImageLoader : public QObject {
+    Q_OBJECT
+
+public:
+    explicit OrthoImageLoader(QObject* parent = nullptr);
+    ~OrthoImageLoader();
+
+    /**
+     * @brief load 开始在后台解码影像文件，之前未完成的请求不再发出信号
+     * @param path 文件路径
+     */
+    void load(QString path);
+
+    /**
+     * @brief cancel 丢弃当前与排队的请求
+     */
+    void cancel();
+
+    /**
+     * @brief isLoading 是否有请求尚未完成
+     * @return
+     */
+    bool isLoading() const;
+
+signals:
+    /**
+     * @brief loaded 解码完成
+     * @param image RGB888图像，第0行为影像上边界
+     */
+    void loaded(const QImage& image);
+
+    /**
+     * @brief failed 解码失败
+     * @param message 错误信息
+     */
+    void failed(QString message);
+
+private:
+    void start(QString path);
+    void joinWorker();
+
+private:
+    // 工作线程
+    std::thread mWorker{};
+    // 工作线程是否在运行(包括已失效的请求)
+    bool mbRunning{false};
+    // 是否有未失效的请求尚未完成
+    bool mbLoading{false};
+    // 请求序号，用于丢弃已被取代的请求的结果
+    quint64 muGeneration{0};
+    // 工作线程忙时到达的最新请求
+    QString mPendingPath{};
+};
+
+#endif // ORTHOIMAGELOADER_H
@@ -0,0 +1,330 @@
+#include "orthopyramid.h"
+#include <QBuffer>
+#include <QFileInfo>
+#include <QImageReader>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+namespace {
+
+/**
+ * 页金字塔缓存文件格式
+ *
+ * [OrthoHeader][LevelInfo * levelCount][PageInfo * pageCount][页数据: 每页一个JPEG文件]
+ * 文件头在所有页写完后才写入标识，生成中断的文件不会被当作有效缓存。
+ * 缓存只在本机使用，按本机字节序写入，字节序不符时视为无效缓存。
+ */
+const char kOrthoMagic[8] = {'O', 'R', 'T', 'H', 'P', 'Y', 'R', '\0'};
+const quint32 kOrthoVersion = 1;
+const quint32 kEndianMarker = 0x01020304;
+// 每次从原始影像解码的行带最大字节数
+const quint64 kBandBytes = 128ull * 1024 * 1024;
+
+struct OrthoHeader {
+    char magic[8];
+    quint32 version;
+    quint32 endianMarker;
+    quint32 pageSize;
+    quint32 levelCount;
+    quint64 width;
+    quint64 height;
+    quint64 pageCount;
+};
+
+/**
+ * @brief appendRows 将rows拼接到image下方
+ */
+QImage appendRows(const QImage& image, const QImage& rows) {
+    if(image.isNull() || image.height() == 0) return rows;
+    if(rows.isNull() || rows.height() == 0) return image;
+    QImage result(image.width(), image.height() + rows.height(), QImage::Format_RGB888);
+    for(int y = 0; y < image.height(); ++y) {
+        std::memcpy(result.scanLine(y), image.constScanLine(y), image.width() * 3);
+    }
+    for(int y = 0; y < rows.height(); ++y) {
+        std::memcpy(result.scanLine(image.height() + y), rows.constScanLine(y), rows.width() * 3);
+    }
+    return result;
+}
+
+/**
+ * @brief downsample 将宽高减半(向上取整)，2x2邻域取均值，越界部分重复边缘像素
+ */
+QImage downsample(const QImage& image) {
+    int width = (image.width() + 1) / 2, height = (image.height() + 1) / 2;
+    QImage result(width, height, QImage::Format_RGB888);
+    for(int y = 0; y < height; ++y) {
+        const uchar* pRow0 = image.constScanLine(y * 2);
+        const uchar* pRow1 = image.constScanLine(std::min(y * 2 + 1, image.height() - 1));
+        uchar* pOut = result.scanLine(y);
+        for(int x = 0; x < width; ++x) {
+            int x0 = x * 2 * 3, x1 = std::min(x * 2 + 1, image.width() - 1) * 3;
+            for(int c = 0; c < 3; ++c) {
+                pOut[x * 3 + c] = uchar((pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] +
+                                         pRow1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief encodePage 截取一页并编码为JPEG，越界部分重复边缘像素
+ * @param rows 页所在的行带(不超过一页高)
+ * @param x0 页起始列
+ */
+QByteArray encodePage(const QImage& rows, int x0) {
+    const int pageSize = int(OrthoPyramid::PAGE_SIZE);
+    QImage page(pageSize, pageSize, QImage::Format_RGB888);
+    int width = std::min(pageSize, rows.width() - x0);
+    for(int y = 0; y < pageSize; ++y) {
+        const uchar* pSrc = rows.constScanLine(std::min(y, rows.height() - 1)) + x0 * 3;
+        uchar* pDst = page.scanLine(y);
+        std::memcpy(pDst, pSrc, width * 3);
+        for(int x = width; x < pageSize; ++x) {
+            std::memcpy(pDst + x * 3, pSrc + (width - 1) * 3, 3);
+        }
+    }
+
+    QByteArray encoded;
+    QBuffer buffer(&encoded);
+    buffer.open(QIODevice::WriteOnly);
+    page.save(&buffer, "JPG", OrthoPyramid::JPEG_QUALITY);
+    return encoded;
+}
+
+}
+
+void OrthoPyramid::build(QString imagePath, QString path,
+                         const DigitalElevationModel::ProgressCallback &progress) {
+    QSize size = QImageReader(imagePath).size();
+    if(!size.isValid() || size.isEmpty()) {
+        throw "Failed to read the orthophoto image size.";
+    }
+
+    // 计算各层级尺寸
+    std::vector<LevelInfo> levels{};
+    quint64 width = size.width(), height = size.height(), pageCount = 0;
+    while(true) {
+        LevelInfo info{};
+        info.width = width;
+        info.height = height;
+        info.pagesX = quint32((width + PAGE_SIZE - 1) / PAGE_SIZE);
+        info.pagesY = quint32((height + PAGE_SIZE - 1) / PAGE_SIZE);
+        info.firstPage = pageCount;
+        levels.push_back(info);
+        pageCount += quint64(info.pagesX) * info.pagesY;
+        if(width <= PAGE_SIZE && height <= PAGE_SIZE) break;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+
+    OrthoHeader header{};
+    header.version = kOrthoVersion;
+    header.endianMarker = kEndianMarker;
+    header.pageSize = PAGE_SIZE;
+    header.levelCount = quint32(levels.size());
+    header.width = size.width();
+    header.height = size.height();
+    header.pageCount = pageCount;
+
+    quint64 pageTableOffset = sizeof(OrthoHeader) + levels.size() * sizeof(LevelInfo);
+    std::vector<PageInfo> pages(pageCount);
+    quint64 nextOffset = pageTableOffset + pageCount * sizeof(PageInfo);
+
+    QFile file(path);
+    file.open(QFile::WriteOnly | QFile::Truncate);
+    if(!file.isOpen()) {
+        throw "Failed to open orthophoto pyramid cache file for writing.";
+    }
+
+    auto writeBytes = [&file](const void* pData, quint64 size) {
+        if(file.write(reinterpret_cast<const char*>(pData), size) != qint64(size)) {
+            throw "Failed to write orthophoto pyramid cache file.";
+        }
+    };
+
+    try {
+        // 标识清零的文件头，页表与标识在页数据写完后回填
+        writeBytes(&header, sizeof(OrthoHeader));
+        writeBytes(levels.data(), levels.size() * sizeof(LevelInfo));
+        writeBytes(pages.data(), pages.size() * sizeof(PageInfo));
+
+        quint64 pagesWritten = 0;
+        // 一行页在多个线程中编码，按顺序写入
+        auto writePageRow = [&](quint32 l, quint32 pageY, const QImage& rows) {
+            const LevelInfo& info = levels[l];
+            std::vector<QByteArray> encoded(info.pagesX);
+            std::atomic<quint32> nextPage{0};
+            auto encodePages = [&]() {
+                for(quint32 x = nextPage++; x < info.pagesX; x = nextPage++) {
+                    encoded[x] = encodePage(rows, int(x * PAGE_SIZE));
+                }
+            };
+            unsigned nThreads = std::max<unsigned>(1, std::min<unsigned>(
+                    DigitalElevationModel::loaderThreadCount(), info.pagesX));
+            std::vector<std::thread> workers;
+            for(unsigned i = 1; i < nThreads; ++i) {
+                workers.emplace_back(encodePages);
+            }
+            encodePages();
+            for(auto& worker : workers) worker.join();
+
+            for(quint32 x = 0; x < info.pagesX; ++x) {
+                if(encoded[x].isEmpty()) throw "Failed to encode an orthophoto page.";
+                PageInfo& page = pages[info.firstPage + quint64(pageY) * info.pagesX + x];
+                page.offset = nextOffset;
+                page.size = encoded[x].size();
+                writeBytes(encoded[x].constData(), page.size);
+                nextOffset += page.size;
+            }
+
+            pagesWritten += info.pagesX;
+            if(progress && !progress(float(pagesWritten) / pageCount)) {
+                throw "Orthophoto pyramid generation was cancelled.";
+            }
+        };
+
+        /**
+         * 各层级流水线生成：每级积累到一页高的行即写出一行页，
+         * 并将这些行降采样后交给下一级，各级只保留不足一页高的剩余行。
+         */
+        std::vector<QImage> pending(levels.size());
+        std::vector<quint32> nextPageRow(levels.size(), 0);
+        std::function<void(quint32, const QImage&, bool)> addRows =
+        [&](quint32 l, const QImage & rows, bool last) {
+            pending[l] = appendRows(pending[l], rows);
+            bool flushed = false;
+            while(pending[l].height() >= int(PAGE_SIZE) || (last && pending[l].height() > 0)) {
+                int n = std::min(int(PAGE_SIZE), pending[l].height());
+                QImage chunk = pending[l].copy(0, 0, pending[l].width(), n);
+                pending[l] = pending[l].copy(0, n, pending[l].width(), pending[l].height() - n);
+                writePageRow(l, nextPageRow[l]++, chunk);
+
+                flushed = last && pending[l].height() == 0;
+                if(l + 1 < levels.size()) addRows(l + 1, downsample(chunk), flushed);
+            }
+            if(last && !flushed && l + 1 < levels.size()) addRows(l + 1, QImage(), true);
+        };
+
+        // 按行带解码原始影像
+        const quint64 bandRows = std::max<quint64>(
+                                     PAGE_SIZE, kBandBytes / (quint64(size.width()) * 4) / PAGE_SIZE * PAGE_SIZE);
+        for(quint64 y0 = 0; y0 < quint64(size.height()); y0 += bandRows) {
+            int rows = int(std::min<quint64>(bandRows, size.height() - y0));
+            QImageReader reader(imagePath);
+            reader.setClipRect(QRect(0, int(y0), size.width(), rows));
+            QImage band = reader.read();
+            if(band.isNull() || band.width() != size.width() || band.height() != rows) {
+                throw "Failed to decode the orthophoto image.";
+            }
+            addRows(0, band.convertToFormat(QImage::Format_RGB888), y0 + rows >= quint64(size.height()));
+        }
+
+        file.seek(pageTableOffset);
+        writeBytes(pages.data(), pages.size() * sizeof(PageInfo));
+        std::memcpy(header.magic, kOrthoMagic, sizeof(kOrthoMagic));
+        file.seek(0);
+        writeBytes(&header, sizeof(OrthoHeader));
+    } catch (const char*) {
+        file.close();
+        QFile::remove(path);
+        throw;
+    }
+}
+
+OrthoPyramid OrthoPyramid::open(QString path) {
+    OrthoPyramid pyramid;
+    pyramid.mpFile = std::make_shared<QFile>(path);
+    pyramid.mpFile->open(QFile::ReadOnly);
+    if(!pyramid.mpFile->isOpen()) return OrthoPyramid();
+
+    qint64 fileSize = pyramid.mpFile->size();
+    if(fileSize < qint64(sizeof(OrthoHeader))) {
+        throw "Orthophoto pyramid cache file is too small to contain a header.";
+    }
+    pyramid.mpMapped = pyramid.mpFile->map(0, fileSize);
+    if(!pyramid.mpMapped) {
+        throw "Failed to map orthophoto pyramid cache file into memory.";
+    }
+
+    OrthoHeader header;
+    std::memcpy(&header, pyramid.mpMapped, sizeof(OrthoHeader));
+    if(std::memcmp(header.magic, kOrthoMagic, sizeof(kOrthoMagic)) != 0
+            || header.version != kOrthoVersion
+            || header.endianMarker != kEndianMarker) {
+        throw "Not a compatible orthophoto pyramid cache file.";
+    }
+
+    quint64 pageTableOffset = sizeof(OrthoHeader) + header.levelCount * sizeof(LevelInfo);
+    if(header.pageSize != PAGE_SIZE || header.levelCount == 0
+            || pageTableOffset + header.pageCount * sizeof(PageInfo) > quint64(fileSize)) {
+        throw "Malformed orthophoto pyramid cache header.";
+    }
+
+    pyramid.muWidth = header.width;
+    pyramid.muHeight = header.height;
+    pyramid.mLevels.resize(header.levelCount);
+    std::memcpy(pyramid.mLevels.data(), pyramid.mpMapped + sizeof(OrthoHeader),
+                header.levelCount * sizeof(LevelInfo));
+    pyramid.mpPages = reinterpret_cast<const PageInfo*>(pyramid.mpMapped + pageTableOffset);
+
+    // 校验页数据均位于文件内
+    for(quint64 i = 0; i < header.pageCount; ++i) {
+        const PageInfo& page = pyramid.mpPages[i];
+        if(page.size == 0 || page.offset + page.size > quint64(fileSize)) {
+            throw "Malformed orthophoto pyramid cache: page data outside of the file.";
+        }
+    }
+
+    return pyramid;
+}
+
+QString OrthoPyramid::cachePathFor(QString imagePath) {
+    return imagePath + ".vtex";
+}
+
+bool OrthoPyramid::isCacheValid(QString imagePath) {
+    QFileInfo cacheInfo(cachePathFor(imagePath));
+    QFileInfo imageInfo(imagePath);
+    return cacheInfo.exists() && cacheInfo.lastModified() >= imageInfo.lastModified();
+}
+
+bool OrthoPyramid::isEmpty() const {
+    return mLevels.empty();
+}
+
+quint64 OrthoPyramid::width() const {
+    return muWidth;
+}
+
+quint64 OrthoPyramid::height() const {
+    return muHeight;
+}
+
+quint32 OrthoPyramid::levelCount() const {
+    return quint32(mLevels.size());
+}
+
+const OrthoPyramid::LevelInfo &OrthoPyramid::level(quint32 level) const {
+    Q_ASSERT(level < mLevels.size());
+    return mLevels[level];
+}
+
+const OrthoPyramid::PageInfo &OrthoPyramid::page(quint32 level, quint32 pageX, quint32 pageY) const {
+    const LevelInfo& info = this->level(level);
+    Q_ASSERT(pageX < info.pagesX && pageY < info.pagesY);
+    return mpPages[info.firstPage + quint64(pageY) * info.pagesX + pageX];
+}
+
+QImage OrthoPyramid::readPage(quint32 level, quint32 pageX, quint32 pageY) const {
+    const PageInfo& info = page(level, pageX, pageY);
+    QImage image = QImage::fromData(mpMapped + info.offset, int(info.size), "JPG");
+    if(image.width() != int(PAGE_SIZE) || image.height() != int(PAGE_SIZE)) {
+        throw "Corrupted orthophoto page.";
+    }
+    return image.convertToFormat(QImage::Format_RGB888);
+}
@@ -0,0 +1,114 @@
+#ifndef ORTHOPYRAMID_H
+#define ORTHOPYRAMID_H
+
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <memory>
+#include <vector>
+#include "digitalelevationmodel.h"
+
+/**
+ * @brief The OrthoPyramid class
+ *
+ * 正射影像多分辨率页金字塔缓存文件，供虚拟纹理按页读取。
+ * 第0级为原始分辨率，之后每级宽高减半(2x2均值)，直到单页可容纳整级。
+ * 每级切分为 PAGE_SIZE * PAGE_SIZE 的页，以JPEG压缩存储，越界部分重复边缘像素。
+ * 生成时按行带读取原始影像，内存占用与影像尺寸无关；读取时只映射文件。
+ */
+class OrthoPyramid {
+public:
+    // 页边长(像素)
+    static const quint32 PAGE_SIZE = 128;
+    // 页的JPEG压缩质量
+    static const int JPEG_QUALITY = 90;
+
+    /**
+     * @brief The LevelInfo struct 金字塔层级信息
+     */
+    struct LevelInfo {
+        quint64 width;
+        quint64 height;
+        quint32 pagesX;
+        quint32 pagesY;
+        // 该级第一页在页表中的序号
+        quint64 firstPage;
+    };
+
+    /**
+     * @brief The PageInfo struct 页数据在文件中的偏移与字节数
+     */
+    struct PageInfo {
+        quint64 offset;
+        quint64 size;
+    };
+
+public:
+    OrthoPyramid() = default;
+
+    /**
+     * @brief build 由影像文件生成页金字塔缓存文件
+     *
+     * 原始影像按行带解码(支持裁剪读取的格式如JPEG只解码所需的行)。
+     * 读取或写入失败、取消时删除缓存文件并抛出异常(const char*)。
+     * @param imagePath 影像文件路径
+     * @param path 缓存文件路径
+     * @param progress 进度回调，返回false时中止
+     */
+    static void build(QString imagePath, QString path,
+                      const DigitalElevationModel::ProgressCallback& progress =
+                          DigitalElevationModel::ProgressCallback());
+
+    /**
+     * @brief open 映射页金字塔缓存文件
+     *
+     * 文件格式不符时抛出异常(const char*)。
+     * @param path 缓存文件路径
+     * @return 金字塔，文件无法打开时为空
+     */
+    static OrthoPyramid open(QString path);
+
+    /**
+     * @brief cachePathFor 获取影像文件对应的页金字塔缓存路径
+     * @param imagePath 影像文件路径
+     * @return 缓存文件路径
+     */
+    static QString cachePathFor(QString imagePath);
+
+    /**
+     * @brief isCacheValid 判断影像文件的页金字塔缓存是否存在且不早于影像文件
+     * @param imagePath 影像文件路径
+     * @return true/false
+     */
+    static bool isCacheValid(QString imagePath);
+
+    bool isEmpty() const;
+    quint64 width() const;
+    quint64 height() const;
+    quint32 levelCount() const;
+    const LevelInfo& level(quint32 level) const;
+    const PageInfo& page(quint32 level, quint32 pageX, quint32 pageY) const;
+
+    /**
+     * @brief readPage 解码单页
+     *
+     * 数据损坏时抛出异常(const char*)。可在多个线程中同时调用。
+     * @param level 层级
+     * @param pageX 页列号
+     * @param pageY 页行号
+     * @return PAGE_SIZE * PAGE_SIZE 的RGB888图像，第0行为上边界
+     */
+    QImage readPage(quint32 level, quint32 pageX, quint32 pageY) const;
+
+private:
+    // 映射文件，金字塔拷贝之间共享
+    std::shared_ptr<QFile> mpFile{};
+    const uchar* mpMapped{nullptr};
+
+    quint64 muWidth{0};
+    quint64 muHeight{0};
+    std::vector<LevelInfo> mLevels{};
+    const PageInfo* mpPages{nullptr};
+};
+
+#endif // ORTHOPYRAMID_H
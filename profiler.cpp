@@ -0,0 +1,95 @@
+#include "profiler.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <atomic>
+
+namespace {
+
+// 进程内单调时钟的起点
+const QElapsedTimer& clock() {
+    static QElapsedTimer timer = []() {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+}
+
+Profiler::Scope::Scope(const char *name, const char *category)
+    : mpName(name), mpCategory(category), miStart(Profiler::now()) {}
+
+Profiler::Scope::~Scope() {
+    Profiler::instance().record(mpName, mpCategory, miStart, Profiler::now() - miStart,
+                                Profiler::currentThread());
+}
+
+Profiler &Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+qint64 Profiler::now() {
+    return clock().nsecsElapsed();
+}
+
+quint32 Profiler::currentThread() {
+    static std::atomic<quint32> nextThread{1};
+    thread_local quint32 thread = nextThread++;
+    return thread;
+}
+
+void Profiler::record(const char *name, const char *category, qint64 start, qint64 duration,
+                      quint32 thread) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    Event event{name, category, start, duration, thread};
+    if(mEvents.size() < MAX_EVENTS) {
+        mEvents.push_back(event);
+    } else {
+        mEvents[muNext % MAX_EVENTS] = event;
+    }
+    ++muNext;
+}
+
+std::vector<Profiler::Event> Profiler::events() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if(mEvents.size() < MAX_EVENTS) return mEvents;
+
+    // 写满后最早的事件位于下一个写入位置
+    std::vector<Event> ordered;
+    ordered.reserve(mEvents.size());
+    quint64 first = muNext % MAX_EVENTS;
+    ordered.insert(ordered.end(), mEvents.begin() + first, mEvents.end());
+    ordered.insert(ordered.end(), mEvents.begin(), mEvents.begin() + first);
+    return ordered;
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEvents.clear();
+    muNext = 0;
+}
+
+bool Profiler::exportChromeTrace(QString path) const {
+    std::vector<Event> snapshot = events();
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) return false;
+    QTextStream stream(&file);
+
+    // 完整事件(ph = X)，时间以微秒为单位；GPU轨道单独命名
+    stream << "{\"traceEvents\":[\n";
+    stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD
+           << ",\"args\":{\"name\":\"GPU\"}}";
+    for(const Event& event : snapshot) {
+        stream << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category
+               << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << QString::number(event.start / 1000.0, 'f', 3)
+               << ",\"dur\":" << QString::number(event.duration / 1000.0, 'f', 3) << "}";
+    }
+    stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    stream.flush();
+    return stream.status() == QTextStream::Ok && file.error() == QFileDevice::NoError;
+}
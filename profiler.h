@@ -0,0 +1,112 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QString>
+#include <QtGlobal>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief The Profiler class
+ *
+ * 进程内的耗时记录，可导出为Chrome trace-event JSON(chrome://tracing、Perfetto)。
+ * CPU耗时以Scope在作用域结束时记录，GPU耗时由渲染器的计时查询得到后写入GPU轨道。
+ * 事件保存在固定容量的环形缓冲区中，写满后覆盖最早的事件；可在任意线程中记录。
+ */
+class Profiler {
+public:
+    // 环形缓冲区容量(事件数)
+    static const quint64 MAX_EVENTS = 1 << 20;
+    // GPU轨道的线程号，CPU线程从1开始编号
+    static const quint32 GPU_THREAD = 0;
+
+    /**
+     * @brief The Event struct 一段耗时
+     */
+    struct Event {
+        // 名称与类别须为字符串常量
+        const char* name;
+        const char* category;
+        // 开始时间与持续时间(ns，自进程启动计)
+        qint64 start;
+        qint64 duration;
+        quint32 thread;
+    };
+
+    /**
+     * @brief The Scope class 在构造与析构之间计时，析构时记录到全局Profiler
+     */
+    class Scope {
+    public:
+        /**
+         * @param name 名称(字符串常量)
+         * @param category 类别(字符串常量)
+         */
+        explicit Scope(const char* name, const char* category = "cpu");
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* mpName;
+        const char* mpCategory;
+        qint64 miStart;
+    };
+
+public:
+    /**
+     * @brief instance 获取全局Profiler
+     * @return
+     */
+    static Profiler& instance();
+
+    /**
+     * @brief now 获取当前时间
+     * @return 自进程启动的纳秒数
+     */
+    static qint64 now();
+
+    /**
+     * @brief currentThread 获取当前线程的编号(从1开始，按首次记录的顺序)
+     * @return
+     */
+    static quint32 currentThread();
+
+    /**
+     * @brief record 记录一段耗时
+     * @param name 名称(字符串常量)
+     * @param category 类别(字符串常量)
+     * @param start 开始时间(ns)
+     * @param duration 持续时间(ns)
+     * @param thread 线程编号，GPU耗时为GPU_THREAD
+     */
+    void record(const char* name, const char* category, qint64 start, qint64 duration,
+                quint32 thread);
+
+    /**
+     * @brief events 获取按记录顺序排列的事件副本
+     * @return
+     */
+    std::vector<Event> events() const;
+
+    void clear();
+
+    /**
+     * @brief exportChromeTrace 导出为Chrome trace-event JSON
+     * @param path 文件路径
+     * @return 写入失败时为false
+     */
+    bool exportChromeTrace(QString path) const;
+
+private:
+    Profiler() = default;
+
+private:
+    mutable std::mutex mMutex;
+    std::vector<Event> mEvents{};
+    // 下一个写入位置，mEvents写满之后循环使用
+    quint64 muNext{0};
+};
+
+#endif // PROFILER_H
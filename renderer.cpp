@@ -4,19 +4,154 @@
 #include <QSurfaceFormat>
 #include <limits>
 #include <algorithm>
-#include <QRandomGenerator>
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QScreen>
+#include <QtMath>
+#include <cmath>
+#include <cstring>
+#include "profiler.h"
+#include "vertexcache.h"
+#include <QPainter>
+#ifndef QT_OPENGL_ES_2
+#include <QOpenGLTimerQuery>
+#endif
+
+// GLES2头文件中没有的纹理格式
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+#ifndef GL_RG8
+#define GL_RG8 0x822B
+#endif
+#ifndef GL_LUMINANCE32F_ARB
+#define GL_LUMINANCE32F_ARB 0x8818
+#endif
+
+namespace {
+
+// 高程纹理位移方式中格网块的边长(格网数)，与细节层次节点相同
+const quint64 kPatchSize = TerrainLod::PATCH_SIZE;
+
+/**
+ * @brief The QualityLevel struct 交互时的画质等级
+ */
+struct QualityLevel {
+    // 渲染分辨率缩放，小于1或关闭多重采样时绘制到离屏目标
+    float resolutionScale;
+    bool multisample;
+    // 细节层次误差容限的倍数
+    float lodToleranceScale;
+};
+
+const QualityLevel kQualityLevels[Renderer::QUALITY_LEVEL_COUNT] = {
+    {1.0f, true, 1.0f},
+    {1.0f, false, 2.0f},
+    {0.75f, false, 4.0f},
+    {0.5f, false, 8.0f},
+};
+
+// 改变画质等级后至少经过的帧数，避免来回切换
+const int kQualitySettleFrames = 3;
+
+// GPU计时查询个数，结果通常在几帧之后才可读取
+const int kGpuQueryCount = 4;
+
+/**
+ * @brief buildPatch 生成高程纹理位移方式重复绘制的格网块
+ *
+ * 顶点为(列号, 行号, 0, 裙边标记)，共(kPatchSize + 1)^2个格网顶点与四条边上的裙边顶点；
+ * 格网行条带与四条裙边条带以退化三角形拼接为一个条带，对角线与全分辨率网格相同。
+ * @param vertices 输出的顶点属性
+ * @param indices 输出的条带索引
+ */
+void buildPatch(std::vector<GLushort>& vertices, std::vector<GLushort>& indices) {
+    const GLushort n = GLushort(kPatchSize + 1);
+    vertices.clear();
+    indices.clear();
+    auto addVertex = [&](GLushort col, GLushort row, GLushort skirt) {
+        vertices.insert(vertices.end(), {col, row, 0, skirt});
+        return GLushort(vertices.size() / 4 - 1);
+    };
+    for(GLushort row = 0; row < n; ++row) {
+        for(GLushort col = 0; col < n; ++col) addVertex(col, row, 0);
+    }
+
+    auto beginStrip = [&](GLushort first) {
+        if(!indices.empty()) indices.insert(indices.end(), {indices.back(), first});
+    };
+
+    // 格网
+    for(GLushort row = 0; row + 1 < n; ++row) {
+        beginStrip(GLushort((row + 1) * n));
+        for(GLushort col = 0; col < n; ++col) {
+            indices.push_back(GLushort((row + 1) * n + col));
+            indices.push_back(GLushort(row * n + col));
+        }
+    }
+
+    // 裙边：上下两行、左右两列
+    for(GLushort row : {GLushort(0), GLushort(n - 1)}) {
+        GLushort first = addVertex(0, row, 1);
+        beginStrip(first);
+        for(GLushort col = 0; col < n; ++col) {
+            indices.push_back(col == 0 ? first : addVertex(col, row, 1));
+            indices.push_back(GLushort(row * n + col));
+        }
+    }
+    for(GLushort col : {GLushort(0), GLushort(n - 1)}) {
+        GLushort first = addVertex(col, 0, 1);
+        beginStrip(first);
+        for(GLushort row = 0; row < n; ++row) {
+            indices.push_back(row == 0 ? first : addVertex(col, row, 1));
+            indices.push_back(GLushort(row * n + col));
+        }
+    }
+}
+
+}
 
 Renderer::Renderer(QWidget *parent): QOpenGLWidget(parent) {
     QSurfaceFormat format;
     format.setSamples(16);
     setFormat(format);
     setFocusPolicy(Qt::StrongFocus);
+
+    mFrameTimer.setSingleShot(true);
+    connect(&mFrameTimer, &QTimer::timeout, this, [this]() {
+        updateMvpMatrix();
+        update();
+    });
+    mInteractionTimer.setSingleShot(true);
+    mInteractionTimer.setInterval(INTERACTION_IDLE_MS);
+    connect(&mInteractionTimer, &QTimer::timeout, this, [this]() {
+        // 交互结束，以完整画质重绘
+        mbInteracting = false;
+        setQualityLevel(0);
+        update();
+    });
 }
 
 Renderer::~Renderer() {
+    makeCurrent();
     cleanUpBuffers();
+    deleteHeightmap();
+    for(QOpenGLTimerQuery* pQuery : mGpuQueries) delete pQuery;
+    delete mpReducedFbo;
+    mTextureBlitter.destroy();
+    if(mGradientTexId) glDeleteTextures(1, &mGradientTexId);
+    if(mPatchVboId) glDeleteBuffers(1, &mPatchVboId);
+    if(mPatchEboId) glDeleteBuffers(1, &mPatchEboId);
+    doneCurrent();
     delete mProgram;
+    delete mHeightmapProgram;
 }
 
 void Renderer::initializeGL() {
@@ -30,25 +165,106 @@ void Renderer::initializeGL() {
                                       Helpers::readFile(Helpers::applicationDir + "/dem.vsh"));
     mProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
                                       Helpers::readFile(Helpers::applicationDir + "/dem.fsh"));
+    mProgram->bindAttributeLocation("aPosition", mPositionAttr);
     mProgram->link();
 
-    // 获取着色器变量位置
-    mPositionAttr = mProgram->attributeLocation("aPosition");
-    mColorAttr =  mProgram->attributeLocation("aColor");
-    mTexCoordAttr = mProgram->attributeLocation("aTexCoord");
-    mMatrixUnif = mProgram->uniformLocation("uMatrix");
-    mEnableTexUnif = mProgram->uniformLocation("uEnableTex");
-    mSamplerUnif = mProgram->uniformLocation("uSampler");
-
-    Q_ASSERT(mPositionAttr != -1);
-    Q_ASSERT(mColorAttr != -1);
-//    Q_ASSERT(mTexCoordAttr != -1);
-    Q_ASSERT(mMatrixUnif != -1);
-//    Q_ASSERT(mEnableTexUnif != -1);
-//    Q_ASSERT(mSamplerUnif != -1);
+    // 获取每次绘制调用都要更新的uniform变量位置，其余变量每帧按名称设置
+    mSkirtBaseUnif = mProgram->uniformLocation("uSkirtBase");
+
+    /**
+     * 高程纹理位移需要顶点着色器能读取纹理，并且能创建单通道浮点纹理：
+     * OpenGL 3.0 / OpenGL ES 3.0起支持R32F，更低版本退而使用浮点亮度纹理。
+     */
+    QOpenGLContext* pContext = QOpenGLContext::currentContext();
+    int glMajorVersion = pContext->format().majorVersion();
+    if(pContext->isOpenGLES()) {
+        if(glMajorVersion >= 3) {
+            mHeightmapInternalFormat = GL_R32F, mHeightmapFormat = GL_RED;
+        } else if(pContext->hasExtension("GL_OES_texture_float")) {
+            mHeightmapInternalFormat = GL_LUMINANCE, mHeightmapFormat = GL_LUMINANCE;
+        }
+    } else {
+        if(glMajorVersion >= 3 || (pContext->hasExtension("GL_ARB_texture_rg") &&
+                                   pContext->hasExtension("GL_ARB_texture_float"))) {
+            mHeightmapInternalFormat = GL_R32F, mHeightmapFormat = GL_RED;
+        } else if(pContext->hasExtension("GL_ARB_texture_float")) {
+            mHeightmapInternalFormat = GL_LUMINANCE32F_ARB, mHeightmapFormat = GL_LUMINANCE;
+        }
+    }
+    // 法向纹理：OpenGL 3.0 / OpenGL ES 3.0起使用RG8，更低版本使用亮度-透明度纹理
+    bool rgSupported = pContext->isOpenGLES() ? glMajorVersion >= 3 :
+                       (glMajorVersion >= 3 || pContext->hasExtension("GL_ARB_texture_rg"));
+    if(rgSupported) {
+        mNormalInternalFormat = GL_RG8, mNormalFormat = GL_RG;
+    } else {
+        mNormalInternalFormat = GL_LUMINANCE_ALPHA, mNormalFormat = GL_LUMINANCE_ALPHA;
+    }
+    GLint vertexTextureUnits = 0;
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertexTextureUnits);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
+
+    // 像素缓冲区对象：OpenGL 2.1 / OpenGL ES 3.0起支持
+    mbPixelBufferSupported = pContext->isOpenGLES() ? glMajorVersion >= 3 :
+                             (pContext->format().version() >= qMakePair(2, 1) ||
+                              pContext->hasExtension("GL_ARB_pixel_buffer_object"));
+
+    mbHeightmapSupported = false;
+    if(vertexTextureUnits > 0 && mHeightmapFormat != 0) {
+        mHeightmapProgram = new QOpenGLShaderProgram(this);
+        mHeightmapProgram->addShaderFromSourceCode(QOpenGLShader::Vertex,
+                Helpers::readFile(Helpers::applicationDir + "/heightmap.vsh"));
+        mHeightmapProgram->addShaderFromSourceCode(QOpenGLShader::Fragment,
+                Helpers::readFile(Helpers::applicationDir + "/dem.fsh"));
+        mHeightmapProgram->bindAttributeLocation("aPosition", mPositionAttr);
+        mbHeightmapSupported = mHeightmapProgram->link();
+        mPatchOriginUnif = mHeightmapProgram->uniformLocation("uPatchOrigin");
+        mPatchStepUnif = mHeightmapProgram->uniformLocation("uPatchStep");
+        mPatchEndUnif = mHeightmapProgram->uniformLocation("uPatchEnd");
+        mPatchSkirtBaseUnif = mHeightmapProgram->uniformLocation("uSkirtBase");
+    }
+
+    // 所有节点共用的格网块
+    if(mbHeightmapSupported) {
+        std::vector<GLushort> patchVertices, patchIndices;
+        buildPatch(patchVertices, patchIndices);
+        mPatchIndexCount = GLsizei(patchIndices.size());
+        glGenBuffers(1, &mPatchVboId);
+        glGenBuffers(1, &mPatchEboId);
+        glBindBuffer(GL_ARRAY_BUFFER, mPatchVboId);
+        glBufferData(GL_ARRAY_BUFFER, patchVertices.size() * sizeof(GLushort),
+                     patchVertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mPatchEboId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, patchIndices.size() * sizeof(GLushort),
+                     patchIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    // 渐变查找纹理，GLES2没有一维纹理，使用高度为1的二维纹理
+    glGenTextures(1, &mGradientTexId);
+    glBindTexture(GL_TEXTURE_2D, mGradientTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mbGradientDirty = true;
 
     // 消隐
     glEnable(GL_DEPTH_TEST);
+
+    // GPU计时查询：OpenGL 3.3或GL_ARB_timer_query，OpenGL ES不支持
+#ifndef QT_OPENGL_ES_2
+    for(int i = 0; i < kGpuQueryCount; ++i) {
+        auto pQuery = new QOpenGLTimerQuery(this);
+        if(!pQuery->create()) {
+            delete pQuery;
+            break;
+        }
+        mGpuQueries.push_back(pQuery);
+        mGpuQueryStarts.push_back(-1);
+    }
+#endif
 }
 
 void Renderer::resizeGL(int w, int h) {
@@ -58,201 +274,747 @@ void Renderer::resizeGL(int w, int h) {
 void Renderer::paintGL() {
     if(!ready()) return;
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    Profiler::Scope frameScope("paintGL", "frame");
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+    if(!mbMeasuring) {
+        mfFrameInterval = mLastFrameTimer.isValid() ? mLastFrameTimer.nsecsElapsed() / 1e6 : 0.0;
+        mLastFrameTimer.start();
+    }
+    collectGpuTimings();
 
-    mProgram->bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // 传入MVP矩阵
-    mProgram->setUniformValue(mMatrixUnif, mMvpMatrix);
-    // 传入是否启用纹理
-    mProgram->setUniformValue(mEnableTexUnif, mbRenderTexture);
+    // 上传正射影像的下一片
+    if(!mPendingOrtho.isNull()) streamOrthoTexture();
 
-    // 绑定缓冲区对象
-    glBindBuffer(GL_ARRAY_BUFFER, mVboIds[0]);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[0]);
+    // 所选提交方式需要的缓冲区或纹理尚未上传时只清屏
+    bool heightmap = mDrawMode == DrawMode::HeightmapTexture;
+    if(heightmap ? !hasHeightmap() : (!hasTerrainMesh() ||
+                                      (mDrawMode == DrawMode::CacheOptimizedTriangles &&
+                                       !hasCacheOptimizedIndices()))) {
+        mFrameStats = TerrainLod::SelectStats{0, 0, 0, 0};
+        if(!mbMeasuring) emit frameRendered();
+        return;
+    }
 
-    if(mbRenderTexture) {
-        mProgram->setUniformValue(mSamplerUnif, 0);
+    // 按可见节点请求影像页，并上传本帧可用的页
+    if(mbRenderTexture && mpVirtualTexture) updateVirtualTexture();
+
+    // 降低画质时绘制到离屏目标
+    bool reduced = bindReducedFramebuffer();
+
+    QOpenGLShaderProgram* pProgram = heightmap ? mHeightmapProgram : mProgram;
+    pProgram->bind();
+    setTerrainUniforms(pProgram);
+    beginGpuTiming();
+
+    // 绑定缓冲区对象，细节层次使用各节点的条带索引，高程纹理位移使用格网块
+    if(heightmap) {
+        glBindBuffer(GL_ARRAY_BUFFER, mPatchVboId);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mPatchEboId);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, mVboIds[0]);
+        int ebo = mDrawMode == DrawMode::QuadtreeLod ? 1 : mDrawMode == DrawMode::TinTriangles ? 2 :
+                  mDrawMode == DrawMode::CacheOptimizedTriangles ? 3 : 0;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[ebo]);
     }
 
-    // 解释顶点属性
-    GLuint bytesPerVertex = (3 + 4 + 2) * sizeof(GLfloat);
-    glVertexAttribPointer(mPositionAttr,    3, GL_FLOAT, GL_FALSE, bytesPerVertex,
+    // 解释顶点属性：列号、行号、高程编码(格网块中为0)、裙边标记(16位无符号整数，不归一化)
+    GLuint bytesPerVertex = TerrainMesh::VERTEX_COMPONENTS * sizeof(GLushort);
+    glVertexAttribPointer(mPositionAttr,    4, GL_UNSIGNED_SHORT, GL_FALSE, bytesPerVertex,
                           0);
-    glVertexAttribPointer(mColorAttr,       4, GL_FLOAT, GL_FALSE, bytesPerVertex,
-                          (const void *)(3 * sizeof(GLfloat)));
-    glVertexAttribPointer(mTexCoordAttr,    2, GL_FLOAT, GL_FALSE, bytesPerVertex,
-                          (const void *)(7 * sizeof(GLfloat)));
 
     glEnableVertexAttribArray(mPositionAttr);
-    glEnableVertexAttribArray(mColorAttr);
-    glEnableVertexAttribArray(mTexCoordAttr);
     // 渲染
-    if(mbRenderTexture && mpTexture) {
-        mpTexture->bind(0);
+    if(mbRenderTexture && !mpVirtualTexture) {
+        glBindTexture(GL_TEXTURE_2D, mOrthoTexId);
     }
-    for(quint64 i = 0; i < muDemRows - 1; ++i) {
-        glDrawElements(GL_TRIANGLE_STRIP, muDemCols * 2, GL_UNSIGNED_INT,
-                       (const void *)(i * muDemCols * 2 * sizeof(GLuint)));
+    if(mDrawMode == DrawMode::QuadtreeLod || heightmap) {
+        // 裙边下拉到节点的最低高程
+        TerrainLod::View view = lodView();
+        view.pFrustum = mbFrustumCulling ? &mFrustum : nullptr;
+        mLod.select(view, mLodSelection, &mFrameStats);
+        for(quint32 index : mLodSelection) {
+            const TerrainLod::Node& node = mLod.nodes[index];
+            if(heightmap) {
+                // 格网块按节点的取样间隔放大，超出节点范围的顶点截断到节点边界
+                pProgram->setUniformValue(mPatchOriginUnif, QVector2D(node.col, node.row));
+                pProgram->setUniformValue(mPatchStepUnif, GLfloat(quint64(1) << node.level));
+                pProgram->setUniformValue(mPatchEndUnif, QVector2D(node.colEnd, node.rowEnd));
+                pProgram->setUniformValue(mPatchSkirtBaseUnif, node.minElev);
+                glDrawElements(GL_TRIANGLE_STRIP, mPatchIndexCount, GL_UNSIGNED_SHORT, 0);
+            } else {
+                pProgram->setUniformValue(mSkirtBaseUnif, node.minElev);
+                glDrawElements(GL_TRIANGLE_STRIP, node.indexCount, GL_UNSIGNED_INT,
+                               (const void *)(node.indexOffset * sizeof(GLuint)));
+            }
+        }
+    } else if(mDrawMode == DrawMode::TinTriangles) {
+        glDrawElements(GL_TRIANGLES, muTinIndexCount, GL_UNSIGNED_INT, 0);
+        mFrameStats = TerrainLod::SelectStats{1, 0, muTinIndexCount / 3, 0};
+    } else if(mDrawMode == DrawMode::CacheOptimizedTriangles) {
+        glDrawElements(GL_TRIANGLES, muCacheIndexCount, GL_UNSIGNED_INT, 0);
+        mFrameStats = TerrainLod::SelectStats{1, 0, (muDemCols - 1) * (muDemRows - 1) * 2, 0};
+    } else if(mDrawMode == DrawMode::StitchedStrip) {
+        glDrawElements(GL_TRIANGLE_STRIP, muIndexCount, GL_UNSIGNED_INT, 0);
+        mFrameStats = TerrainLod::SelectStats{1, 0, (muDemCols - 1) * (muDemRows - 1) * 2, 0};
+    } else {
+        mFrameStats = TerrainLod::SelectStats{muDemRows - 1, 0,
+                                              (muDemCols - 1) * (muDemRows - 1) * 2, 0};
+        // 跳过行间的退化索引
+        for(quint64 i = 0; i < muDemRows - 1; ++i) {
+            glDrawElements(GL_TRIANGLE_STRIP, muDemCols * 2, GL_UNSIGNED_INT,
+                           (const void *)(i * (muDemCols * 2 + 2) * sizeof(GLuint)));
+        }
     }
 
+    endGpuTiming();
     glDisableVertexAttribArray(mPositionAttr);
-    glDisableVertexAttribArray(mColorAttr);
-    glDisableVertexAttribArray(mTexCoordAttr);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    mProgram->release();
+    pProgram->release();
+
+    if(reduced) drawReducedFramebuffer();
+
+    // 交互时等待GPU完成，使帧时间包含GPU执行时间
+    if(mbInteracting) {
+        glFinish();
+        updateQualityLevel(frameTimer.nsecsElapsed() / 1e6);
+    }
+
+    // QPainter只能在绘制事件中打开
+    if(mbMeasuring) return;
+    if(mbProfilerOverlay) drawProfilerOverlay(frameTimer.nsecsElapsed() / 1e6);
+
+    emit frameRendered();
 }
 
-void Renderer::setupRenderer(const DigitalElevationModel *pDem, const QImage* pTexture,
-                             bool useRandomizedGradient) {
-    if(!pDem || pDem->isEmpty()) {
-        return;
+void Renderer::beginGpuTiming() {
+#ifndef QT_OPENGL_ES_2
+    // 上一轮的结果尚未取回时跳过本帧
+    if(mGpuQueries.empty() || mGpuQueryStarts[miGpuQuery] >= 0) return;
+    mGpuQueryStarts[miGpuQuery] = Profiler::now();
+    mGpuQueries[miGpuQuery]->begin();
+    mbGpuTiming = true;
+#endif
+}
+
+void Renderer::endGpuTiming() {
+#ifndef QT_OPENGL_ES_2
+    if(!mbGpuTiming) return;
+    mGpuQueries[miGpuQuery]->end();
+    miGpuQuery = (miGpuQuery + 1) % int(mGpuQueries.size());
+    mbGpuTiming = false;
+#endif
+}
+
+void Renderer::collectGpuTimings() {
+#ifndef QT_OPENGL_ES_2
+    /**
+     * 取回已完成的查询，不等待。
+     * GPU没有与CPU共用的时间起点，跟踪中GPU事件以CPU提交时刻为开始时间，只有持续时间是测得的。
+     */
+    for(quint64 i = 0; i < mGpuQueries.size(); ++i) {
+        if(mGpuQueryStarts[i] < 0 || !mGpuQueries[i]->isResultAvailable()) continue;
+        qint64 duration = qint64(mGpuQueries[i]->waitForResult());
+        Profiler::instance().record("draw submission", "gpu", mGpuQueryStarts[i], duration,
+                                    Profiler::GPU_THREAD);
+        mfGpuFrameTime = duration / 1e6;
+        mGpuQueryStarts[i] = -1;
+    }
+#endif
+}
+
+void Renderer::drawProfilerOverlay(double cpuFrameTime) {
+    QStringList lines{
+        QString("帧间隔 %1 ms").arg(mfFrameInterval, 0, 'f', 2),
+        QString("CPU %1 ms").arg(cpuFrameTime, 0, 'f', 2),
+        mfGpuFrameTime >= 0.0 ? QString("GPU %1 ms").arg(mfGpuFrameTime, 0, 'f', 2) :
+        QString("GPU 不支持计时查询"),
+        QString("绘制调用 %1").arg(mFrameStats.drawnNodes),
+        QString("三角形 %1").arg(mFrameStats.drawnTriangles),
+    };
+
+    // 在帧缓冲上叠加半透明文字框
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::TextAntialiasing);
+    QFontMetrics metrics(painter.font());
+    int textWidth = 0;
+    for(const QString& line : lines) textWidth = std::max(textWidth, metrics.horizontalAdvance(line));
+    QRect box(8, 8, textWidth + 12, metrics.height() * int(lines.size()) + 8);
+    painter.fillRect(box, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    for(int i = 0; i < lines.size(); ++i) {
+        painter.drawText(box.left() + 6, box.top() + 4 + metrics.ascent() + i * metrics.height(), lines[i]);
     }
-    mbRenderTexture = pTexture != nullptr ? true : false;
+    painter.end();
 
-    muDemCols = pDem->getCols();
-    muDemRows = pDem->getRows();
-    mfBboxXSpan = muDemCols * pDem->getCellSize();
-    mfBboxYSpan = muDemRows * pDem->getCellSize();
+    // QPainter改变了GL状态
+    glEnable(GL_DEPTH_TEST);
+}
 
-    auto * pData = pDem->getData().data();
+bool Renderer::profilerOverlay() const {
+    return mbProfilerOverlay;
+}
 
-    std::vector<float> vertexAttribs{};
-    vertexAttribs.reserve(muDemCols * muDemRows * (3 + 4 + 2));
-    std::vector<std::vector<GLuint>> indexArrays(muDemRows - 1);
+void Renderer::setProfilerOverlay(bool enabled) {
+    mbProfilerOverlay = enabled;
+    update();
+}
 
-    // 搜索DEM高程跨度
-    float maxElev = -std::numeric_limits<float>::max(), minElev = -maxElev;
+double Renderer::lastGpuFrameTime() const {
+    return mfGpuFrameTime;
+}
 
-    for(quint64 i = 0; i < muDemCols * muDemRows; ++i) {
-        if(pData[i] < minElev) minElev = pData[i];
-        if(pData[i] > maxElev) maxElev = pData[i];
+bool Renderer::bindReducedFramebuffer() {
+    const QualityLevel& quality = kQualityLevels[miQualityLevel];
+    if(quality.multisample && quality.resolutionScale >= 1.0f) return false;
+    if(!QOpenGLFramebufferObject::hasOpenGLFramebufferObjects()) return false;
+
+    // 离屏目标无多重采样，尺寸随等级与窗口变化时重建
+    QSize size = (QSizeF(width(), height()) * devicePixelRatioF() * quality.resolutionScale).toSize()
+                 .expandedTo(QSize(1, 1));
+    if(!mpReducedFbo || mpReducedFbo->size() != size) {
+        delete mpReducedFbo;
+        mpReducedFbo = new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::Depth);
+        glBindTexture(GL_TEXTURE_2D, mpReducedFbo->texture());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
+    if(!mTextureBlitter.isCreated() && !mTextureBlitter.create()) return false;
+
+    mpReducedFbo->bind();
+    glViewport(0, 0, size.width(), size.height());
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    return true;
+}
 
-    mfMaxElev = maxElev, mfMinElev = minElev;
+void Renderer::drawReducedFramebuffer() {
+    // 回到窗口的帧缓冲，将离屏目标线性缩放到整个视口
+    QOpenGLFramebufferObject::bindDefault();
+    QRect viewport(QPoint(0, 0), (QSizeF(width(), height()) * devicePixelRatioF()).toSize());
+    glViewport(0, 0, viewport.width(), viewport.height());
+    glDisable(GL_DEPTH_TEST);
+    mTextureBlitter.bind();
+    mTextureBlitter.blit(mpReducedFbo->texture(),
+                         QOpenGLTextureBlitter::targetTransform(viewport, viewport),
+                         QOpenGLTextureBlitter::OriginBottomLeft);
+    mTextureBlitter.release();
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Renderer::setupRenderer(const DigitalElevationModel *pDem) {
+    if(!pDem || pDem->isEmpty()) {
+        return;
+    }
+
+    Profiler::Scope scope("Renderer::setupRenderer");
+    TerrainMesh mesh = TerrainMesh::build(*pDem, DigitalElevationModel::ProgressCallback(), mbHillshade);
+    if(mfTinMaxError > 0.0f) mesh.tin = TinMesh::build(*pDem, mfTinMaxError);
+    uploadTerrainMesh(mesh);
+}
+
+void Renderer::uploadTerrainMesh(const TerrainMesh &mesh) {
+    if(mesh.isEmpty()) {
+        return;
+    }
+    Profiler::Scope scope("buffer upload", "upload");
+
+    // DEM范围不变时(如只改变存储方式或提交方式)保留相机
+    bool sameExtent = muDemCols == mesh.cols && muDemRows == mesh.rows &&
+                      mDemXYCenter == mesh.xyCenter && mfMinElev == mesh.minElev &&
+                      mfMaxElev == mesh.maxElev;
+
+    muDemCols = mesh.cols;
+    muDemRows = mesh.rows;
+    muIndexCount = mesh.indices.size();
+    muTinIndexCount = mesh.tin.indices.size();
+    mfTinMaxError = mesh.tin.maxError;
+    mfBboxXSpan = mesh.xSpan;
+    mfBboxYSpan = mesh.ySpan;
+    mfMaxElev = mesh.maxElev, mfMinElev = mesh.minElev;
+    mfColorMaxElev = mfMaxElev, mfColorMinElev = mfMinElev;
 
     // 计算渲染参数
-    float elevSpan = maxElev - minElev;
+    float elevSpan = mfMaxElev - mfMinElev;
     mfBboxMinEdge = std::min({elevSpan, mfBboxXSpan, mfBboxYSpan});
     mfBboxMaxEdge = std::max({elevSpan, mfBboxXSpan, mfBboxYSpan});
     mfBboxDiagonal = sqrt(elevSpan * elevSpan +  mfBboxXSpan * mfBboxXSpan + mfBboxYSpan * mfBboxYSpan);
     mfDemGridDiagonal = sqrt(mfBboxXSpan * mfBboxXSpan + mfBboxYSpan * mfBboxYSpan);
 
-    // 找到DEM格网中心位置
-    auto geoCenter = pDem->getGeoCoord(muDemRows / 2.0, muDemCols / 2.0).toVector2D();
-    mDemXYCenter = QVector2D(geoCenter.y(), geoCenter.x());
-
-    // 确定要渲染的渐变
-    std::vector<Helpers::ColorStop> gradient = mDefaultGradient;
-    if(useRandomizedGradient) {
-        gradient = std::vector<Helpers::ColorStop>();
-        int nStops = QRandomGenerator::global()->bounded(2, 6);
-        for(int i = 0; i <= nStops; ++i) {
-            gradient.push_back(Helpers::ColorStop(i / float(nStops),
-                                                  QRandomGenerator::global()->bounded(0, 256),
-                                                  QRandomGenerator::global()->bounded(0, 256),
-                                                  QRandomGenerator::global()->bounded(0, 256),
-                                                  1.0f
-                                                 ));
-        }
-    }
-
-    // 生成顶点数据
-    for(quint64 y = 0; y < muDemRows; ++y) {
-        auto &currentIndexArray = indexArrays[y];
-
-        for(quint64 x = 0; x < muDemCols; ++x) {
-            quint64 index = x + y * muDemCols;
-
-            QVector3D geoCoord = pDem->getGeoCoord(y, x);
-
-            /**
-             * 交换XY轴输入顶点
-             *
-             * 地理坐标系为北东高坐标（左手系），而OpenGL为右手。
-             * 直接输入会导致XY翻转，DEM平面被沿XY轴角平分线对称。
-             * 交换后输入，世界坐标系的Y轴为DEM地理参考的X轴，世界坐标系的X轴为地理参考的Y轴。
-             */
-            vertexAttribs.insert(vertexAttribs.end(), {
-                geoCoord.y(),
-                geoCoord.x(),
-                pData[index],
-            });
-
-            // 插值出顶点渐变颜色
-            auto vertexColor = Helpers::linearGradient(gradient,
-                               (pData[index] - minElev) / (maxElev - minElev));
-            vertexAttribs.insert(vertexAttribs.end(), vertexColor.begin(), vertexColor.end());
-
-            // 纹理映射
-            vertexAttribs.insert(vertexAttribs.end(), {
-                mbRenderTexture ? x / float(muDemCols)              : 0,
-                mbRenderTexture ? -(y / float(muDemRows)) + 1.0f    : 0,
-            });
-
-            // 生成索引数组
-            if(y != muDemRows - 1) { // 若非最后一列
-                currentIndexArray.insert(currentIndexArray.end(), {
-                    GLuint(index + muDemCols),
-                    GLuint(index)
-                });
-            }
-        }
-    }
+    mDemXYCenter = mesh.xyCenter;
+    mGridToWorldScale = QVector3D(mesh.cellSize, -mesh.cellSize, mesh.heightStep);
+    mGridToWorldOffset = QVector3D(mesh.originX, mesh.originY, mesh.minElev);
 
-    // 初始化渲染
-    cleanUpBuffers();
+    // 初始化渲染，GL调用需在本控件的上下文中进行
+    // 高程纹理属于之前的DEM，需要时重新上传
+    makeCurrent();
+    deleteMeshBuffers();
+    deleteHeightmap();
     mVboIds = std::vector<GLuint>(1, 0);
-    mEboIds = std::vector<GLuint>(1, 0);
+    mEboIds = std::vector<GLuint>(4, 0);
 
     glGenBuffers(1, mVboIds.data());
-    glGenBuffers(1, mEboIds.data());
+    glGenBuffers(4, mEboIds.data());
 
     // 缓存VBO数据
     glBindBuffer(GL_ARRAY_BUFFER, mVboIds[0]);
-    glBufferData(GL_ARRAY_BUFFER, vertexAttribs.size() * sizeof(GLfloat),
-                 vertexAttribs.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertexAttribs.size() * sizeof(GLushort),
+                 mesh.vertexAttribs.data(), GL_STATIC_DRAW);
 
     // 缓存EBO数据
-    auto flatIndexArray = std::accumulate(indexArrays.begin(),
-                                          indexArrays.end(),
-                                          std::vector<GLuint> {},
-    [](std::vector<GLuint>& a, std::vector<GLuint>& b) {
-        a.insert(a.end(), b.begin(), b.end());
-        return a;
-    });
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[0]);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 flatIndexArray.size() * sizeof(GLuint), flatIndexArray.data(), GL_STATIC_DRAW);
-
-    // 载入纹理图像
-    if(mbRenderTexture) {
-        mpTexture = new QOpenGLTexture((*pTexture).mirrored());
-        mpTexture->setMagnificationFilter(QOpenGLTexture::Linear);
-        mpTexture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
-        mpTexture->setSize(pTexture->width(), pTexture->height());
-        mpTexture->setFormat(QOpenGLTexture::TextureFormat::RGBFormat);
-        mpTexture->allocateStorage(QOpenGLTexture::PixelFormat::RGB, QOpenGLTexture::PixelType::UInt8);
-    }
+                 mesh.indices.size() * sizeof(GLuint), mesh.indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.lod.indices.size() * sizeof(GLuint),
+                 mesh.lod.indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.tin.indices.size() * sizeof(GLuint),
+                 mesh.tin.indices.data(), GL_STATIC_DRAW);
+    muMeshBytes = mesh.vertexAttribs.size() * sizeof(GLushort) +
+                  (mesh.indices.size() + mesh.lod.indices.size() + mesh.tin.indices.size()) *
+                  sizeof(GLuint);
+
+    // 节点选择只需要节点信息
+    mLod = TerrainLod();
+    mLod.nodes = mesh.lod.nodes;
+    mLod.originX = mesh.lod.originX;
+    mLod.originY = mesh.lod.originY;
+    mLod.cellSize = mesh.lod.cellSize;
 
     // 解绑
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    onResetCameraControl();
+    uploadNormalMap(mesh.normals);
+    doneCurrent();
+
+    if(!sameExtent) onResetCameraControl();
 
     updateMvpMatrix();
     update();
 }
 
+bool Renderer::hasTerrainMesh() const {
+    return !mVboIds.empty();
+}
+
+bool Renderer::hasTin() const {
+    return muTinIndexCount != 0;
+}
+
+void Renderer::uploadCacheOptimizedIndices() {
+    if(!hasTerrainMesh() || hasCacheOptimizedIndices()) return;
+
+    quint64 nIndices = VertexCache::gridTriangleIndexCount(muDemCols, muDemRows);
+    makeCurrent();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEboIds[3]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, nIndices * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+    std::vector<quint32> stripe;
+    quint64 offset = 0;
+    for(quint64 i = 0; i < VertexCache::gridStripeCount(muDemCols); ++i) {
+        stripe.clear();
+        VertexCache::gridStripeTriangles(muDemCols, muDemRows, i, stripe);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset * sizeof(GLuint),
+                        stripe.size() * sizeof(GLuint), stripe.data());
+        offset += stripe.size();
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    doneCurrent();
+
+    muCacheIndexCount = nIndices;
+    muMeshBytes += nIndices * sizeof(GLuint);
+    update();
+}
+
+bool Renderer::hasCacheOptimizedIndices() const {
+    return muCacheIndexCount != 0;
+}
+
+void Renderer::releaseTerrainMesh() {
+    makeCurrent();
+    deleteMeshBuffers();
+    doneCurrent();
+    update();
+}
+
+bool Renderer::heightmapTextureSupported() const {
+    return mbHeightmapSupported;
+}
+
+void Renderer::uploadHeightmap(const DigitalElevationModel &dem) {
+    if(!mbHeightmapSupported) throw "Vertex texture fetch of float textures is not supported.";
+    if(dem.getCols() != muDemCols || dem.getRows() != muDemRows || mLod.isEmpty())
+        throw "Heightmap size does not match the uploaded terrain mesh.";
+
+    Profiler::Scope scope("heightmap upload", "upload");
+    makeCurrent();
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if(dem.getCols() > quint64(maxTextureSize) || dem.getRows() > quint64(maxTextureSize)) {
+        doneCurrent();
+        throw "Heightmap exceeds the maximum texture size.";
+    }
+
+    deleteHeightmap();
+    glGenTextures(1, &mHeightmapTexId);
+    glBindTexture(GL_TEXTURE_2D, mHeightmapTexId);
+    // 顶点着色器中没有导数，不使用多级渐远纹理；浮点纹理不一定支持线性过滤
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, mHeightmapInternalFormat, GLsizei(dem.getCols()),
+                 GLsizei(dem.getRows()), 0, mHeightmapFormat, GL_FLOAT, nullptr);
+    muHeightmapCols = dem.getCols();
+    muHeightmapRows = dem.getRows();
+    uploadHeightmapRows(dem, 0, 0, muHeightmapRows, muHeightmapCols);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    doneCurrent();
+
+    update();
+}
+
+void Renderer::updateHeightmap(const DigitalElevationModel &dem, quint64 row, quint64 col,
+                               quint64 rows, quint64 cols) {
+    if(!hasHeightmap()) return;
+    if(dem.getCols() != muHeightmapCols || dem.getRows() != muHeightmapRows)
+        throw "Heightmap size does not match the uploaded heightmap.";
+    if(row >= muHeightmapRows || col >= muHeightmapCols) return;
+    rows = std::min(rows, muHeightmapRows - row);
+    cols = std::min(cols, muHeightmapCols - col);
+
+    makeCurrent();
+    glBindTexture(GL_TEXTURE_2D, mHeightmapTexId);
+    uploadHeightmapRows(dem, row, col, rows, cols);
+
+    // 只重新计算窗口及其一圈邻点所影响的法向纹素
+    NormalMap layout;
+    layout.cols = muNormalCols, layout.rows = muNormalRows, layout.step = muNormalStep;
+    QRect window = layout.affectedWindow(row, col, rows, cols);
+    if(mNormalTexId && !window.isEmpty()) {
+        std::vector<quint8> texels(quint64(window.width()) * window.height() * 2);
+        NormalMap::computeWindow(dem, muNormalStep, window, texels.data());
+        glBindTexture(GL_TEXTURE_2D, mNormalTexId);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, window.left(), window.top(), window.width(), window.height(),
+                        mNormalFormat, GL_UNSIGNED_BYTE, texels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    doneCurrent();
+
+    update();
+}
+
+void Renderer::releaseHeightmap() {
+    makeCurrent();
+    deleteHeightmap();
+    doneCurrent();
+    update();
+}
+
+bool Renderer::hasHeightmap() const {
+    return mHeightmapTexId != 0;
+}
+
+int Renderer::maxTextureSize() const {
+    return mMaxTextureSize;
+}
+
+void Renderer::setVirtualTexture(OrthoPyramid pyramid) {
+    if(pyramid.isEmpty()) return;
+    const OrthoPyramid::LevelInfo& base = pyramid.level(0);
+    if(base.pagesX > quint64(mMaxTextureSize) || base.pagesY > quint64(mMaxTextureSize))
+        throw "Orthophoto page table exceeds the maximum texture size.";
+
+    // 物理页缓存每个方向的槽位数，页表中以8位存储
+    const GLsizei pageSize = OrthoPyramid::PAGE_SIZE;
+    quint32 slots = quint32(std::clamp(std::min(int(VIRTUAL_ATLAS_SIZE), int(mMaxTextureSize)) / pageSize,
+                                       1, 256));
+
+    makeCurrent();
+    deleteOrthoTexture();
+    deleteVirtualTexture();
+    try {
+        mpVirtualTexture = std::make_unique<VirtualTexture>(std::move(pyramid), slots, slots);
+    } catch (const char*) {
+        doneCurrent();
+        throw;
+    }
+
+    glGenTextures(1, &mAtlasTexId);
+    glBindTexture(GL_TEXTURE_2D, mAtlasTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, slots * pageSize, slots * pageSize, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, nullptr);
+
+    glGenTextures(1, &mPageTableTexId);
+    glBindTexture(GL_TEXTURE_2D, mPageTableTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, mpVirtualTexture->tableCols(),
+                 mpVirtualTexture->tableRows(), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 mpVirtualTexture->pageTable().data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    doneCurrent();
+
+    mbRenderTexture = true;
+    update();
+}
+
+void Renderer::setOrthoTexture(QImage image) {
+    if(image.isNull()) return;
+    if(image.width() > mMaxTextureSize || image.height() > mMaxTextureSize)
+        throw "Orthophoto exceeds the maximum texture size.";
+    if(image.format() != QImage::Format_RGB888) image = image.convertToFormat(QImage::Format_RGB888);
+
+    // 只分配存储，像素由之后的各帧分片上传；之前的纹理保留到上传完成
+    Profiler::Scope scope("texture allocation", "upload");
+    makeCurrent();
+    deleteVirtualTexture();
+    if(mPendingOrthoTexId) glDeleteTextures(1, &mPendingOrthoTexId);
+    glGenTextures(1, &mPendingOrthoTexId);
+    glBindTexture(GL_TEXTURE_2D, mPendingOrthoTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width(), image.height(), 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if(mbPixelBufferSupported) {
+        for(QOpenGLBuffer& buffer : mUploadBuffers) {
+            if(!buffer.isCreated()) buffer.create();
+            buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+        }
+    }
+    doneCurrent();
+
+    mPendingOrtho = std::move(image);
+    miPendingOrthoRow = 0;
+    mbRenderTexture = true;
+    update();
+}
+
+void Renderer::releaseOrthoTexture() {
+    makeCurrent();
+    deleteOrthoTexture();
+    deleteVirtualTexture();
+    doneCurrent();
+    mbRenderTexture = false;
+    update();
+}
+
+bool Renderer::hasPendingTextureUploads() const {
+    return mPendingOrthoTexId || (mbRenderTexture && mpVirtualTexture && mpVirtualTexture->hasPendingPages());
+}
+
+bool Renderer::hasOrthoTexture() const {
+    return mOrthoTexId || mPendingOrthoTexId || mpVirtualTexture;
+}
+
+bool Renderer::hasVirtualTexture() const {
+    return mpVirtualTexture != nullptr;
+}
+
+VirtualTexture::Stats Renderer::virtualTextureStats() const {
+    return mpVirtualTexture ? mpVirtualTexture->stats() : VirtualTexture::Stats{0, 0, 0, 0, 0, 0};
+}
+
+quint64 Renderer::gpuMemoryBytes() const {
+    quint64 virtualTextureBytes = 0;
+    if(mpVirtualTexture) {
+        quint64 atlasPixels = quint64(mpVirtualTexture->slotsX()) * mpVirtualTexture->slotsY() *
+                              OrthoPyramid::PAGE_SIZE * OrthoPyramid::PAGE_SIZE;
+        virtualTextureBytes = atlasPixels * 3 + mpVirtualTexture->pageTable().size();
+    }
+    return muMeshBytes + muNormalBytes + muHeightmapCols * muHeightmapRows * sizeof(GLfloat) + muOrthoTexBytes +
+           virtualTextureBytes;
+}
+
+const std::vector<Helpers::ColorStop> &Renderer::defaultGradient() const {
+    return mDefaultGradient;
+}
+
+void Renderer::setGradient(const std::vector<Helpers::ColorStop> &gradient) {
+    if(gradient.empty()) throw "Unexpected stops for linear gradient.";
+    mGradient = gradient;
+    mbGradientDirty = true;
+    update();
+}
+
+void Renderer::setColorRange(float minElev, float maxElev) {
+    mfColorMinElev = minElev;
+    mfColorMaxElev = maxElev;
+    update();
+}
+
 void Renderer::switchProjectionType(ProjectionType type) {
     mCurrentProjType = type;
     onResetCameraControl();
 }
 
+const OrbitControls &Renderer::cameraControls() const {
+    return mOrbitCameraCtrl;
+}
+
+void Renderer::setCameraControls(const OrbitControls &controls) {
+    mOrbitCameraCtrl = controls;
+    updateMvpMatrix();
+    update();
+}
+
+Renderer::DrawMode Renderer::drawMode() const {
+    return mDrawMode;
+}
+
+void Renderer::setDrawMode(DrawMode mode) {
+    mDrawMode = mode;
+    update();
+}
+
+bool Renderer::frustumCulling() const {
+    return mbFrustumCulling;
+}
+
+void Renderer::setFrustumCulling(bool enabled) {
+    mbFrustumCulling = enabled;
+    update();
+}
+
+bool Renderer::hillshade() const {
+    return mbHillshade;
+}
+
+void Renderer::setHillshade(bool enabled) {
+    mbHillshade = enabled;
+    update();
+}
+
+bool Renderer::hasNormalMap() const {
+    return mNormalTexId != 0;
+}
+
+void Renderer::setNormalMap(const NormalMap &normals) {
+    // 高程纹理位移方式下网格缓冲区已释放，只要求已有DEM范围
+    if(!ready()) return;
+    makeCurrent();
+    uploadNormalMap(normals);
+    doneCurrent();
+    update();
+}
+
+float Renderer::lightAzimuth() const {
+    return mfLightAzimuth;
+}
+
+float Renderer::lightAltitude() const {
+    return mfLightAltitude;
+}
+
+void Renderer::setLightDirection(float azimuth, float altitude) {
+    mfLightAzimuth = std::fmod(azimuth, 360.0f);
+    mfLightAltitude = std::clamp(altitude, 0.0f, 90.0f);
+    update();
+}
+
+const TerrainLod::SelectStats &Renderer::frameStats() const {
+    return mFrameStats;
+}
+
+float Renderer::lodPixelTolerance() const {
+    return mfLodPixelTolerance;
+}
+
+void Renderer::setLodPixelTolerance(float pixels) {
+    mfLodPixelTolerance = std::max(pixels, 0.1f);
+    update();
+}
+
+float Renderer::frameBudget() const {
+    return mfFrameBudget;
+}
+
+void Renderer::setFrameBudget(float milliseconds) {
+    mfFrameBudget = std::max(milliseconds, 1.0f);
+    miFramesAtQualityLevel = 0;
+    mfAverageFrameTime = 0.0;
+}
+
+int Renderer::qualityLevel() const {
+    return miQualityLevel;
+}
+
+void Renderer::scheduleCameraFrame() {
+    mbInteracting = true;
+    mInteractionTimer.start();
+    if(mFrameTimer.isActive()) return;
+
+    // 距上一帧不足一个显示刷新间隔时推迟到间隔结束，期间的输入合并到同一帧
+    qreal refreshRate = screen() ? screen()->refreshRate() : 60.0;
+    qint64 interval = qRound64(1000.0 / std::max(refreshRate, qreal(1.0)));
+    qint64 elapsed = mLastFrameTimer.isValid() ? mLastFrameTimer.elapsed() : interval;
+    mFrameTimer.start(int(std::max<qint64>(interval - elapsed, 0)));
+}
+
+void Renderer::setQualityLevel(int level) {
+    level = std::clamp(level, 0, QUALITY_LEVEL_COUNT - 1);
+    miFramesAtQualityLevel = 0;
+    mfAverageFrameTime = 0.0;
+    if(level == miQualityLevel) return;
+    miQualityLevel = level;
+    emit qualityLevelChanged(level);
+}
+
+void Renderer::updateQualityLevel(double frameTime) {
+    // 指数滑动平均，等级改变后的前几帧只积累平均值
+    mfAverageFrameTime = miFramesAtQualityLevel == 0 ? frameTime :
+                         0.7 * mfAverageFrameTime + 0.3 * frameTime;
+    if(++miFramesAtQualityLevel < kQualitySettleFrames) return;
+
+    // 超出预算时降低画质，低于预算一半时提高画质
+    if(mfAverageFrameTime > mfFrameBudget && miQualityLevel + 1 < QUALITY_LEVEL_COUNT) {
+        setQualityLevel(miQualityLevel + 1);
+    } else if(mfAverageFrameTime < mfFrameBudget * 0.5 && miQualityLevel > 0) {
+        setQualityLevel(miQualityLevel - 1);
+    }
+}
+
+double Renderer::measureFrameTime(int nFrames) {
+    if(!ready() || nFrames <= 0) return 0.0;
+
+    makeCurrent();
+    mbMeasuring = true;
+    // 预热一帧，排除渐变纹理上传等一次性开销
+    paintGL();
+    glFinish();
+
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < nFrames; ++i) {
+        paintGL();
+    }
+    glFinish();
+    double frameTime = timer.nsecsElapsed() / 1e6 / nFrames;
+    mbMeasuring = false;
+    doneCurrent();
+
+    update();
+    return frameTime;
+}
+
 float Renderer::elevationScale() const {
     return mfElevScale;
 }
@@ -292,14 +1054,309 @@ void Renderer::onEnableTextureRender(bool enabled) {
 }
 
 void Renderer::cleanUpBuffers() {
+    deleteMeshBuffers();
+    deleteNormalMap();
+    deleteOrthoTexture();
+    deleteVirtualTexture();
+    for(QOpenGLBuffer& buffer : mUploadBuffers) buffer.destroy();
+}
+
+void Renderer::deleteMeshBuffers() {
     if(mVboIds.size())
         glDeleteBuffers(mVboIds.size(), mVboIds.data());
     if(mEboIds.size())
         glDeleteBuffers(mEboIds.size(), mEboIds.data());
-    if(mpTexture) {
-        delete mpTexture;
-        mpTexture = nullptr;
+    mVboIds.clear();
+    mEboIds.clear();
+    muMeshBytes = 0;
+    muCacheIndexCount = 0;
+}
+
+void Renderer::deleteNormalMap() {
+    if(mNormalTexId) glDeleteTextures(1, &mNormalTexId);
+    mNormalTexId = 0;
+    muNormalCols = muNormalRows = 0;
+    muNormalBytes = 0;
+}
+
+void Renderer::uploadNormalMap(const NormalMap &normals) {
+    deleteNormalMap();
+    if(normals.isEmpty()) return;
+
+    // 超出最大纹理尺寸时按间隔抽取
+    quint64 factor = NormalMap::stepFor(normals.cols, normals.rows, quint64(mMaxTextureSize));
+    NormalMap reduced = factor > 1 ? normals.downsampled(factor) : NormalMap();
+    const NormalMap& map = factor > 1 ? reduced : normals;
+
+    Profiler::Scope scope("normal map upload", "upload");
+    glGenTextures(1, &mNormalTexId);
+    glBindTexture(GL_TEXTURE_2D, mNormalTexId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // 每行 cols * 2 字节
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, mNormalInternalFormat, GLsizei(map.cols), GLsizei(map.rows), 0,
+                 mNormalFormat, GL_UNSIGNED_BYTE, map.texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    muNormalCols = map.cols;
+    muNormalRows = map.rows;
+    muNormalStep = map.step;
+    // 纹素j对应格网点 j * step，在纹素中心取样
+    mNormalMapping = QVector4D(float(muDemCols) / (map.step * map.cols),
+                               float(muDemRows) / (map.step * map.rows),
+                               0.5f / map.cols, 0.5f / map.rows);
+    muNormalBytes = map.texels.size() * 4 / 3;
+}
+
+void Renderer::deleteHeightmap() {
+    if(mHeightmapTexId) glDeleteTextures(1, &mHeightmapTexId);
+    mHeightmapTexId = 0;
+    muHeightmapCols = muHeightmapRows = 0;
+}
+
+void Renderer::deleteOrthoTexture() {
+    if(mOrthoTexId) glDeleteTextures(1, &mOrthoTexId);
+    if(mPendingOrthoTexId) glDeleteTextures(1, &mPendingOrthoTexId);
+    mOrthoTexId = mPendingOrthoTexId = 0;
+    muOrthoTexBytes = 0;
+    mPendingOrtho = QImage();
+}
+
+void Renderer::streamOrthoTexture() {
+    Profiler::Scope scope("texture slice upload", "upload");
+    // 本帧上传的整行数，RGB888扫描行按4字节对齐，与默认的解包对齐一致
+    const QImage& image = mPendingOrtho;
+    int bytesPerLine = int(image.bytesPerLine());
+    int rows = std::clamp(TEXTURE_UPLOAD_BYTES_PER_FRAME / bytesPerLine, 1,
+                          image.height() - miPendingOrthoRow);
+    int bytes = rows * bytesPerLine;
+    const uchar* pSource = image.constScanLine(miPendingOrthoRow);
+
+    glBindTexture(GL_TEXTURE_2D, mPendingOrthoTexId);
+    if(mbPixelBufferSupported) {
+        // 复制到像素缓冲区后立即返回，传输由驱动异步完成
+        QOpenGLBuffer& buffer = mUploadBuffers[miUploadBuffer];
+        miUploadBuffer = (miUploadBuffer + 1) % 2;
+        buffer.bind();
+        buffer.allocate(bytes);
+        void* pMapped = buffer.map(QOpenGLBuffer::WriteOnly);
+        if(pMapped) {
+            memcpy(pMapped, pSource, bytes);
+            buffer.unmap();
+        } else {
+            buffer.write(0, pSource, bytes);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, miPendingOrthoRow, image.width(), rows, GL_RGB,
+                        GL_UNSIGNED_BYTE, nullptr);
+        buffer.release();
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, miPendingOrthoRow, image.width(), rows, GL_RGB,
+                        GL_UNSIGNED_BYTE, pSource);
+    }
+    miPendingOrthoRow += rows;
+
+    if(miPendingOrthoRow == image.height()) {
+        // 上传完成后生成多级渐远纹理并替换之前的纹理
+        glGenerateMipmap(GL_TEXTURE_2D);
+        if(mOrthoTexId) glDeleteTextures(1, &mOrthoTexId);
+        mOrthoTexId = mPendingOrthoTexId;
+        mPendingOrthoTexId = 0;
+        muOrthoTexBytes = quint64(image.width()) * image.height() * 3 * 4 / 3;
+        mPendingOrtho = QImage();
+    } else {
+        update();
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Renderer::deleteVirtualTexture() {
+    if(mAtlasTexId) glDeleteTextures(1, &mAtlasTexId);
+    if(mPageTableTexId) glDeleteTextures(1, &mPageTableTexId);
+    mAtlasTexId = mPageTableTexId = 0;
+    mpVirtualTexture.reset();
+}
+
+void Renderer::updateVirtualTexture() {
+    Profiler::Scope scope("virtual texture update", "upload");
+    if(mLod.isEmpty()) return;
+
+    // 视锥体内的细节层次节点决定所需的页，与提交方式无关
+    TerrainLod::View view = lodView();
+    view.pFrustum = &mFrustum;
+    mLod.select(view, mVirtualTextureNodes);
+
+    const OrthoPyramid& pyramid = mpVirtualTexture->pyramid();
+    double imageWidth = pyramid.width(), imageHeight = pyramid.height();
+    // 影像覆盖整个DEM格网，第0级一个像素在世界坐标系中的边长
+    float texelSize = mfBboxXSpan / imageWidth;
+    quint32 topLevel = pyramid.levelCount() - 1;
+
+    mpVirtualTexture->beginFrame();
+    for(quint32 index : mVirtualTextureNodes) {
+        const TerrainLod::Node& node = mLod.nodes[index];
+
+        // 节点内离相机最近处，一个影像像素在屏幕上约为1像素的层级
+        float pixelsPerUnit = view.pixelScale;
+        if(view.perspective) {
+            QVector3D boxMin, boxMax;
+            mLod.nodeBounds(node, mfElevScale, boxMin, boxMax);
+            QVector3D nearest(std::clamp(view.eye.x(), boxMin.x(), boxMax.x()),
+                              std::clamp(view.eye.y(), boxMin.y(), boxMax.y()),
+                              std::clamp(view.eye.z(), boxMin.z(), boxMax.z()));
+            pixelsPerUnit /= std::max((nearest - view.eye).length(), 1e-6f);
+        }
+        float texelPixels = texelSize * pixelsPerUnit;
+        quint32 level = texelPixels >= 1.0f ? 0 :
+                        std::min(topLevel, quint32(std::log2(1.0f / texelPixels)));
+
+        // 节点格网范围对应的影像范围，与着色器中纹理坐标的计算一致
+        mpVirtualTexture->requestRect(level,
+                                      node.col * imageWidth / muDemCols,
+                                      node.row * imageHeight / muDemRows,
+                                      node.colEnd * imageWidth / muDemCols,
+                                      node.rowEnd * imageHeight / muDemRows);
+    }
+    mpVirtualTexture->endFrame();
+
+    // 上传已解码的页与修改过的页表行
+    std::vector<VirtualTexture::Page> pages;
+    mpVirtualTexture->takeReadyPages(VIRTUAL_PAGES_PER_FRAME, pages);
+    const GLsizei pageSize = OrthoPyramid::PAGE_SIZE;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, mAtlasTexId);
+    for(const VirtualTexture::Page& page : pages) {
+        GLint x = GLint(page.slot % mpVirtualTexture->slotsX()) * pageSize;
+        GLint y = GLint(page.slot / mpVirtualTexture->slotsX()) * pageSize;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, pageSize, pageSize, GL_RGB, GL_UNSIGNED_BYTE,
+                        page.image.constBits());
+    }
+    quint32 rowBegin = 0, rowEnd = 0;
+    if(mpVirtualTexture->takeDirtyTableRows(rowBegin, rowEnd)) {
+        GLsizei cols = GLsizei(mpVirtualTexture->tableCols());
+        glBindTexture(GL_TEXTURE_2D, mPageTableTexId);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(rowBegin), cols, GLsizei(rowEnd - rowBegin),
+                        GL_RGBA, GL_UNSIGNED_BYTE,
+                        mpVirtualTexture->pageTable().data() + quint64(rowBegin) * cols * 4);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // 还有页在路上时继续请求重绘
+    if(mpVirtualTexture->hasPendingPages()) update();
+}
+
+void Renderer::uploadHeightmapRows(const DigitalElevationModel &dem, quint64 row, quint64 col,
+                                   quint64 rows, quint64 cols) {
+    // 按行带转换为浮点数并上传，CPU端只需一个行带的临时缓冲区
+    const quint64 bandRows = std::max<quint64>(1, (1 << 20) / cols);
+    float noData = dem.getNoDataValue();
+    std::vector<GLfloat> band(std::min(rows, bandRows) * cols);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for(quint64 y0 = 0; y0 < rows; y0 += bandRows) {
+        quint64 nRows = std::min(bandRows, rows - y0);
+        GLfloat* pTexel = band.data();
+        for(quint64 y = 0; y < nRows; ++y) {
+            for(quint64 x = 0; x < cols; ++x) {
+                float elev = dem.getElev(row + y0 + y, col + x);
+                *pTexel++ = elev == noData ? HEIGHTMAP_NODATA : elev;
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(col), GLint(row + y0), GLsizei(cols),
+                        GLsizei(nRows), mHeightmapFormat, GL_FLOAT, band.data());
+    }
+}
+
+void Renderer::uploadGradient() {
+    // 在纹素中心处插值渐变
+    std::vector<GLubyte> texels(GRADIENT_LUT_SIZE * 4);
+    for(int i = 0; i < GRADIENT_LUT_SIZE; ++i) {
+        float color[4];
+        Helpers::linearGradient(mGradient, i / (GRADIENT_LUT_SIZE - 1.0f), color);
+        for(int c = 0; c < 4; ++c) {
+            texels[i * 4 + c] = GLubyte(std::clamp(color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, mGradientTexId);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GRADIENT_LUT_SIZE, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mbGradientDirty = false;
+}
+
+void Renderer::setTerrainUniforms(QOpenGLShaderProgram *pProgram) {
+    // 传入MVP矩阵
+    pProgram->setUniformValue("uMatrix", mMvpMatrix);
+    // 传入是否启用纹理，正射影像尚未上传完成时使用渐变
+    bool enableTex = mbRenderTexture && (mOrthoTexId || mpVirtualTexture);
+    pProgram->setUniformValue("uEnableTex", enableTex);
+    // 传入顶点解码参数
+    pProgram->setUniformValue("uGridToWorldScale", mGridToWorldScale);
+    pProgram->setUniformValue("uGridToWorldOffset", mGridToWorldOffset);
+    pProgram->setUniformValue("uGridSize", QVector2D(muDemCols, muDemRows));
+
+    if(enableTex) {
+        pProgram->setUniformValue("uSampler", 0);
+    }
+
+    // 渐变查找纹理绑定到纹理单元1
+    // 纹理坐标 = 高程 * k + b，使渐变两端落在首末纹素中心
+    if(mbGradientDirty) uploadGradient();
+    float elevSpan = mfColorMaxElev - mfColorMinElev;
+    float k = elevSpan > 0.0f ? (GRADIENT_LUT_SIZE - 1.0f) / GRADIENT_LUT_SIZE / elevSpan : 0.0f;
+    float b = 0.5f / GRADIENT_LUT_SIZE - mfColorMinElev * k;
+    pProgram->setUniformValue("uGradient", 1);
+    pProgram->setUniformValue("uGradientMapping", QVector2D(k, b));
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, mGradientTexId);
+
+    // 虚拟纹理：物理页缓存绑定到纹理单元0，页表绑定到纹理单元3
+    bool virtualTex = enableTex && mpVirtualTexture;
+    pProgram->setUniformValue("uVirtualTex", virtualTex);
+    if(virtualTex) {
+        const OrthoPyramid& pyramid = mpVirtualTexture->pyramid();
+        float pageSize = OrthoPyramid::PAGE_SIZE;
+        pProgram->setUniformValue("uPageTable", 3);
+        pProgram->setUniformValue("uImageSize", QVector2D(pyramid.width(), pyramid.height()));
+        pProgram->setUniformValue("uPageTableSize", QVector2D(mpVirtualTexture->tableCols(),
+                                  mpVirtualTexture->tableRows()));
+        pProgram->setUniformValue("uAtlasSize", QVector2D(mpVirtualTexture->slotsX() * pageSize,
+                                  mpVirtualTexture->slotsY() * pageSize));
+        pProgram->setUniformValue("uPageSize", pageSize);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, mPageTableTexId);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, mAtlasTexId);
+    }
+
+    // 高程纹理绑定到纹理单元2，供顶点着色器读取
+    if(pProgram == mHeightmapProgram) {
+        pProgram->setUniformValue("uHeightmap", 2);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, mHeightmapTexId);
+    }
+
+    // 法向纹理绑定到纹理单元4，高程缩放量在着色器中作用于法向，改变缩放量时无需重新计算
+    bool enableHillshade = mbHillshade && mNormalTexId;
+    pProgram->setUniformValue("uHillshade", enableHillshade);
+    if(enableHillshade) {
+        float azimuth = qDegreesToRadians(mfLightAzimuth), altitude = qDegreesToRadians(mfLightAltitude);
+        pProgram->setUniformValue("uNormalMap", 4);
+        pProgram->setUniformValue("uNormalMapRG", mNormalFormat == GL_RG);
+        pProgram->setUniformValue("uNormalMapping", mNormalMapping);
+        pProgram->setUniformValue("uElevScale", mfElevScale);
+        // 世界坐标系X向东，Y向北
+        pProgram->setUniformValue("uLightDir", QVector3D(std::sin(azimuth) * std::cos(altitude),
+                                  std::cos(azimuth) * std::cos(altitude), std::sin(altitude)));
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, mNormalTexId);
     }
+    glActiveTexture(GL_TEXTURE0);
 }
 
 void Renderer::updateMvpMatrix() {
@@ -326,8 +1383,26 @@ void Renderer::updateMvpMatrix() {
     // 右乘视图矩阵
     mMvpMatrix *= mOrbitCameraCtrl.computeViewMatrix();
 
+    // 世界坐标系(高程已缩放)中的视锥体，用于裁剪细节层次节点
+    mFrustum = Frustum::fromMatrix(mMvpMatrix);
+
     // 右乘模型矩阵
     mMvpMatrix.scale(1.0f, 1.0f, mfElevScale);
+
+    emit cameraChanged(mOrbitCameraCtrl.position(), mOrbitCameraCtrl.center());
+}
+
+TerrainLod::View Renderer::lodView() {
+    TerrainLod::View view;
+    view.eye = mOrbitCameraCtrl.position();
+    view.elevScale = mfElevScale;
+    view.perspective = mCurrentProjType == ProjectionType::Perspective;
+    float viewportHeight = height() * devicePixelRatioF();
+    view.pixelScale = view.perspective ?
+                      viewportHeight / (2.0f * std::tan(Helpers::Pi / 6.0f)) :
+                      viewportHeight / (mfBboxMaxEdge * mfOrthoZoom);
+    view.pixelTolerance = mfLodPixelTolerance * kQualityLevels[miQualityLevel].lodToleranceScale;
+    return view;
 }
 
 bool Renderer::ready() {
@@ -392,8 +1467,7 @@ void Renderer::mouseMoveEvent(QMouseEvent *event) {
         mOrbitCameraCtrl.setCenter(mCameraCenterOnMouseDown + centerDeltaVector.toVector3D());
     }
 
-    updateMvpMatrix();
-    update();
+    if(mbLeftDown || mbRightDown) scheduleCameraFrame();
 }
 
 
@@ -410,14 +1484,5 @@ void Renderer::wheelEvent(QWheelEvent *event) {
         if(mfOrthoZoom > 2.0f)mfOrthoZoom = 2.0f;
     }
 
-    updateMvpMatrix();
-    update();
+    scheduleCameraFrame();
 }
-
-
-
-
-
-
-
-
@@ -3,12 +3,22 @@
 
 #include "orbitcontrols.h"
 #include <QKeyEvent>
+#include <QElapsedTimer>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
-#include <QOpenGLTexture>
+#include <QOpenGLTextureBlitter>
 #include <QOpenGLWidget>
+#include <QTimer>
+#include <QVector4D>
 #include "digitalelevationmodel.h"
 #include "helpers.h"
+#include "terrainmesh.h"
+#include "virtualtexture.h"
+#include <memory>
+
+class QOpenGLTimerQuery;
 
 
 class Renderer : public QOpenGLWidget, protected QOpenGLFunctions {
@@ -20,10 +30,44 @@ public:
         Perspective = 0x2,
     };
 
+    /**
+     * 地形提交方式
+     */
+    enum DrawMode {
+        // 所有行拼接为一个条带，一次绘制调用
+        StitchedStrip = 0x1,
+        // 每行一次绘制调用(原方式，用于对比)
+        PerRowStrips = 0x2,
+        // 四叉树细节层次，每个选中节点一次绘制调用
+        QuadtreeLod = 0x4,
+        // 高程纹理位移：按四叉树节点重复绘制同一个格网块，高程在顶点着色器中从纹理读取
+        HeightmapTexture = 0x8,
+        // 打开文件时生成的不规则三角网，一次绘制调用
+        TinTriangles = 0x10,
+        // 全分辨率格网按顶点缓存友好的顺序输出为GL_TRIANGLES，一次绘制调用
+        CacheOptimizedTriangles = 0x20,
+    };
+
     // 和包围盒最短边长度一起用于确定近裁剪面
     const float NEAR_PLANE_SCALE = 0.01f;
     // 和包围盒最长边长度一起用于确定远裁剪面
     const float FAR_PLANE_SCALE = 100.0f;
+    // 渐变查找纹理的纹素数
+    static const int GRADIENT_LUT_SIZE = 256;
+    // 高程纹理中无数据格网点的取值，着色器中以小于-1e38判断
+    static constexpr float HEIGHTMAP_NODATA = -3.0e38f;
+    // 较长边超过该尺寸(或最大纹理尺寸)的正射影像以虚拟纹理显示
+    static const int VIRTUAL_TEXTURE_MIN_SIZE = 8192;
+    // 虚拟纹理物理页缓存纹理的最大边长(像素)
+    static const int VIRTUAL_ATLAS_SIZE = 4096;
+    // 每帧最多上传的影像页数
+    static const int VIRTUAL_PAGES_PER_FRAME = 16;
+    // 正射影像纹理每帧上传的字节数上限(按整行计)
+    static const int TEXTURE_UPLOAD_BYTES_PER_FRAME = 4 * 1024 * 1024;
+    // 超过该时间(ms)没有相机输入即结束交互，恢复完整画质
+    static const int INTERACTION_IDLE_MS = 200;
+    // 画质等级数，0为完整画质
+    static const int QUALITY_LEVEL_COUNT = 4;
 
 public:
     explicit Renderer(QWidget* parent);
@@ -36,13 +80,319 @@ protected:
     void paintGL() override;
 
 public:
-    void setupRenderer(const DigitalElevationModel* pDem, const QImage* pTexture = nullptr,
-                       bool useRandomizedGradient = false);
+    /**
+     * @brief setupRenderer 在GUI线程中生成并上传地形网格
+     *
+     * 当前网格带有不规则三角网时，以相同的误差阈值重新生成。
+     * @param pDem DEM数据
+     */
+    void setupRenderer(const DigitalElevationModel* pDem);
+    /**
+     * @brief uploadTerrainMesh 将已生成的地形网格上传到GPU并开始渲染
+     *
+     * 只做缓冲区上传，需在GUI线程调用；网格可在工作线程中预先生成。正射影像纹理不受影响。
+     * @param mesh 地形网格
+     */
+    void uploadTerrainMesh(const TerrainMesh& mesh);
+
+    /**
+     * @brief hasTerrainMesh 地形网格的顶点与索引缓冲区是否已上传
+     * @return
+     */
+    bool hasTerrainMesh() const;
+
+    /**
+     * @brief hasTin 已上传的网格是否带有不规则三角网
+     * @return
+     */
+    bool hasTin() const;
+
+    /**
+     * @brief uploadCacheOptimizedIndices 生成并上传缓存优化的格网三角形索引
+     *
+     * 索引数为条带的3倍，只在选择该提交方式时上传；按竖条逐段生成与上传，CPU端不保留。
+     * 需先上传地形网格，随网格缓冲区一起释放。
+     */
+    void uploadCacheOptimizedIndices();
+
+    /**
+     * @brief hasCacheOptimizedIndices 缓存优化的格网三角形索引是否已上传
+     * @return
+     */
+    bool hasCacheOptimizedIndices() const;
+
+    /**
+     * @brief releaseTerrainMesh 释放地形网格的顶点与索引缓冲区
+     *
+     * 保留细节层次节点，高程纹理位移方式仍可绘制，其余提交方式需重新上传网格。
+     */
+    void releaseTerrainMesh();
+
+    /**
+     * @brief heightmapTextureSupported 当前上下文是否支持高程纹理位移
+     *
+     * 需要顶点着色器纹理读取与单通道浮点纹理，在initializeGL之后有效。
+     * @return
+     */
+    bool heightmapTextureSupported() const;
+
+    /**
+     * @brief uploadHeightmap 将DEM高程上传为单通道浮点纹理(每个格网点4字节)
+     *
+     * 节点选择复用已上传网格的细节层次节点，需先以同一DEM调用uploadTerrainMesh。
+     * DEM尺寸与已上传网格不符或超出最大纹理尺寸时抛出异常(const char*)。
+     * @param dem DEM数据
+     */
+    void uploadHeightmap(const DigitalElevationModel& dem);
+
+    /**
+     * @brief updateHeightmap 重新上传高程纹理中的一个矩形窗口
+     *
+     * 用于高程被修改后的局部更新，节点的高程范围与误差不随之更新。
+     * 受影响的法向纹素同时重新计算并上传。
+     * @param dem DEM数据，尺寸与已上传的高程纹理相同
+     * @param row 起始行号
+     * @param col 起始列号
+     * @param rows 行数
+     * @param cols 列数
+     */
+    void updateHeightmap(const DigitalElevationModel& dem, quint64 row, quint64 col,
+                         quint64 rows, quint64 cols);
+
+    /**
+     * @brief releaseHeightmap 释放高程纹理
+     */
+    void releaseHeightmap();
+
+    /**
+     * @brief hasHeightmap 高程纹理是否已上传
+     * @return
+     */
+    bool hasHeightmap() const;
+
+    /**
+     * @brief maxTextureSize 获取最大纹理尺寸，在initializeGL之后有效
+     * @return 像素
+     */
+    int maxTextureSize() const;
+
+    /**
+     * @brief setOrthoTexture 设置正射影像纹理，影像覆盖整个DEM格网
+     *
+     * 只分配纹理存储，像素在之后的各帧中经像素缓冲区对象分片上传，
+     * 每帧不超过 TEXTURE_UPLOAD_BYTES_PER_FRAME；上传完成前继续显示之前的纹理。
+     * 影像超出最大纹理尺寸时抛出异常(const char*)。
+     * @param image RGB888图像，第0行为影像上边界
+     */
+    void setOrthoTexture(QImage image);
+
+    /**
+     * @brief releaseOrthoTexture 释放正射影像纹理(包括虚拟纹理与未完成的上传)
+     */
+    void releaseOrthoTexture();
+
+    /**
+     * @brief hasOrthoTexture 是否有正射影像纹理(包括虚拟纹理与正在上传的纹理)
+     * @return
+     */
+    bool hasOrthoTexture() const;
+
+    /**
+     * @brief hasPendingTextureUploads 正射影像纹理或虚拟纹理是否还有待上传的数据
+     *
+     * 无界面渲染时据此决定还需绘制多少帧，画面才包含完整的影像。
+     * @return
+     */
+    bool hasPendingTextureUploads() const;
+
+    /**
+     * @brief setVirtualTexture 以虚拟纹理显示页金字塔中的正射影像
+     *
+     * 影像覆盖整个DEM格网。按可见的细节层次节点请求页，每帧上传有限数量的页到固定大小的物理页缓存，
+     * 显存占用与影像尺寸无关。替换之前的正射影像纹理并启用纹理显示；
+     * 页表超出最大纹理尺寸时抛出异常(const char*)。
+     * @param pyramid 页金字塔
+     */
+    void setVirtualTexture(OrthoPyramid pyramid);
+
+    /**
+     * @brief hasVirtualTexture 是否以虚拟纹理显示正射影像
+     * @return
+     */
+    bool hasVirtualTexture() const;
+
+    /**
+     * @brief virtualTextureStats 获取虚拟纹理的驻留统计，没有虚拟纹理时全为0
+     * @return
+     */
+    VirtualTexture::Stats virtualTextureStats() const;
+
+    /**
+     * @brief gpuMemoryBytes 获取地形网格缓冲区、高程纹理与正射影像纹理占用的显存
+     * @return 字节数
+     */
+    quint64 gpuMemoryBytes() const;
+
+    const std::vector<Helpers::ColorStop>& defaultGradient() const;
+
+    /**
+     * @brief setGradient 设置高程渐变
+     *
+     * 渐变以查找纹理的形式在下一帧上传，着色器按归一化高程取色，不重新生成网格。
+     * @param gradient 颜色转折点列表，按位置百分比排序
+     */
+    void setGradient(const std::vector<Helpers::ColorStop>& gradient);
+
+    /**
+     * @brief setColorRange 设置渐变拉伸所对应的高程范围
+     *
+     * 上传网格时重置为DEM的有效高程范围。
+     * @param minElev 渐变起点高程
+     * @param maxElev 渐变终点高程
+     */
+    void setColorRange(float minElev, float maxElev);
     void switchProjectionType(Renderer::ProjectionType type);
 
+    /**
+     * @brief cameraControls 获取当前相机
+     * @return
+     */
+    const OrbitControls& cameraControls() const;
+
+    /**
+     * @brief setCameraControls 设置相机并重绘
+     * @param controls 相机
+     */
+    void setCameraControls(const OrbitControls& controls);
+
+    DrawMode drawMode() const;
+    void setDrawMode(Renderer::DrawMode mode);
+
+    /**
+     * @brief frustumCulling 是否对细节层次节点做视锥体裁剪
+     * @return
+     */
+    bool frustumCulling() const;
+    void setFrustumCulling(bool enabled);
+
+    /**
+     * @brief hillshade 是否以地表法向做山体阴影光照
+     * @return
+     */
+    bool hillshade() const;
+    void setHillshade(bool enabled);
+
+    /**
+     * @brief hasNormalMap 地表法向纹理是否已上传
+     * @return
+     */
+    bool hasNormalMap() const;
+    /**
+     * @brief setNormalMap 替换地表法向纹理，用于网格生成时未计算法向、之后打开山体阴影的情形
+     *
+     * 法向纹理不随网格缓冲区释放，高程纹理位移方式下同样可以上传。
+     * @param normals 由当前DEM计算的法向
+     */
+    void setNormalMap(const NormalMap& normals);
+
+    /**
+     * @brief lightAzimuth 获取光源方位角(度，自北顺时针)
+     * @return
+     */
+    float lightAzimuth() const;
+    /**
+     * @brief lightAltitude 获取光源高度角(度)
+     * @return
+     */
+    float lightAltitude() const;
+    /**
+     * @brief setLightDirection 设置山体阴影的光源方向
+     * @param azimuth 方位角(度，自北顺时针)
+     * @param altitude 高度角(度)
+     */
+    void setLightDirection(float azimuth, float altitude);
+
+    /**
+     * @brief frameStats 获取上一帧绘制与裁剪的节点数和三角形数
+     *
+     * 全分辨率提交方式下，节点数为绘制调用数，不做裁剪。
+     * @return
+     */
+    const TerrainLod::SelectStats& frameStats() const;
+
+    /**
+     * @brief lodPixelTolerance 获取细节层次的屏幕空间误差容限
+     * @return 容限(像素)
+     */
+    float lodPixelTolerance() const;
+    void setLodPixelTolerance(float pixels);
+
+    /**
+     * @brief measureFrameTime 测量当前视角下的平均帧时间
+     *
+     * 连续绘制若干帧并等待GPU完成，包含CPU提交与GPU执行时间。
+     * 测量帧不叠加性能信息，也不发出frameRendered。
+     * @param nFrames 帧数
+     * @return 平均帧时间(ms)，尚未载入DEM时为0
+     */
+    double measureFrameTime(int nFrames);
+
+    /**
+     * @brief frameBudget 获取交互(相机移动)时的帧时间预算
+     * @return 预算(ms)
+     */
+    float frameBudget() const;
+
+    /**
+     * @brief setFrameBudget 设置交互时的帧时间预算，平均帧时间超出预算时逐级降低画质
+     * @param milliseconds 预算(ms)
+     */
+    void setFrameBudget(float milliseconds);
+
+    /**
+     * @brief qualityLevel 获取当前画质等级
+     *
+     * 0为完整画质；1起关闭多重采样并放宽细节层次误差容限，2起再降低渲染分辨率。
+     * 只在交互时降低，交互结束后恢复为0。
+     * @return 等级(0 ~ QUALITY_LEVEL_COUNT - 1)
+     */
+    int qualityLevel() const;
+
+    /**
+     * @brief profilerOverlay 是否在视图左上角显示帧间隔、CPU/GPU耗时、绘制调用数与三角形数
+     * @return
+     */
+    bool profilerOverlay() const;
+    void setProfilerOverlay(bool enabled);
+
+    /**
+     * @brief lastGpuFrameTime 获取最近一次取回的绘制提交GPU耗时(计时查询)
+     * @return 耗时(ms)，不支持计时查询或尚无结果时为负
+     */
+    double lastGpuFrameTime() const;
+
     float elevationScale()const;
     void setElevationScale(float newScale);
 
+signals:
+    /**
+     * @brief cameraChanged 相机位置或姿态变化
+     * @param eye 相机位置(世界坐标系)
+     * @param center 相机注视点(世界坐标系)
+     */
+    void cameraChanged(QVector3D eye, QVector3D center);
+
+    /**
+     * @brief frameRendered 一帧绘制完成，可读取frameStats()
+     */
+    void frameRendered();
+
+    /**
+     * @brief qualityLevelChanged 画质等级变化
+     * @param level 新的等级
+     */
+    void qualityLevelChanged(int level);
+
 public slots:
     void onResetCameraControl();
     void onSetAutoFitElevation();
@@ -50,13 +400,47 @@ public slots:
 
 private:
     void cleanUpBuffers();
+    void deleteMeshBuffers();
+    void deleteHeightmap();
+    void deleteNormalMap();
+    void uploadNormalMap(const NormalMap& normals);
+    void deleteOrthoTexture();
+    void deleteVirtualTexture();
+    void streamOrthoTexture();
+    void updateVirtualTexture();
+    void uploadHeightmapRows(const DigitalElevationModel& dem, quint64 row, quint64 col,
+                             quint64 rows, quint64 cols);
+    void uploadGradient();
+    void setTerrainUniforms(QOpenGLShaderProgram* pProgram);
     void updateMvpMatrix();
+    void scheduleCameraFrame();
+    void setQualityLevel(int level);
+    void updateQualityLevel(double frameTime);
+    bool bindReducedFramebuffer();
+    void drawReducedFramebuffer();
+    void beginGpuTiming();
+    void endGpuTiming();
+    void collectGpuTimings();
+    void drawProfilerOverlay(double cpuFrameTime);
+    TerrainLod::View lodView();
     bool ready();
 
 private:
     QOpenGLShaderProgram* mProgram = nullptr;
+    // 高程纹理位移方式的着色器程序，不支持时为空
+    QOpenGLShaderProgram* mHeightmapProgram = nullptr;
     // 当前投影类型
     ProjectionType mCurrentProjType = ProjectionType::Perspective;
+    // 地形提交方式
+    DrawMode mDrawMode = DrawMode::QuadtreeLod;
+    // 细节层次的屏幕空间误差容限(像素)
+    float mfLodPixelTolerance{2.0f};
+    // 是否做视锥体裁剪
+    bool mbFrustumCulling{true};
+    // 世界坐标系中的视锥体，随MVP矩阵更新
+    Frustum mFrustum{};
+    // 上一帧的绘制统计
+    TerrainLod::SelectStats mFrameStats{0, 0, 0, 0};
     // 正射缩放倍率
     float mfOrthoZoom{1.0};
     // 模型视图投影变换矩阵
@@ -80,6 +464,9 @@ private:
     float mfBboxMinEdge{};   // DEM包围盒最小边
     float mfBboxMaxEdge{};   // DEM包围盒最大边
     float mfBboxDiagonal{}; // DEM包围盒斜对角线
+    // 顶点格网坐标与高程编码到世界坐标的映射(见TerrainMesh)
+    QVector3D mGridToWorldScale{};
+    QVector3D mGridToWorldOffset{};
 
 
     // VAO在低版本OpenGL ES不支持，这里不使用
@@ -87,21 +474,116 @@ private:
     std::vector<GLuint> mVboIds{};
     // EBOs
     std::vector<GLuint> mEboIds{};
-    // 纹理图像
-    QOpenGLTexture* mpTexture{nullptr};
-
-    // attribute变量aPosition
-    GLint mPositionAttr{-1};
-    // attribute变量aColor
-    GLint mColorAttr{-1};
-    // attribute变量aTexCoord
-    GLint mTexCoordAttr{-1};
-    // uniform变量uMatrix
-    GLint mMatrixUnif{-1};
-    // uniform变量uEnableTexture
-    GLint mEnableTexUnif{-1};
-    // uniform变量uSampler
-    GLint mSamplerUnif{-1};
+    // 索引总数
+    quint64 muIndexCount{};
+    // 地形网格缓冲区占用的显存
+    quint64 muMeshBytes{};
+    // 不规则三角网的索引数(在mEboIds[2]中)与生成时的误差阈值
+    quint64 muTinIndexCount{};
+    float mfTinMaxError{};
+    // 缓存优化的格网三角形索引数(在mEboIds[3]中)，未上传时为0
+    quint64 muCacheIndexCount{};
+    // 四叉树细节层次节点(索引已上传到mEboIds[1]，CPU端不保留)
+    TerrainLod mLod{};
+    // 本帧选中的节点
+    std::vector<quint32> mLodSelection{};
+    // 正射影像纹理(RGB，多级渐远)
+    GLuint mOrthoTexId{0};
+    quint64 muOrthoTexBytes{0};
+    // 正在分片上传的影像及其纹理，上传完成后替换mOrthoTexId
+    QImage mPendingOrtho{};
+    GLuint mPendingOrthoTexId{0};
+    int miPendingOrthoRow{0};
+    // 像素缓冲区对象，相邻两帧轮流使用，映射时不必等待上一片的传输
+    QOpenGLBuffer mUploadBuffers[2]{QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer),
+                                    QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer)};
+    int miUploadBuffer{0};
+    // 上下文支持像素缓冲区对象，不支持时直接由内存分片上传
+    bool mbPixelBufferSupported{false};
+
+    // 相机输入合并：一个显示刷新间隔内最多绘制一帧
+    QTimer mFrameTimer{};
+    QElapsedTimer mLastFrameTimer{};
+    // 交互中(相机在移动)，停止输入INTERACTION_IDLE_MS后结束
+    QTimer mInteractionTimer{};
+    bool mbInteracting{false};
+    // 交互时的帧时间预算(ms)、画质等级与该等级下的平均帧时间
+    float mfFrameBudget{1000.0f / 60.0f};
+    int miQualityLevel{0};
+    int miFramesAtQualityLevel{0};
+    double mfAverageFrameTime{0.0};
+    // 降低画质时的离屏渲染目标(无多重采样)，绘制完成后缩放到窗口
+    QOpenGLFramebufferObject* mpReducedFbo{nullptr};
+    QOpenGLTextureBlitter mTextureBlitter{};
+
+    // GPU计时查询，轮流使用，结果在之后的帧中取回；不支持时为空
+    std::vector<QOpenGLTimerQuery*> mGpuQueries{};
+    // 各查询开始时的CPU时间(ns)，空闲时为-1
+    std::vector<qint64> mGpuQueryStarts{};
+    int miGpuQuery{0};
+    bool mbGpuTiming{false};
+    double mfGpuFrameTime{-1.0};
+    // 两次绘制开始之间的时间(ms)
+    double mfFrameInterval{0.0};
+    bool mbProfilerOverlay{false};
+    // measureFrameTime在绘制事件之外直接调用paintGL，期间不叠加性能信息、不发出frameRendered
+    bool mbMeasuring{false};
+    // 渐变查找纹理(GRADIENT_LUT_SIZE x 1)
+    GLuint mGradientTexId{0};
+    // 渐变已修改、尚未上传
+    bool mbGradientDirty{true};
+    // 渐变拉伸的高程范围
+    float mfColorMinElev{};
+    float mfColorMaxElev{};
+
+    // 最大纹理尺寸
+    GLint mMaxTextureSize{0};
+    // 虚拟纹理(超大正射影像)，为空时使用mOrthoTexId
+    std::unique_ptr<VirtualTexture> mpVirtualTexture{};
+    // 物理页缓存纹理(RGB)与页表纹理(RGBA，最近邻)
+    GLuint mAtlasTexId{0};
+    GLuint mPageTableTexId{0};
+    // 本帧用于请求影像页的节点
+    std::vector<quint32> mVirtualTextureNodes{};
+
+    // 上下文支持高程纹理位移
+    bool mbHeightmapSupported{false};
+    // 高程纹理的内部格式与像素格式
+    GLint mHeightmapInternalFormat{0};
+    GLenum mHeightmapFormat{0};
+    // 高程纹理(列数 x 行数，单通道浮点)
+    GLuint mHeightmapTexId{0};
+    quint64 muHeightmapCols{};
+    quint64 muHeightmapRows{};
+    // 法向纹理的内部格式与像素格式(双通道8位)
+    GLint mNormalInternalFormat{0};
+    GLenum mNormalFormat{0};
+    // 法向纹理及其取样间隔，纹理坐标 = 格网纹理坐标 * xy + zw
+    GLuint mNormalTexId{0};
+    quint64 muNormalCols{};
+    quint64 muNormalRows{};
+    quint64 muNormalStep{1};
+    QVector4D mNormalMapping{};
+    // 法向纹理(含多级渐远)占用的显存，与网格缓冲区分开释放
+    quint64 muNormalBytes{};
+    // 山体阴影光照及光源方向(度)
+    bool mbHillshade{true};
+    float mfLightAzimuth{315.0f};
+    float mfLightAltitude{45.0f};
+    // 格网块的顶点与条带索引缓冲区
+    GLuint mPatchVboId{0};
+    GLuint mPatchEboId{0};
+    GLsizei mPatchIndexCount{0};
+
+    // attribute变量aPosition，两个着色器程序中绑定到同一位置
+    const GLuint mPositionAttr{0};
+    // 网格程序的uniform变量uSkirtBase
+    GLint mSkirtBaseUnif{-1};
+    // 高程纹理位移程序的uniform变量uPatchOrigin、uPatchStep、uPatchEnd、uSkirtBase
+    GLint mPatchOriginUnif{-1};
+    GLint mPatchStepUnif{-1};
+    GLint mPatchEndUnif{-1};
+    GLint mPatchSkirtBaseUnif{-1};
 
     // 线性渐变插值转折点
     const std::vector<Helpers::ColorStop> mDefaultGradient{
@@ -109,6 +591,8 @@ private:
         Helpers::ColorStop(0.18f, 123, 227, 62, 1.0f),
         Helpers::ColorStop(1.0f, 253, 95, 10, 1.0f),
     };
+    // 当前渐变
+    std::vector<Helpers::ColorStop> mGradient{mDefaultGradient};
 
     // 鼠标状态
     bool mbLeftDown{false};    // 左键按下
@@ -0,0 +1,181 @@
+#include "syntheticdem.h"
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// 少于该行数时串行计算，避免创建线程的开销
+const quint64 kMinParallelRows = 64;
+
+// 无数据值，生成的DEM中不出现
+const float kNoData = -9999.0f;
+
+/**
+ * @brief hashNoise 种子与格网点坐标的整数散列
+ * @return [-1, 1)内的伪随机数
+ */
+inline float hashNoise(quint32 seed, quint64 row, quint64 col) {
+    quint64 h = (quint64(seed) << 32) ^ (row * 0x9E3779B97F4A7C15ull) ^ (col * 0xC2B2AE3D27D4EB4Full);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return float(h >> 40) / float(1 << 23) - 1.0f;
+}
+
+/**
+ * @brief forEachRow 在多个线程中对 0 ~ count-1 调用function，各线程交错处理
+ */
+template<typename Function>
+void forEachRow(quint64 count, const Function& function) {
+    unsigned nThreads = count < kMinParallelRows ? 1u :
+                        std::max(1u, std::min<unsigned>(DigitalElevationModel::loaderThreadCount(),
+                                 unsigned(count)));
+    auto work = [&](unsigned thread) {
+        for(quint64 i = thread; i < count; i += nThreads) function(i);
+    };
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for(auto& worker : workers) worker.join();
+}
+
+/**
+ * @brief diamondSquare 中点位移
+ *
+ * 在边长 n = 2^k + 1 的格网上逐级细分：菱形步为每个正方形中心赋值，正方形步为每条边的中点赋值，
+ * 同一步内各点只读取上一步的结果，可按行并行。完成后原地裁剪为 size * size。
+ */
+std::vector<float> diamondSquare(const SyntheticDem::Params& params) {
+    quint64 n = 2;
+    while(n + 1 < params.size) n *= 2;
+    n += 1;
+
+    std::vector<float> grid(n * n);
+    float amp = params.relief;
+    for(quint64 r : {quint64(0), n - 1}) {
+        for(quint64 c : {quint64(0), n - 1}) {
+            grid[r * n + c] = amp * hashNoise(params.seed, r, c);
+        }
+    }
+
+    for(quint64 step = n - 1; step > 1; step /= 2) {
+        const quint64 half = step / 2;
+        amp *= params.roughness;
+
+        // 菱形步：正方形中心 = 四角平均 + 扰动
+        forEachRow((n - 1) / step, [&](quint64 i) {
+            quint64 r = half + i * step;
+            float* pUp = &grid[(r - half) * n];
+            float* pDown = &grid[(r + half) * n];
+            for(quint64 c = half; c < n; c += step) {
+                float average = (pUp[c - half] + pUp[c + half] + pDown[c - half] + pDown[c + half]) * 0.25f;
+                grid[r * n + c] = average + amp * hashNoise(params.seed, r, c);
+            }
+        });
+
+        // 正方形步：边中点 = 上下左右(边界上只有3个)平均 + 扰动
+        forEachRow((n - 1) / half + 1, [&](quint64 i) {
+            quint64 r = i * half;
+            for(quint64 c = (i % 2 == 0) ? half : 0; c < n; c += step) {
+                float sum = 0.0f;
+                int count = 0;
+                if(r >= half) sum += grid[(r - half) * n + c], ++count;
+                if(r + half < n) sum += grid[(r + half) * n + c], ++count;
+                if(c >= half) sum += grid[r * n + c - half], ++count;
+                if(c + half < n) sum += grid[r * n + c + half], ++count;
+                grid[r * n + c] = sum / count + amp * hashNoise(params.seed, r, c);
+            }
+        });
+    }
+
+    // 逐行前移，目标位置不超过源位置
+    for(quint64 r = 0; r < params.size; ++r) {
+        float* pRow = &grid[r * params.size];
+        std::memmove(pRow, &grid[r * n], params.size * sizeof(float));
+        for(quint64 c = 0; c < params.size; ++c) pRow[c] += params.baseElev;
+    }
+    grid.resize(params.size * params.size);
+    return grid;
+}
+
+/**
+ * @brief valueNoise 格点散列值的平滑插值
+ * @param x 列方向坐标(格点单位，非负)
+ * @param y 行方向坐标(格点单位，非负)
+ */
+inline float valueNoise(quint32 seed, float x, float y) {
+    quint64 x0 = quint64(x), y0 = quint64(y);
+    float fx = x - x0, fy = y - y0;
+    fx = fx * fx * (3.0f - 2.0f * fx);
+    fy = fy * fy * (3.0f - 2.0f * fy);
+    float top = hashNoise(seed, y0, x0) + fx * (hashNoise(seed, y0, x0 + 1) - hashNoise(seed, y0, x0));
+    float bottom = hashNoise(seed, y0 + 1, x0) + fx * (hashNoise(seed, y0 + 1, x0 + 1) -
+                   hashNoise(seed, y0 + 1, x0));
+    return top + fy * (bottom - top);
+}
+
+/**
+ * @brief fractalBrownian 分形布朗运动，最低倍频的波长为格网边长的一半，之后逐级减半
+ */
+std::vector<float> fractalBrownian(const SyntheticDem::Params& params) {
+    std::vector<float> grid(params.size * params.size);
+    forEachRow(params.size, [&](quint64 r) {
+        float* pRow = &grid[r * params.size];
+        for(quint64 c = 0; c < params.size; ++c) {
+            float sum = 0.0f;
+            float amp = params.relief;
+            float frequency = 2.0f / std::max<quint64>(params.size, 2);
+            for(quint32 octave = 0; octave < params.octaves && frequency <= 1.0f; ++octave) {
+                sum += amp * valueNoise(params.seed + octave, c * frequency, r * frequency);
+                amp *= params.roughness;
+                frequency *= 2.0f;
+            }
+            pRow[c] = params.baseElev + sum;
+        }
+    });
+    return grid;
+}
+
+}
+
+DigitalElevationModel SyntheticDem::generate(Generator generator, const Params &params) {
+    if(params.size < 2) throw "Synthetic DEM size must be at least 2.";
+    std::vector<float> data = generator == DiamondSquare ? diamondSquare(params) : fractalBrownian(params);
+    return DigitalElevationModel(params.size, params.size, 0.0f, 0.0f, params.cellSize, kNoData,
+                                 std::move(data));
+}
+
+QString SyntheticDem::generatorName(Generator generator) {
+    return generator == DiamondSquare ? "diamond-square" : "fbm";
+}
+
+void SyntheticDem::saveToText(const DigitalElevationModel &dem, QString path) {
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) throw "Failed to open the DEM text file.";
+
+    QByteArray header = QString("ncols %1\nnrows %2\nxllcorner %3\nyllcorner %4\ncellsize %5\nNODATA_value %6\n")
+                        .arg(dem.getCols()).arg(dem.getRows()).arg(dem.getLowerLeftX())
+                        .arg(dem.getLowerLeftY()).arg(dem.getCellSize()).arg(dem.getNoDataValue()).toLatin1();
+    bool ok = file.write(header) == header.size();
+
+    // 逐行格式化后写入
+    QByteArray line;
+    for(quint64 row = 0; ok && row < dem.getRows(); ++row) {
+        line.clear();
+        for(quint64 col = 0; col < dem.getCols(); ++col) {
+            if(col) line.append(' ');
+            line.append(QByteArray::number(dem.getElev(row, col), 'f', 2));
+        }
+        line.append('\n');
+        ok = file.write(line) == line.size();
+    }
+    if(!ok) throw "Failed to write the DEM text file.";
+}
@@ -0,0 +1,65 @@
+#ifndef SYNTHETICDEM_H
+#define SYNTHETICDEM_H
+
+#include <QString>
+#include "digitalelevationmodel.h"
+
+/**
+ * @brief The SyntheticDem struct
+ *
+ * 分形地形生成，用于性能测试与无真实数据时的调试。
+ * 随机扰动由种子与格网点坐标散列得到，与生成顺序及线程数无关，同一参数总是得到相同的DEM。
+ */
+struct SyntheticDem {
+    /**
+     * 生成算法
+     */
+    enum Generator {
+        // 中点位移(菱形-正方形)，在 2^k + 1 的格网上生成后裁剪
+        DiamondSquare = 0,
+        // 分形布朗运动，值噪声逐倍频叠加
+        FractalBrownian = 1,
+    };
+
+    /**
+     * @brief The Params struct 生成参数
+     */
+    struct Params {
+        // 格网行列数
+        quint64 size = 1024;
+        quint32 seed = 1;
+        // 每提高一级(倍频)扰动幅度的缩放量，越大越崎岖
+        float roughness = 0.55f;
+        // 高程起伏幅度(m)，高程大致分布在 baseElev ± relief
+        float relief = 1000.0f;
+        float baseElev = 1500.0f;
+        // 格网尺寸(m)
+        float cellSize = 30.0f;
+        // 分形布朗运动的倍频数
+        quint32 octaves = 8;
+    };
+
+    /**
+     * @brief generate 生成DEM，各行在多个线程中计算
+     * @param generator 生成算法
+     * @param params 生成参数
+     * @return DEM，左下角位于原点，没有无数据格网点
+     */
+    static DigitalElevationModel generate(Generator generator, const Params& params);
+
+    /**
+     * @brief generatorName 获取生成算法的名称
+     * @param generator 生成算法
+     * @return "diamond-square"或"fbm"
+     */
+    static QString generatorName(Generator generator);
+
+    /**
+     * @brief saveToText 将DEM写为ESRI ASCII Grid文件，写入失败时抛出异常(const char*)
+     * @param dem DEM数据
+     * @param path 文件路径
+     */
+    static void saveToText(const DigitalElevationModel& dem, QString path);
+};
+
+#endif // SYNTHETICDEM_H
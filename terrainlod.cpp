@@ -0,0 +1,364 @@
+#include "terrainlod.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+/**
+ * @brief The SkirtLayout struct 裙边顶点编号
+ *
+ * 所有节点的边界都落在行号(列号)为 PATCH_SIZE 整数倍或最后一行(列)的格网线上，
+ * 在这些格网线上为每个格网点各复制一个裙边顶点。
+ */
+struct SkirtLayout {
+    quint64 cols;
+    quint64 rows;
+    quint64 base;
+    quint64 nRowLines;
+    quint64 nColLines;
+
+    SkirtLayout(quint64 cols, quint64 rows, quint64 base): cols(cols), rows(rows), base(base) {
+        const quint64 size = TerrainLod::PATCH_SIZE;
+        nRowLines = (rows - 1) / size + 1 + ((rows - 1) % size ? 1 : 0);
+        nColLines = (cols - 1) / size + 1 + ((cols - 1) % size ? 1 : 0);
+    }
+
+    quint64 rowLine(quint64 row) const {
+        return row % TerrainLod::PATCH_SIZE == 0 ? row / TerrainLod::PATCH_SIZE : nRowLines - 1;
+    }
+
+    quint64 colLine(quint64 col) const {
+        return col % TerrainLod::PATCH_SIZE == 0 ? col / TerrainLod::PATCH_SIZE : nColLines - 1;
+    }
+
+    // 节点上下边界(行格网线)上的裙边顶点
+    quint32 onRowLine(quint64 row, quint64 col) const {
+        return quint32(base + rowLine(row) * cols + col);
+    }
+
+    // 节点左右边界(列格网线)上的裙边顶点
+    quint32 onColLine(quint64 row, quint64 col) const {
+        return quint32(base + nRowLines * cols + colLine(col) * rows + row);
+    }
+
+    quint64 count() const {
+        return nRowLines * cols + nColLines * rows;
+    }
+};
+
+/**
+ * @brief samplePositions 计算节点在一个方向上的取样格网号
+ * @param begin 起始格网号
+ * @param end 末格网号(含)
+ * @param step 取样间隔
+ * @param samples 输出的取样格网号
+ */
+void samplePositions(quint64 begin, quint64 end, quint64 step, std::vector<quint64>& samples) {
+    samples.clear();
+    for(quint64 i = begin; i < end; i += step) samples.push_back(i);
+    samples.push_back(end);
+}
+
+/**
+ * @brief emitNodeStrip 生成节点的三角形条带索引
+ *
+ * 格网行条带与四条裙边条带之间以退化三角形拼接，不开启背面剔除，绕序无需一致。
+ * 三角形对角线与全分辨率网格相同，为(行, 列)到(行 + 1, 列 + 1)。
+ * @param output 接收索引的函数
+ */
+template<class Output>
+void emitNodeStrip(const TerrainLod::Node& node, quint64 cols, const SkirtLayout& skirts,
+                   std::vector<quint64>& xs, std::vector<quint64>& ys, Output output) {
+    quint64 step = quint64(1) << node.level;
+    samplePositions(node.col, node.colEnd, step, xs);
+    samplePositions(node.row, node.rowEnd, step, ys);
+
+    bool first = true;
+    quint32 last = 0;
+    bool pendingJoin = false;
+    auto put = [&](quint32 index) {
+        if(pendingJoin) {
+            output(index);
+            pendingJoin = false;
+        }
+        output(index);
+        last = index;
+        first = false;
+    };
+    auto beginStrip = [&]() {
+        if(!first) {
+            output(last);
+            pendingJoin = true;
+        }
+    };
+    auto vertex = [&](quint64 row, quint64 col) {
+        return quint32(row * cols + col);
+    };
+
+    // 格网
+    for(quint64 j = 0; j + 1 < ys.size(); ++j) {
+        beginStrip();
+        for(quint64 col : xs) {
+            put(vertex(ys[j + 1], col));
+            put(vertex(ys[j], col));
+        }
+    }
+
+    // 裙边
+    const quint64 edgeRows[] = {ys.front(), ys.back()};
+    for(quint64 row : edgeRows) {
+        beginStrip();
+        for(quint64 col : xs) {
+            put(skirts.onRowLine(row, col));
+            put(vertex(row, col));
+        }
+    }
+    const quint64 edgeCols[] = {xs.front(), xs.back()};
+    for(quint64 col : edgeCols) {
+        beginStrip();
+        for(quint64 row : ys) {
+            put(skirts.onColLine(row, col));
+            put(vertex(row, col));
+        }
+    }
+}
+
+/**
+ * @brief nodeGeometricError 计算节点以本层取样代替全分辨率格网的最大高程误差
+ *
+ * 取样格网的每个单元按与网格相同的对角线分为两个三角形，
+ * 在三角形上线性插值全分辨率格网点的高程并与原高程比较。无数据格网点不参与比较。
+ */
+float nodeGeometricError(const DigitalElevationModel& dem, const TerrainLod::Node& node,
+                         std::vector<quint64>& xs, std::vector<quint64>& ys) {
+    if(node.level == 0 || !node.hasData()) return 0.0f;
+
+    quint64 step = quint64(1) << node.level;
+    samplePositions(node.col, node.colEnd, step, xs);
+    samplePositions(node.row, node.rowEnd, step, ys);
+    float noData = dem.getNoDataValue();
+    float maxError = 0.0f;
+
+    for(quint64 j = 0; j + 1 < ys.size(); ++j) {
+        quint64 row0 = ys[j], row1 = ys[j + 1];
+        for(quint64 i = 0; i + 1 < xs.size(); ++i) {
+            quint64 col0 = xs[i], col1 = xs[i + 1];
+            float t0 = dem.getElev(row0, col0), t1 = dem.getElev(row0, col1);
+            float b0 = dem.getElev(row1, col0), b1 = dem.getElev(row1, col1);
+            if(t0 == noData || t1 == noData || b0 == noData || b1 == noData) continue;
+
+            for(quint64 row = row0; row <= row1; ++row) {
+                float v = float(row - row0) / (row1 - row0);
+                for(quint64 col = col0; col <= col1; ++col) {
+                    float elev = dem.getElev(row, col);
+                    if(elev == noData) continue;
+                    float u = float(col - col0) / (col1 - col0);
+                    float interp = u >= v ? t0 + u * (t1 - t0) + v * (b1 - t1)
+                                   : t0 + v * (b0 - t0) + u * (b1 - b0);
+                    maxError = std::max(maxError, std::abs(interp - elev));
+                }
+            }
+        }
+    }
+    return maxError;
+}
+
+}
+
+quint64 TerrainLod::skirtVertexCount(quint64 cols, quint64 rows) {
+    if(cols < 2 || rows < 2) return 0;
+    return SkirtLayout(cols, rows, 0).count();
+}
+
+TerrainLod TerrainLod::build(const DigitalElevationModel &dem, quint64 skirtVertexBase,
+                             const DigitalElevationModel::ProgressCallback &progress) {
+    TerrainLod lod;
+    quint64 cols = dem.getCols(), rows = dem.getRows();
+    if(cols < 2 || rows < 2) return lod;
+
+    QVector3D origin = dem.getGeoCoord(0, 0);
+    lod.originX = origin.y();
+    lod.originY = origin.x();
+    lod.cellSize = dem.getCellSize();
+
+    // 根节点覆盖整个格网
+    quint32 rootLevel = 0;
+    while((PATCH_SIZE << rootLevel) < std::max(cols, rows) - 1) ++rootLevel;
+
+    // 按层序生成节点，子节点连续存放
+    std::vector<Node>& nodes = lod.nodes;
+    nodes.push_back(Node{rootLevel, 0, 0, cols - 1, rows - 1, 0, 0, 0, 0, 0, 0, 0, 0});
+    for(quint64 i = 0; i < nodes.size(); ++i) {
+        if(nodes[i].level == 0) continue;
+        quint32 level = nodes[i].level - 1;
+        quint64 span = PATCH_SIZE << level;
+        nodes[i].firstChild = nodes.size();
+        for(quint64 k = 0; k < 4; ++k) {
+            quint64 col = nodes[i].col + (k % 2) * span, row = nodes[i].row + (k / 2) * span;
+            if(col >= cols - 1 || row >= rows - 1) continue;
+            nodes.push_back(Node{level, col, row, std::min(cols - 1, col + span),
+                                 std::min(rows - 1, row + span), 0, 0, 0, 0, 0, 0, 0, 0});
+            ++nodes[i].childCount;
+        }
+    }
+
+    SkirtLayout skirts(cols, rows, skirtVertexBase);
+
+    // 并行计算节点高程范围、误差与索引数量
+    std::atomic<quint64> nextNode{0};
+    std::atomic<quint64> nodesDone{0};
+    std::atomic_bool cancelled{false};
+    const quint64 nodeBatch = 16;
+
+    auto forEachNode = [&](auto&& work, float progressBegin, float progressEnd) {
+        nextNode = 0;
+        nodesDone = 0;
+        auto run = [&](bool reportProgress) {
+            std::vector<quint64> xs, ys;
+            for(quint64 batch = nextNode++; batch * nodeBatch < nodes.size() && !cancelled;
+                    batch = nextNode++) {
+                quint64 end = std::min<quint64>(nodes.size(), (batch + 1) * nodeBatch);
+                for(quint64 i = batch * nodeBatch; i < end; ++i) {
+                    work(nodes[i], xs, ys);
+                }
+                quint64 done = nodesDone += end - batch * nodeBatch;
+                float fraction = float(done) / nodes.size();
+                if(reportProgress && progress &&
+                        !progress(progressBegin + (progressEnd - progressBegin) * fraction)) {
+                    cancelled = true;
+                }
+            }
+        };
+
+        unsigned nThreads = std::max<quint64>(1, std::min<quint64>(
+                DigitalElevationModel::loaderThreadCount(), nodes.size() / nodeBatch + 1));
+        std::vector<std::thread> workers;
+        for(unsigned i = 1; i < nThreads; ++i) {
+            workers.emplace_back(run, false);
+        }
+        run(true);
+        for(auto& worker : workers) worker.join();
+        if(cancelled) throw "Terrain mesh generation was cancelled.";
+    };
+
+    forEachNode([&](Node & node, std::vector<quint64>& xs, std::vector<quint64>& ys) {
+        MinMaxQuadtree::Stats range = dem.getElevRange(node.row, node.col,
+                                      node.rowEnd - node.row + 1, node.colEnd - node.col + 1);
+        node.minElev = range.minElev;
+        node.maxElev = range.maxElev;
+        node.geometricError = nodeGeometricError(dem, node, xs, ys);
+        node.indexCount = 0;
+        emitNodeStrip(node, cols, skirts, xs, ys, [&](quint32) {
+            ++node.indexCount;
+        });
+        // 格网与四条裙边
+        node.triangleCount = 2 * (xs.size() - 1) * (ys.size() - 1) +
+                             4 * (xs.size() - 1) + 4 * (ys.size() - 1);
+    }, 0.0f, 0.8f);
+
+    // 父节点误差不小于子节点，保证自上而下选择时细化的单调性
+    for(quint64 i = nodes.size(); i-- > 0;) {
+        for(quint64 k = 0; k < nodes[i].childCount; ++k) {
+            nodes[i].geometricError = std::max(nodes[i].geometricError,
+                                               nodes[nodes[i].firstChild + k].geometricError);
+        }
+    }
+
+    quint64 nIndices = 0;
+    for(Node& node : nodes) {
+        node.indexOffset = nIndices;
+        nIndices += node.indexCount;
+    }
+    lod.indices.resize(nIndices);
+
+    forEachNode([&](Node & node, std::vector<quint64>& xs, std::vector<quint64>& ys) {
+        quint32* pOut = lod.indices.data() + node.indexOffset;
+        emitNodeStrip(node, cols, skirts, xs, ys, [&](quint32 index) {
+            *pOut++ = index;
+        });
+    }, 0.8f, 1.0f);
+
+    // 裙边顶点来源
+    lod.skirtSources.resize(skirts.count());
+    for(quint64 row = 0; row < rows; ++row) {
+        if(row % PATCH_SIZE != 0 && row != rows - 1) continue;
+        for(quint64 col = 0; col < cols; ++col) {
+            lod.skirtSources[skirts.onRowLine(row, col) - skirtVertexBase] = quint32(row * cols + col);
+        }
+    }
+    for(quint64 col = 0; col < cols; ++col) {
+        if(col % PATCH_SIZE != 0 && col != cols - 1) continue;
+        for(quint64 row = 0; row < rows; ++row) {
+            lod.skirtSources[skirts.onColLine(row, col) - skirtVertexBase] = quint32(row * cols + col);
+        }
+    }
+
+    return lod;
+}
+
+void TerrainLod::select(const View &view, std::vector<quint32> &selected,
+                        SelectStats* pStats) const {
+    selected.clear();
+    SelectStats stats{0, 0, 0, 0};
+    if(isEmpty()) {
+        if(pStats) *pStats = stats;
+        return;
+    }
+
+    // 节点序号与其包围盒是否已确定完全可见
+    std::vector<std::pair<quint32, bool>> stack{{0, view.pFrustum == nullptr}};
+    while(!stack.empty()) {
+        auto [index, inside] = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[index];
+        if(!node.hasData()) continue;
+
+        if(!inside) {
+            QVector3D boxMin, boxMax;
+            nodeBounds(node, view.elevScale, boxMin, boxMax);
+            Frustum::Containment containment = view.pFrustum->classifyBox(boxMin, boxMax);
+            if(containment == Frustum::Outside) {
+                ++stats.culledNodes;
+                stats.culledTriangles += node.triangleCount;
+                continue;
+            }
+            inside = containment == Frustum::Inside;
+        }
+
+        if(node.childCount == 0 || screenError(node, view) <= view.pixelTolerance) {
+            selected.push_back(index);
+            ++stats.drawnNodes;
+            stats.drawnTriangles += node.triangleCount;
+            continue;
+        }
+        for(quint32 k = 0; k < node.childCount; ++k) {
+            stack.push_back({quint32(node.firstChild + k), inside});
+        }
+    }
+
+    if(pStats) *pStats = stats;
+}
+
+float TerrainLod::screenError(const Node &node, const View &view) const {
+    float worldError = node.geometricError * view.elevScale;
+    if(!view.perspective) return worldError * view.pixelScale;
+
+    // 以相机到包围盒的最近距离估计投影误差
+    QVector3D boxMin, boxMax;
+    nodeBounds(node, view.elevScale, boxMin, boxMax);
+    QVector3D nearest(std::clamp(view.eye.x(), boxMin.x(), boxMax.x()),
+                      std::clamp(view.eye.y(), boxMin.y(), boxMax.y()),
+                      std::clamp(view.eye.z(), boxMin.z(), boxMax.z()));
+    float distance = std::max((nearest - view.eye).length(), cellSize * 1e-3f);
+    return worldError * view.pixelScale / distance;
+}
+
+void TerrainLod::nodeBounds(const Node &node, float elevScale, QVector3D &boxMin,
+                            QVector3D &boxMax) const {
+    boxMin = QVector3D(originX + node.col * cellSize, originY - node.rowEnd * cellSize,
+                       node.minElev * elevScale);
+    boxMax = QVector3D(originX + node.colEnd * cellSize, originY - node.row * cellSize,
+                       node.maxElev * elevScale);
+}
@@ -0,0 +1,153 @@
+#ifndef TERRAINLOD_H
+#define TERRAINLOD_H
+
+#include <QVector3D>
+#include <vector>
+#include "digitalelevationmodel.h"
+#include "frustum.h"
+
+/**
+ * @brief The TerrainLod class
+ *
+ * 地形网格的四叉树细节层次(CDLOD)。
+ * 第L层节点覆盖 PATCH_SIZE * 2^L 个格网，每隔 2^L 个格网点取样，
+ * 各节点的三角形条带直接索引全分辨率顶点缓冲区中的顶点。
+ * 每帧自根节点向下选择屏幕空间误差不超过容限的节点绘制，三角形数随屏幕尺寸而非DEM尺寸增长。
+ *
+ * 节点四周带有裙边：裙边顶点复制节点边界顶点，由着色器下拉到节点的最低高程，
+ * 遮挡相邻节点层级不同时边界处的裂缝。
+ */
+class TerrainLod {
+public:
+    // 节点边长(按本层取样间隔计的格网数)
+    static const quint64 PATCH_SIZE = 32;
+
+    /**
+     * @brief The Node struct 四叉树节点
+     */
+    struct Node {
+        // 层号，0为全分辨率
+        quint32 level;
+        // 覆盖的格网点范围(含两端)
+        quint64 col;
+        quint64 row;
+        quint64 colEnd;
+        quint64 rowEnd;
+        // 有效高程范围，全部无数据时minElev > maxElev
+        float minElev;
+        float maxElev;
+        // 以本层取样代替全分辨率格网的最大高程误差(m)，不小于子节点的误差
+        float geometricError;
+        // 条带索引在索引数组中的范围
+        quint64 indexOffset;
+        quint64 indexCount;
+        // 非退化三角形数(含裙边)
+        quint64 triangleCount;
+        // 子节点在节点数组中连续存放，childCount为0时为叶节点
+        quint64 firstChild;
+        quint32 childCount;
+
+        bool hasData() const {
+            return minElev <= maxElev;
+        }
+    };
+
+    /**
+     * @brief The View struct 节点选择所需的相机参数(世界坐标系，高程已乘缩放量)
+     */
+    struct View {
+        // 相机位置
+        QVector3D eye;
+        // 高程缩放量
+        float elevScale;
+        // 是否透视投影
+        bool perspective;
+        // 透视投影：视口高度 / (2 * tan(视场角 / 2))；正射投影：视口高度 / 视景体高度
+        float pixelScale;
+        // 屏幕空间误差容限(像素)
+        float pixelTolerance;
+        // 视锥体(世界坐标系)，为空时不裁剪
+        const Frustum* pFrustum = nullptr;
+    };
+
+    /**
+     * @brief The SelectStats struct 节点选择统计
+     */
+    struct SelectStats {
+        // 绘制与被视锥体裁剪的节点数
+        quint64 drawnNodes;
+        quint64 culledNodes;
+        // 绘制与被裁剪的三角形数，被裁剪节点按其被裁剪时所在层级计
+        quint64 drawnTriangles;
+        quint64 culledTriangles;
+    };
+
+public:
+    /**
+     * @brief build 为DEM生成四叉树节点、误差与条带索引
+     *
+     * 节点误差与索引在多个线程中计算。取消时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param skirtVertexBase 裙边顶点在顶点缓冲区中的起始序号
+     * @param progress 进度回调，返回false时中止
+     * @return 细节层次
+     */
+    static TerrainLod build(const DigitalElevationModel& dem, quint64 skirtVertexBase,
+                            const DigitalElevationModel::ProgressCallback& progress =
+                                DigitalElevationModel::ProgressCallback());
+
+    /**
+     * @brief skirtVertexCount 获取格网所需的裙边顶点数，即build生成的skirtSources的长度
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @return
+     */
+    static quint64 skirtVertexCount(quint64 cols, quint64 rows);
+
+    bool isEmpty() const {
+        return nodes.empty();
+    }
+
+    /**
+     * @brief select 选择本帧要绘制的节点
+     *
+     * 包围盒在视锥体之外的节点连同其子树被裁剪，完全在视锥体之内的节点其子树不再测试。
+     * @param view 相机参数
+     * @param selected 输出的节点序号(清空后写入)
+     * @param pStats 选择统计，可为空
+     */
+    void select(const View& view, std::vector<quint32>& selected,
+                SelectStats* pStats = nullptr) const;
+
+    /**
+     * @brief screenError 计算节点在屏幕上的误差
+     * @param node 节点
+     * @param view 相机参数
+     * @return 误差(像素)
+     */
+    float screenError(const Node& node, const View& view) const;
+
+    /**
+     * @brief nodeBounds 计算节点在世界坐标系中的包围盒
+     * @param node 节点
+     * @param elevScale 高程缩放量
+     * @param boxMin 包围盒最小角点
+     * @param boxMax 包围盒最大角点
+     */
+    void nodeBounds(const Node& node, float elevScale, QVector3D& boxMin, QVector3D& boxMax) const;
+
+public:
+    // 节点，第0个为根节点，按层序存放
+    std::vector<Node> nodes{};
+    // 各节点的三角形条带索引(含裙边，以退化三角形拼接)
+    std::vector<quint32> indices{};
+    // 每个裙边顶点所复制的全分辨率顶点序号
+    std::vector<quint32> skirtSources{};
+
+    // 格网坐标到世界坐标的映射，同TerrainMesh
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float cellSize = 0.0f;
+};
+
+#endif // TERRAINLOD_H
@@ -0,0 +1,161 @@
+#include "terrainmesh.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+bool TerrainMesh::fitsVertexFormat(quint64 cols, quint64 rows) {
+    if(cols > MAX_GRID_SIZE || rows > MAX_GRID_SIZE) return false;
+    // 每个方向不超过2^16时总数不会溢出quint64
+    return cols * rows + TerrainLod::skirtVertexCount(cols, rows) <= MAX_VERTEX_COUNT;
+}
+
+TerrainMesh TerrainMesh::build(const DigitalElevationModel &dem,
+                               const DigitalElevationModel::ProgressCallback &progress, bool buildNormals) {
+    Profiler::Scope buildScope("TerrainMesh::build", "mesh");
+    TerrainMesh mesh;
+    if(dem.isEmpty()) return mesh;
+
+    quint64 demCols = dem.getCols();
+    quint64 demRows = dem.getRows();
+    if(!fitsVertexFormat(demCols, demRows)) {
+        throw "DEM grid is too large for the terrain mesh vertex format.";
+    }
+    mesh.cols = demCols;
+    mesh.rows = demRows;
+    mesh.xSpan = demCols * dem.getCellSize();
+    mesh.ySpan = demRows * dem.getCellSize();
+
+    // DEM高程跨度取自最小/最大值索引，同一DEM重复生成网格时无需重新扫描
+    // 无数据格网点不参与统计
+    MinMaxQuadtree::Stats range;
+    {
+        Profiler::Scope scope("min/max scan", "mesh");
+        range = dem.getElevRange();
+    }
+    float minElev = range.hasData() ? range.minElev : dem.getNoDataValue();
+    float maxElev = range.hasData() ? range.maxElev : dem.getNoDataValue();
+
+    mesh.maxElev = maxElev, mesh.minElev = minElev;
+
+    // 找到DEM格网中心位置
+    auto geoCenter = dem.getGeoCoord(demRows / 2.0, demCols / 2.0).toVector2D();
+    mesh.xyCenter = QVector2D(geoCenter.y(), geoCenter.x());
+
+    /**
+     * 交换XY轴输入顶点
+     *
+     * 地理坐标系为北东高坐标（左手系），而OpenGL为右手。
+     * 直接输入会导致XY翻转，DEM平面被沿XY轴角平分线对称。
+     * 交换后输入，世界坐标系的Y轴为DEM地理参考的X轴，世界坐标系的X轴为地理参考的Y轴。
+     */
+    QVector3D origin = dem.getGeoCoord(0, 0);
+    mesh.originX = origin.y();
+    mesh.originY = origin.x();
+    mesh.cellSize = dem.getCellSize();
+
+    // 高程编码0 ~ NODATA_HEIGHT - 1 覆盖有效高程范围
+    float noData = dem.getNoDataValue();
+    mesh.heightStep = (maxElev - minElev) / (NODATA_HEIGHT - 1);
+    float invHeightStep = mesh.heightStep > 0.0f ? 1.0f / mesh.heightStep : 0.0f;
+
+    // 进度依次分给细节层次、顶点与索引、法向(生成时)
+    const float lodEnd = buildNormals ? 0.6f : 0.7f;
+    const float vertexEnd = buildNormals ? 0.8f : 1.0f;
+
+    // 细节层次
+    {
+        Profiler::Scope scope("LOD build", "mesh");
+        mesh.lod = TerrainLod::build(dem, demCols * demRows, [&](float fraction) {
+            return !progress || progress(fraction * lodEnd);
+        });
+    }
+
+    // 预先分配全部顶点属性与索引，各线程直接写入所负责的行
+    quint64 nSkirtVertices = mesh.lod.skirtSources.size();
+    mesh.vertexAttribs.resize((demCols * demRows + nSkirtVertices) * VERTEX_COMPONENTS);
+    mesh.indices.resize((demRows - 1) * demCols * 2 + (demRows > 2 ? (demRows - 2) * 2 : 0));
+    quint16* pAttribs = mesh.vertexAttribs.data();
+    quint32* pIndices = mesh.indices.data();
+
+    auto buildRow = [&](quint64 y) {
+        quint16* pVertex = pAttribs + y * demCols * VERTEX_COMPONENTS;
+        for(quint64 x = 0; x < demCols; ++x, pVertex += VERTEX_COMPONENTS) {
+            float elev = dem.getElevByIndex(y * demCols + x);
+            pVertex[0] = quint16(x);
+            pVertex[1] = quint16(y);
+            pVertex[2] = elev == noData ? NODATA_HEIGHT : quint16(std::min<long>(
+                             std::lround((elev - minElev) * invHeightStep), NODATA_HEIGHT - 1));
+            pVertex[3] = 0;
+        }
+
+        // 生成索引数组，最后一行没有条带
+        if(y != demRows - 1) {
+            quint32* pStrip = pIndices + mesh.rowStripOffset(y);
+            for(quint64 x = 0; x < demCols; ++x) {
+                quint64 index = x + y * demCols;
+                pStrip[x * 2] = quint32(index + demCols);
+                pStrip[x * 2 + 1] = quint32(index);
+            }
+
+            /**
+             * 重复本行最后一个索引与下一行第一个索引，产生4个退化三角形，
+             * 使所有行拼接为一个条带。每行索引数为偶数，拼接后各行三角形的绕序不变。
+             */
+            if(y + 2 < demRows) {
+                pStrip[demCols * 2] = quint32(y * demCols + demCols - 1);
+                pStrip[demCols * 2 + 1] = quint32((y + 2) * demCols);
+            }
+        }
+    };
+
+    // 按行带动态分配给各线程，调用线程同时负责报告进度
+    const quint64 bandRows = 64;
+    std::atomic<quint64> nextBand{0};
+    std::atomic<quint64> rowsDone{0};
+    std::atomic_bool cancelled{false};
+
+    auto buildBands = [&](bool reportProgress) {
+        for(quint64 band = nextBand++; band * bandRows < demRows && !cancelled; band = nextBand++) {
+            Profiler::Scope scope("vertex/strip band", "mesh");
+            quint64 rowEnd = std::min(demRows, (band + 1) * bandRows);
+            for(quint64 y = band * bandRows; y < rowEnd; ++y) {
+                buildRow(y);
+            }
+            quint64 done = rowsDone += rowEnd - band * bandRows;
+            if(reportProgress && progress && !progress(lodEnd + (vertexEnd - lodEnd) * done / demRows)) {
+                cancelled = true;
+            }
+        }
+    };
+
+    unsigned nThreads = std::max<quint64>(1, std::min<quint64>(
+            DigitalElevationModel::loaderThreadCount(), (demRows + bandRows - 1) / bandRows));
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < nThreads; ++i) {
+        workers.emplace_back(buildBands, false);
+    }
+    buildBands(true);
+    for(auto& worker : workers) worker.join();
+
+    if(cancelled) {
+        throw "Terrain mesh generation was cancelled.";
+    }
+
+    // 法向，每个行带之后汇报进度并检查取消
+    if(buildNormals) {
+        mesh.normals = NormalMap::build(dem, NormalMap::MAX_SIZE, [&](float fraction) {
+            return !progress || progress(vertexEnd + (1.0f - vertexEnd) * fraction);
+        });
+    }
+
+    // 裙边顶点复制格网点并打上裙边标记
+    quint16* pSkirt = pAttribs + demCols * demRows * VERTEX_COMPONENTS;
+    for(quint64 i = 0; i < nSkirtVertices; ++i, pSkirt += VERTEX_COMPONENTS) {
+        std::copy_n(pAttribs + mesh.lod.skirtSources[i] * VERTEX_COMPONENTS, VERTEX_COMPONENTS, pSkirt);
+        pSkirt[3] = 1;
+    }
+
+    return mesh;
+}
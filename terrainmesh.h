@@ -0,0 +1,101 @@
+#ifndef TERRAINMESH_H
+#define TERRAINMESH_H
+
+#include <QVector2D>
+#include <vector>
+#include "digitalelevationmodel.h"
+#include "normalmap.h"
+#include "terrainlod.h"
+#include "tinmesh.h"
+
+/**
+ * @brief The TerrainMesh struct
+ *
+ * DEM地形网格的CPU端数据(顶点属性、索引及渲染所需的统计量)。
+ * 不依赖OpenGL上下文，可在工作线程中生成，再交给渲染器上传到GPU。
+ */
+struct TerrainMesh {
+    // 格网尺寸
+    quint64 cols = 0;
+    quint64 rows = 0;
+    // 高程范围
+    float minElev = 0.0f;
+    float maxElev = 0.0f;
+    // 格网平面包围盒跨度
+    float xSpan = 0.0f;
+    float ySpan = 0.0f;
+    // 格网平面中心(世界坐标系)
+    QVector2D xyCenter{};
+
+    // 格网坐标到世界坐标的映射：X = originX + 列号 * cellSize，Y = originY - 行号 * cellSize
+    float originX = 0.0f;
+    float originY = 0.0f;
+    float cellSize = 0.0f;
+    // 高程解码：Z = minElev + 高程编码 * heightStep
+    float heightStep = 0.0f;
+
+    // 每个顶点的分量数
+    static const quint64 VERTEX_COMPONENTS = 4;
+    // 表示无数据的高程编码
+    static const quint16 NODATA_HEIGHT = 0xFFFF;
+    // 格网每个方向的最大点数(列号、行号以16位无符号整数存储)
+    static const quint64 MAX_GRID_SIZE = 0x10000;
+    // 格网点与裙边顶点总数的上限(索引为32位无符号整数，0xFFFFFFFF留作无效索引)
+    static const quint64 MAX_VERTEX_COUNT = 0xFFFFFFFFull;
+
+    // 顶点属性：列号、行号、高程编码、裙边标记，各16位
+    // 世界坐标、纹理坐标及颜色均由着色器从中计算
+    // 前 cols * rows 个为格网点，其后为细节层次使用的裙边顶点(裙边标记为1)
+    std::vector<quint16> vertexAttribs{};
+    // 三角形条带索引，每行 cols * 2 个，相邻行之间插入2个退化索引拼接为一个条带
+    std::vector<quint32> indices{};
+
+    bool isEmpty() const {
+        return cols * rows == 0;
+    }
+
+    /**
+     * @brief rowStripOffset 获取某行条带在索引数组中的起始位置
+     * @param row 行号(0 ~ rows - 2)
+     * @return 索引序号，该行条带共 cols * 2 个索引
+     */
+    quint64 rowStripOffset(quint64 row) const {
+        return row * (cols * 2 + 2);
+    }
+
+    // 四叉树细节层次，索引指向vertexAttribs中的顶点
+    TerrainLod lod{};
+
+    // 不规则三角网，打开文件时选择生成，否则为空；索引指向vertexAttribs中的格网顶点
+    TinMesh tin{};
+
+    // 地表法向，用于山体阴影光照
+    NormalMap normals{};
+
+    /**
+     * @brief fitsVertexFormat 格网能否以该网格的顶点格式表示
+     *
+     * 每个方向不超过 MAX_GRID_SIZE，且格网点与裙边顶点总数不超过 MAX_VERTEX_COUNT。
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @return
+     */
+    static bool fitsVertexFormat(quint64 cols, quint64 rows);
+
+    /**
+     * @brief build 由DEM生成地形网格
+     *
+     * 高程在有效范围内均匀量化为16位编码，误差不超过 heightStep / 2。
+     * 取消或格网超出顶点格式(见fitsVertexFormat)时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param progress 进度回调，返回false时中止
+     * @param buildNormals 是否计算地表法向(山体阴影)，否则normals为空
+     * @return 地形网格
+     */
+    static TerrainMesh build(const DigitalElevationModel& dem,
+                             const DigitalElevationModel::ProgressCallback& progress =
+                                 DigitalElevationModel::ProgressCallback(),
+                             bool buildNormals = true);
+};
+
+#endif // TERRAINMESH_H
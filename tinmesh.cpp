@@ -0,0 +1,306 @@
+#include "tinmesh.h"
+#include "profiler.h"
+#include "vertexcache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const int kTileSize = int(TinMesh::TILE_SIZE);
+// 每块的格网点数(每个方向)，相邻块共用边界上的格网点
+const int kGridSize = kTileSize + 1;
+// 斜边中点为格网点的三角形(面积不小于1)总数，按隐式二叉树编号，编号越大层级越深；
+// 最深一层的三角形面积为1，从kLastLevelBegin开始编号，其子三角形的直角边长为1，不再二分
+const int kTriangleCount = kTileSize * kTileSize * 2 - 2;
+const int kLastLevelBegin = kTriangleCount - kTileSize * kTileSize;
+
+// 必须细化的三角形误差
+const float kForceSplit = std::numeric_limits<float>::infinity();
+
+/**
+ * @brief The Triangle struct 块内格网坐标表示的直角三角形，a、b为斜边端点，c为直角顶点
+ */
+struct Triangle {
+    int ax, ay, bx, by, cx, cy;
+
+    // 斜边中点，即二分时插入的格网点
+    int midIndex() const {
+        return ((ay + by) >> 1) * kGridSize + ((ax + bx) >> 1);
+    }
+
+    // 二分得到的两个子三角形的斜边中点
+    int leftChildMidIndex() const {
+        return ((ay + cy) >> 1) * kGridSize + ((ax + cx) >> 1);
+    }
+
+    int rightChildMidIndex() const {
+        return ((by + cy) >> 1) * kGridSize + ((bx + cx) >> 1);
+    }
+
+    // 直角边长为1的三角形没有斜边中点，不能再二分
+    bool isSmallest() const {
+        return std::abs(ax - cx) + std::abs(ay - cy) <= 1;
+    }
+};
+
+/**
+ * @brief triangleAt 由编号求三角形顶点
+ *
+ * 整块沿(0, 0)到(kTileSize, kTileSize)的对角线分为两个根三角形；
+ * 三角形二分为(c, a, m)与(b, c, m)两个子三角形，m为斜边中点。
+ * @param i 编号(0 ~ kTriangleCount - 1)
+ * @return
+ */
+Triangle triangleAt(int i) {
+    int id = i + 2;
+    Triangle t{0, 0, 0, 0, 0, 0};
+    if(id & 1) {
+        t.bx = t.by = t.cx = kTileSize;
+    } else {
+        t.ax = t.ay = t.cy = kTileSize;
+    }
+    while((id >>= 1) > 1) {
+        int mx = (t.ax + t.bx) >> 1, my = (t.ay + t.by) >> 1;
+        if(id & 1) {
+            t.bx = t.ax, t.by = t.ay;
+            t.ax = t.cx, t.ay = t.cy;
+        } else {
+            t.ax = t.bx, t.ay = t.by;
+            t.bx = t.cx, t.by = t.cy;
+        }
+        t.cx = mx, t.cy = my;
+    }
+    return t;
+}
+
+/**
+ * @brief The Tile struct 一个块的高程与各格网点的细化误差
+ */
+struct Tile {
+    // 块左上角在DEM中的行列号
+    quint64 row0;
+    quint64 col0;
+    // 块内格网点高程，超出DEM或无数据时为NaN
+    std::vector<float> heights;
+    // 以该格网点为斜边中点的三角形需要细化的误差，不小于其子三角形的误差
+    std::vector<float> errors;
+};
+
+/**
+ * @brief triangleError 计算三角形覆盖的格网点到三角形平面的最大高程偏差
+ *
+ * 三角形同时覆盖有效格网点与无效(无数据或超出DEM)格网点时必须细化；全部无效时误差为0。
+ */
+float triangleError(const Tile& tile, const Triangle& t) {
+    const float* h = tile.heights.data();
+    float ha = h[t.ay * kGridSize + t.ax], hb = h[t.by * kGridSize + t.bx],
+          hc = h[t.cy * kGridSize + t.cx];
+    bool planeValid = !std::isnan(ha) && !std::isnan(hb) && !std::isnan(hc);
+
+    // 以边函数判断格网点是否在三角形内(含边界)，面积取绝对值统一绕序
+    int area = (t.bx - t.ax) * (t.cy - t.ay) - (t.by - t.ay) * (t.cx - t.ax);
+    int sign = area > 0 ? 1 : -1;
+    float invArea = 1.0f / (area * sign);
+    int x0 = std::min({t.ax, t.bx, t.cx}), x1 = std::max({t.ax, t.bx, t.cx});
+    int y0 = std::min({t.ay, t.by, t.cy}), y1 = std::max({t.ay, t.by, t.cy});
+
+    bool anyValid = false, anyInvalid = false;
+    float maxError = 0.0f;
+    for(int y = y0; y <= y1; ++y) {
+        for(int x = x0; x <= x1; ++x) {
+            int wa = sign * ((t.cx - t.bx) * (y - t.by) - (t.cy - t.by) * (x - t.bx));
+            int wb = sign * ((t.ax - t.cx) * (y - t.cy) - (t.ay - t.cy) * (x - t.cx));
+            int wc = sign * ((t.bx - t.ax) * (y - t.ay) - (t.by - t.ay) * (x - t.ax));
+            if(wa < 0 || wb < 0 || wc < 0) continue;
+
+            float elev = h[y * kGridSize + x];
+            if(std::isnan(elev)) {
+                anyInvalid = true;
+            } else {
+                anyValid = true;
+                if(planeValid) {
+                    float plane = (ha * wa + hb * wb + hc * wc) * invArea;
+                    maxError = std::max(maxError, std::abs(plane - elev));
+                }
+            }
+            if(anyValid && anyInvalid) return kForceSplit;
+        }
+    }
+    return maxError;
+}
+
+/**
+ * @brief propagateErrors 自深向浅使每个格网点的误差不小于其子三角形的误差
+ *
+ * 细化某三角形时其斜边中点也是斜边另一侧三角形的斜边中点，两侧同时二分，保证网格连续。
+ */
+void propagateErrors(Tile& tile) {
+    float* e = tile.errors.data();
+    for(int i = kLastLevelBegin - 1; i >= 0; --i) {
+        Triangle t = triangleAt(i);
+        float& mid = e[t.midIndex()];
+        mid = std::max({mid, e[t.leftChildMidIndex()], e[t.rightChildMidIndex()]});
+    }
+}
+
+/**
+ * @brief emitTriangles 自根三角形向下细化并输出三角形
+ */
+void emitTriangles(const Tile& tile, const Triangle& t, float maxError, quint64 cols,
+                   quint64 rows, std::vector<quint32>& indices) {
+    if(!t.isSmallest() && tile.errors[t.midIndex()] > maxError) {
+        int mx = (t.ax + t.bx) >> 1, my = (t.ay + t.by) >> 1;
+        emitTriangles(tile, Triangle{t.cx, t.cy, t.ax, t.ay, mx, my}, maxError, cols, rows, indices);
+        emitTriangles(tile, Triangle{t.bx, t.by, t.cx, t.cy, mx, my}, maxError, cols, rows, indices);
+        return;
+    }
+
+    // 超出DEM的三角形不输出(跨越DEM边界的三角形已被细化)
+    const int xs[] = {t.ax, t.bx, t.cx}, ys[] = {t.ay, t.by, t.cy};
+    quint32 triangle[3];
+    for(int k = 0; k < 3; ++k) {
+        quint64 row = tile.row0 + ys[k], col = tile.col0 + xs[k];
+        if(row >= rows || col >= cols) return;
+        triangle[k] = quint32(row * cols + col);
+    }
+    indices.insert(indices.end(), triangle, triangle + 3);
+}
+
+}
+
+TinMesh TinMesh::build(const DigitalElevationModel &dem, float maxError,
+                       const DigitalElevationModel::ProgressCallback &progress) {
+    Profiler::Scope scope("TinMesh::build", "mesh");
+    auto startTime = std::chrono::steady_clock::now();
+    TinMesh tin;
+    tin.maxError = maxError;
+    const quint64 cols = dem.getCols(), rows = dem.getRows();
+    if(cols < 2 || rows < 2) return tin;
+
+    const quint64 tilesX = (cols - 2) / kTileSize + 1, tilesY = (rows - 2) / kTileSize + 1;
+    std::vector<Tile> tiles(tilesX * tilesY);
+
+    // 各块动态分配给各线程，调用线程同时负责报告进度
+    std::atomic<quint64> nextTile{0};
+    std::atomic<quint64> tilesDone{0};
+    std::atomic_bool cancelled{false};
+    auto forEachTile = [&](auto&& work, float progressBegin, float progressEnd) {
+        nextTile = 0;
+        tilesDone = 0;
+        auto run = [&](bool reportProgress) {
+            for(quint64 i = nextTile++; i < tiles.size() && !cancelled; i = nextTile++) {
+                work(tiles[i]);
+                float fraction = float(++tilesDone) / tiles.size();
+                if(reportProgress && progress &&
+                        !progress(progressBegin + (progressEnd - progressBegin) * fraction)) {
+                    cancelled = true;
+                }
+            }
+        };
+
+        unsigned nThreads = std::max<quint64>(1, std::min<quint64>(
+                DigitalElevationModel::loaderThreadCount(), tiles.size()));
+        std::vector<std::thread> workers;
+        for(unsigned i = 1; i < nThreads; ++i) {
+            workers.emplace_back(run, false);
+        }
+        run(true);
+        for(auto& worker : workers) worker.join();
+        if(cancelled) throw "Terrain mesh generation was cancelled.";
+    };
+
+    for(quint64 ty = 0; ty < tilesY; ++ty) {
+        for(quint64 tx = 0; tx < tilesX; ++tx) {
+            tiles[ty * tilesX + tx].row0 = ty * kTileSize;
+            tiles[ty * tilesX + tx].col0 = tx * kTileSize;
+        }
+    }
+
+    // 读取高程并计算各三角形的误差
+    const float noData = dem.getNoDataValue();
+    forEachTile([&](Tile & tile) {
+        tile.heights.assign(kGridSize * kGridSize, std::numeric_limits<float>::quiet_NaN());
+        tile.errors.assign(kGridSize * kGridSize, 0.0f);
+        quint64 rowEnd = std::min<quint64>(rows, tile.row0 + kGridSize),
+                colEnd = std::min<quint64>(cols, tile.col0 + kGridSize);
+        for(quint64 row = tile.row0; row < rowEnd; ++row) {
+            float* pHeight = tile.heights.data() + (row - tile.row0) * kGridSize;
+            for(quint64 col = tile.col0; col < colEnd; ++col) {
+                float elev = dem.getElev(row, col);
+                if(elev != noData) pHeight[col - tile.col0] = elev;
+            }
+        }
+
+        // 编号越大的三角形越小，先处理子三角形
+        float* e = tile.errors.data();
+        for(int i = kTriangleCount - 1; i >= 0; --i) {
+            Triangle t = triangleAt(i);
+            float& mid = e[t.midIndex()];
+            mid = std::max(mid, triangleError(tile, t));
+            if(i < kLastLevelBegin) {
+                mid = std::max({mid, e[t.leftChildMidIndex()], e[t.rightChildMidIndex()]});
+            }
+        }
+    }, 0.0f, 0.9f);
+
+    /**
+     * 相邻块公共边上的格网点取两块误差的较大值，再在块内重新传递，
+     * 直到公共边上的误差不再变化，两块对公共边的细化因而相同。
+     */
+    for(bool changed = true; changed;) {
+        changed = false;
+        auto merge = [&changed](float& e1, float& e2) {
+            if(e1 == e2) return;
+            e1 = e2 = std::max(e1, e2);
+            changed = true;
+        };
+        for(quint64 ty = 0; ty < tilesY; ++ty) {
+            for(quint64 tx = 0; tx < tilesX; ++tx) {
+                Tile& tile = tiles[ty * tilesX + tx];
+                if(tx + 1 < tilesX) {
+                    Tile& right = tiles[ty * tilesX + tx + 1];
+                    for(int y = 0; y < kGridSize; ++y) {
+                        merge(tile.errors[y * kGridSize + kTileSize], right.errors[y * kGridSize]);
+                    }
+                }
+                if(ty + 1 < tilesY) {
+                    Tile& below = tiles[(ty + 1) * tilesX + tx];
+                    for(int x = 0; x < kGridSize; ++x) {
+                        merge(tile.errors[kTileSize * kGridSize + x], below.errors[x]);
+                    }
+                }
+            }
+        }
+        if(changed) forEachTile(propagateErrors, 0.9f, 0.9f);
+    }
+
+    // 按误差阈值细化并输出三角形，各块结果按块顺序拼接
+    std::vector<std::vector<quint32>> tileIndices(tiles.size());
+    forEachTile([&](Tile & tile) {
+        std::vector<quint32>& indices = tileIndices[&tile - tiles.data()];
+        emitTriangles(tile, Triangle{0, 0, kTileSize, kTileSize, kTileSize, 0}, maxError, cols, rows,
+                      indices);
+        emitTriangles(tile, Triangle{kTileSize, kTileSize, 0, 0, 0, kTileSize}, maxError, cols, rows,
+                      indices);
+        // 二分树的深度优先顺序在相邻子树之间跳跃，块内重排提高顶点缓存命中率
+        VertexCache::optimize(indices);
+        tile.heights = std::vector<float>();
+        tile.errors = std::vector<float>();
+    }, 0.9f, 1.0f);
+
+    quint64 nIndices = 0;
+    for(const auto& indices : tileIndices) nIndices += indices.size();
+    tin.indices.reserve(nIndices);
+    for(auto& indices : tileIndices) {
+        tin.indices.insert(tin.indices.end(), indices.begin(), indices.end());
+        indices = std::vector<quint32>();
+    }
+
+    tin.buildMilliseconds = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - startTime).count();
+    return tin;
+}
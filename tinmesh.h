@@ -0,0 +1,55 @@
+#ifndef TINMESH_H
+#define TINMESH_H
+
+#include <vector>
+#include "digitalelevationmodel.h"
+
+/**
+ * @brief The TinMesh class
+ *
+ * 误差受限的不规则三角网(TIN)，用于平坦或起伏平缓的DEM。
+ * 格网按 TILE_SIZE 分块，每块以直角三角形二分(RTIN)自顶向下细化，
+ * 只有与全分辨率格网点的最大高程偏差超过阈值的三角形才被二分；各块在多个线程中处理。
+ * 相邻块公共边上的细化结果一致，不产生裂缝。
+ *
+ * 三角形顶点直接索引全分辨率网格的格网顶点(行号 * 列数 + 列号)，与网格共用顶点缓冲区。
+ * 块内三角形以VertexCache::optimize重排，提高顶点缓存命中率。
+ */
+class TinMesh {
+public:
+    // 分块边长(格网数)，须为2的幂
+    static const quint64 TILE_SIZE = 256;
+
+    /**
+     * @brief build 为DEM生成误差不超过maxError的不规则三角网
+     *
+     * 所有格网点到所在三角形的高程偏差不超过maxError；
+     * 与无数据格网点相邻的区域细化到全分辨率，渲染时按无数据处理。
+     * 取消时抛出异常(const char*)。
+     * @param dem DEM数据
+     * @param maxError 最大高程误差(m)
+     * @param progress 进度回调，返回false时中止
+     * @return 不规则三角网，DEM少于2行或2列时为空
+     */
+    static TinMesh build(const DigitalElevationModel& dem, float maxError,
+                         const DigitalElevationModel::ProgressCallback& progress =
+                             DigitalElevationModel::ProgressCallback());
+
+    bool isEmpty() const {
+        return indices.empty();
+    }
+
+    quint64 triangleCount() const {
+        return indices.size() / 3;
+    }
+
+public:
+    // 生成时使用的最大高程误差(m)
+    float maxError = 0.0f;
+    // 三角形顶点索引，每3个一个三角形
+    std::vector<quint32> indices{};
+    // 生成耗时(ms)
+    double buildMilliseconds = 0.0;
+};
+
+#endif // TINMESH_H
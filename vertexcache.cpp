@@ -0,0 +1,255 @@
+#include "vertexcache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Forsyth算法的评分参数
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+/**
+ * @brief vertexScore 计算顶点的评分
+ * @param cachePosition 顶点在LRU缓存中的位置，不在缓存中为-1
+ * @param remaining 尚未输出的相邻三角形数
+ * @param cacheSize 缓存容量
+ */
+float vertexScore(int cachePosition, quint32 remaining, int cacheSize) {
+    if(remaining == 0) return -1.0f;
+
+    float score = 0.0f;
+    if(cachePosition >= 0) {
+        if(cachePosition < 3) {
+            // 刚用过的顶点属于上一个三角形，固定评分避免总是选择与其相邻的三角形
+            score = kLastTriangleScore;
+        } else {
+            float scale = 1.0f / (cacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, kCacheDecayPower);
+        }
+    }
+    // 剩余三角形少的顶点优先，尽早结束对它的使用
+    score += kValenceBoostScale * std::pow(float(remaining), -kValenceBoostPower);
+    return score;
+}
+
+}
+
+VertexCache::Simulator::Simulator(int cacheSize): mEntries(std::max(cacheSize, 1), 0xFFFFFFFFu) {}
+
+void VertexCache::Simulator::fetch(quint32 index) {
+    if(std::find(mEntries.begin(), mEntries.end(), index) != mEntries.end()) return;
+    mEntries[muNext] = index;
+    muNext = (muNext + 1) % mEntries.size();
+    ++mStats.misses;
+}
+
+void VertexCache::Simulator::triangles(const quint32 *pIndices, quint64 count) {
+    for(quint64 i = 0; i + 2 < count; i += 3) {
+        fetch(pIndices[i]);
+        fetch(pIndices[i + 1]);
+        fetch(pIndices[i + 2]);
+        if(pIndices[i] != pIndices[i + 1] && pIndices[i + 1] != pIndices[i + 2] &&
+                pIndices[i] != pIndices[i + 2]) {
+            ++mStats.triangles;
+        }
+    }
+}
+
+void VertexCache::Simulator::strip(const quint32 *pIndices, quint64 count) {
+    for(quint64 i = 0; i < count; ++i) {
+        fetch(pIndices[i]);
+        if(i >= 2 && pIndices[i] != pIndices[i - 1] && pIndices[i - 1] != pIndices[i - 2] &&
+                pIndices[i] != pIndices[i - 2]) {
+            ++mStats.triangles;
+        }
+    }
+}
+
+quint64 VertexCache::gridStripeWidth(int cacheSize) {
+    // 条内一行共 宽度 + 1 个格网点，FIFO缓存需同时容纳当前行的上下两行格网点
+    return quint64(std::max(cacheSize / 2 - 1, 1));
+}
+
+quint64 VertexCache::gridStripeCount(quint64 cols, int cacheSize) {
+    if(cols < 2) return 0;
+    quint64 width = gridStripeWidth(cacheSize);
+    return (cols - 2) / width + 1;
+}
+
+void VertexCache::gridStripeTriangles(quint64 cols, quint64 rows, quint64 stripe,
+                                      std::vector<quint32> &indices, int cacheSize) {
+    quint64 width = gridStripeWidth(cacheSize);
+    quint64 colBegin = stripe * width;
+    quint64 colEnd = std::min(cols - 1, colBegin + width);
+    if(rows < 2 || colBegin >= colEnd) return;
+
+    indices.reserve(indices.size() + (colEnd - colBegin) * ((rows - 1) * 6 + 3));
+    /**
+     * 先以退化三角形按顺序载入第一行格网点，否则第一行的上下两行格网点在FIFO中交错，
+     * 下一行开始时上一行格网点已被挤出，此后每行都全部未命中。
+     */
+    for(quint64 col = colBegin; col < colEnd; ++col) {
+        indices.insert(indices.end(), {quint32(col), quint32(col), quint32(col + 1)});
+    }
+    for(quint64 row = 0; row + 1 < rows; ++row) {
+        for(quint64 col = colBegin; col < colEnd; ++col) {
+            quint32 topLeft = quint32(row * cols + col), bottomLeft = quint32(topLeft + cols);
+            // 与条带网格绕序相同的两个三角形
+            indices.insert(indices.end(), {bottomLeft, topLeft, bottomLeft + 1,
+                                           topLeft, topLeft + 1, bottomLeft + 1
+                                          });
+        }
+    }
+}
+
+quint64 VertexCache::gridTriangleIndexCount(quint64 cols, quint64 rows) {
+    if(cols < 2 || rows < 2) return 0;
+    // 每个单元2个三角形，每列单元在所在竖条开头另有1个退化三角形
+    return (cols - 1) * ((rows - 1) * 6 + 3);
+}
+
+VertexCache::Stats VertexCache::measureGridStrips(quint64 cols, quint64 rows, bool perRow,
+                                                  int simulatedCacheSize) {
+    Stats total{0, 0};
+    if(cols < 2 || rows < 2) return total;
+
+    // 与TerrainMesh相同的行条带与行间退化索引
+    Simulator simulator(simulatedCacheSize);
+    std::vector<quint32> strip;
+    strip.reserve(cols * 2 + 2);
+    for(quint64 row = 0; row + 1 < rows; ++row) {
+        strip.clear();
+        for(quint64 col = 0; col < cols; ++col) {
+            strip.push_back(quint32((row + 1) * cols + col));
+            strip.push_back(quint32(row * cols + col));
+        }
+        if(perRow) {
+            Simulator rowSimulator(simulatedCacheSize);
+            rowSimulator.strip(strip.data(), strip.size());
+            total.triangles += rowSimulator.stats().triangles;
+            total.misses += rowSimulator.stats().misses;
+            continue;
+        }
+        if(row + 2 < rows) {
+            strip.push_back(quint32(row * cols + cols - 1));
+            strip.push_back(quint32((row + 2) * cols));
+        }
+        simulator.strip(strip.data(), strip.size());
+    }
+    return perRow ? total : simulator.stats();
+}
+
+VertexCache::Stats VertexCache::measureGridTriangles(quint64 cols, quint64 rows,
+                                                     int simulatedCacheSize) {
+    Simulator simulator(simulatedCacheSize);
+    std::vector<quint32> indices;
+    for(quint64 stripe = 0; stripe < gridStripeCount(cols); ++stripe) {
+        indices.clear();
+        gridStripeTriangles(cols, rows, stripe, indices);
+        simulator.triangles(indices.data(), indices.size());
+    }
+    return simulator.stats();
+}
+
+void VertexCache::optimize(std::vector<quint32> &indices, int cacheSize) {
+    const quint64 nTriangles = indices.size() / 3;
+    if(nTriangles < 2) return;
+    cacheSize = std::max(cacheSize, 4);
+
+    // 顶点重新编号为连续序号
+    std::vector<quint32> vertices(indices.begin(), indices.begin() + nTriangles * 3);
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+    std::vector<quint32> local(nTriangles * 3);
+    for(quint64 i = 0; i < local.size(); ++i) {
+        local[i] = quint32(std::lower_bound(vertices.begin(), vertices.end(), indices[i]) -
+                           vertices.begin());
+    }
+    const quint64 nVertices = vertices.size();
+
+    // 顶点的相邻三角形列表
+    std::vector<quint32> adjacencyOffset(nVertices + 1, 0);
+    for(quint32 v : local) ++adjacencyOffset[v + 1];
+    for(quint64 v = 0; v < nVertices; ++v) adjacencyOffset[v + 1] += adjacencyOffset[v];
+    std::vector<quint32> adjacency(local.size());
+    std::vector<quint32> remaining(nVertices, 0);
+    for(quint64 i = 0; i < local.size(); ++i) {
+        quint32 v = local[i];
+        adjacency[adjacencyOffset[v] + remaining[v]++] = quint32(i / 3);
+    }
+
+    std::vector<int> cachePosition(nVertices, -1);
+    std::vector<float> score(nVertices);
+    for(quint64 v = 0; v < nVertices; ++v) score[v] = vertexScore(-1, remaining[v], cacheSize);
+    std::vector<float> triangleScore(nTriangles);
+    std::vector<bool> emitted(nTriangles, false);
+    for(quint64 t = 0; t < nTriangles; ++t) {
+        triangleScore[t] = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+    }
+
+    // 模拟的LRU缓存，多留3个位置容纳新三角形的顶点
+    std::vector<quint32> cache;
+    cache.reserve(cacheSize + 3);
+    std::vector<quint32> output;
+    output.reserve(nTriangles * 3);
+
+    quint64 bestTriangle = 0;
+    quint64 scanFrom = 0;
+    for(quint64 n = 0; n < nTriangles; ++n) {
+        // 缓存中没有候选三角形时按顺序找下一个未输出的三角形
+        if(n == 0 || bestTriangle == nTriangles) {
+            while(emitted[scanFrom]) ++scanFrom;
+            bestTriangle = scanFrom;
+            for(quint64 t = scanFrom; t < std::min(nTriangles, scanFrom + 64); ++t) {
+                if(!emitted[t] && triangleScore[t] > triangleScore[bestTriangle]) bestTriangle = t;
+            }
+        }
+
+        emitted[bestTriangle] = true;
+        std::vector<quint32> newCache;
+        newCache.reserve(cacheSize + 3);
+        for(int k = 0; k < 3; ++k) {
+            quint32 v = local[bestTriangle * 3 + k];
+            output.push_back(vertices[v]);
+            newCache.push_back(v);
+            // 从相邻三角形列表中移除
+            quint32* pBegin = adjacency.data() + adjacencyOffset[v];
+            quint32* pEnd = pBegin + remaining[v];
+            *std::find(pBegin, pEnd, quint32(bestTriangle)) = *(pEnd - 1);
+            --remaining[v];
+        }
+        for(quint32 v : cache) {
+            if(std::find(newCache.begin(), newCache.end(), v) == newCache.end()) newCache.push_back(v);
+        }
+        // 被挤出缓存的顶点
+        for(quint64 k = cacheSize; k < newCache.size(); ++k) {
+            cachePosition[newCache[k]] = -1;
+            score[newCache[k]] = vertexScore(-1, remaining[newCache[k]], cacheSize);
+        }
+        newCache.resize(std::min<quint64>(newCache.size(), cacheSize));
+        cache.swap(newCache);
+
+        // 更新缓存中顶点及其相邻三角形的评分，并选出下一个三角形
+        for(quint64 k = 0; k < cache.size(); ++k) {
+            cachePosition[cache[k]] = int(k);
+            score[cache[k]] = vertexScore(int(k), remaining[cache[k]], cacheSize);
+        }
+        bestTriangle = nTriangles;
+        float bestScore = -1.0f;
+        for(quint32 v : cache) {
+            for(quint32 k = 0; k < remaining[v]; ++k) {
+                quint32 t = adjacency[adjacencyOffset[v] + k];
+                float s = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+                triangleScore[t] = s;
+                if(s > bestScore) {
+                    bestScore = s;
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices.begin());
+}
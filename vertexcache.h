@@ -0,0 +1,141 @@
+#ifndef VERTEXCACHE_H
+#define VERTEXCACHE_H
+
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * @brief The VertexCache class
+ *
+ * 顶点后变换缓存(post-transform cache)：按缓存友好的顺序生成格网三角形，
+ * 以Forsyth算法重排任意三角形列表，并以FIFO缓存模拟统计ACMR(每个三角形的平均顶点着色次数)。
+ * 不依赖OpenGL上下文。
+ */
+class VertexCache {
+public:
+    // 生成与重排所假设的缓存容量(顶点数)
+    static const int DEFAULT_CACHE_SIZE = 32;
+
+    /**
+     * @brief The Stats struct 缓存模拟结果
+     */
+    struct Stats {
+        // 非退化三角形数
+        quint64 triangles;
+        // 缓存未命中(顶点着色)次数
+        quint64 misses;
+
+        double acmr() const {
+            return triangles ? double(misses) / triangles : 0.0;
+        }
+    };
+
+    /**
+     * @brief The Simulator class FIFO缓存模拟器
+     *
+     * 所有索引(含条带中的退化三角形)都经过缓存，只有非退化三角形计入三角形数。
+     */
+    class Simulator {
+    public:
+        explicit Simulator(int cacheSize = DEFAULT_CACHE_SIZE);
+
+        /**
+         * @brief triangles 模拟GL_TRIANGLES索引
+         * @param pIndices 索引
+         * @param count 索引数，为3的倍数
+         */
+        void triangles(const quint32* pIndices, quint64 count);
+
+        /**
+         * @brief strip 模拟一个GL_TRIANGLE_STRIP
+         * @param pIndices 索引
+         * @param count 索引数
+         */
+        void strip(const quint32* pIndices, quint64 count);
+
+        Stats stats() const {
+            return mStats;
+        }
+
+    private:
+        void fetch(quint32 index);
+
+    private:
+        std::vector<quint32> mEntries{};
+        quint64 muNext{0};
+        Stats mStats{0, 0};
+    };
+
+    /**
+     * @brief gridStripeWidth 缓存优化格网三角形的竖条宽度(格网数)
+     *
+     * 条内逐行输出时，上一行格网点在被下一行重用之前不会被挤出FIFO缓存。
+     * @param cacheSize 缓存容量
+     * @return
+     */
+    static quint64 gridStripeWidth(int cacheSize = DEFAULT_CACHE_SIZE);
+
+    /**
+     * @brief gridStripeCount 格网划分的竖条数
+     * @param cols 格网列数
+     * @param cacheSize 缓存容量
+     * @return
+     */
+    static quint64 gridStripeCount(quint64 cols, int cacheSize = DEFAULT_CACHE_SIZE);
+
+    /**
+     * @brief gridStripeTriangles 按缓存友好的顺序输出一个竖条的GL_TRIANGLES索引
+     *
+     * 格网按列划分为宽 gridStripeWidth 的竖条，条内自上而下逐行、行内自左向右输出每个单元的两个三角形，
+     * 对角线与条带网格相同，为(行, 列)到(行 + 1, 列 + 1)。各竖条依次输出即为整个格网。
+     * 竖条开头另有 宽度 个退化三角形，用于按顺序载入第一行格网点。
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @param stripe 竖条序号
+     * @param indices 追加输出的索引，顶点序号为 行号 * cols + 列号
+     * @param cacheSize 缓存容量
+     */
+    static void gridStripeTriangles(quint64 cols, quint64 rows, quint64 stripe,
+                                    std::vector<quint32>& indices,
+                                    int cacheSize = DEFAULT_CACHE_SIZE);
+
+    /**
+     * @brief gridTriangleIndexCount 缓存优化格网三角形的索引总数(含退化三角形)
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @return
+     */
+    static quint64 gridTriangleIndexCount(quint64 cols, quint64 rows);
+
+    /**
+     * @brief measureGridStrips 模拟TerrainMesh的行条带索引
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @param perRow 每行一次绘制调用(每行开始时清空缓存)，否则为拼接后的单个条带
+     * @param simulatedCacheSize 模拟的缓存容量
+     * @return
+     */
+    static Stats measureGridStrips(quint64 cols, quint64 rows, bool perRow,
+                                   int simulatedCacheSize = DEFAULT_CACHE_SIZE);
+
+    /**
+     * @brief measureGridTriangles 模拟以默认缓存容量生成的缓存优化格网三角形
+     * @param cols 格网列数
+     * @param rows 格网行数
+     * @param simulatedCacheSize 模拟的缓存容量
+     * @return
+     */
+    static Stats measureGridTriangles(quint64 cols, quint64 rows,
+                                      int simulatedCacheSize = DEFAULT_CACHE_SIZE);
+
+    /**
+     * @brief optimize 以Forsyth算法重排三角形顺序，提高缓存命中率
+     *
+     * 只改变三角形的先后顺序，不改变三角形本身与绕序。
+     * @param indices GL_TRIANGLES索引，原地重排
+     * @param cacheSize 缓存容量
+     */
+    static void optimize(std::vector<quint32>& indices, int cacheSize = DEFAULT_CACHE_SIZE);
+};
+
+#endif // VERTEXCACHE_H
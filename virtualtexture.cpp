@@ -0,0 +1,283 @@
+#include "virtualtexture.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+VirtualTexture::VirtualTexture(OrthoPyramid pyramid, quint32 slotsX, quint32 slotsY)
+    : mPyramid(std::move(pyramid)),
+      muSlotsX(std::clamp<quint32>(slotsX, 1, 256)),
+      muSlotsY(std::clamp<quint32>(slotsY, 1, 256)),
+      muTopLevel(mPyramid.levelCount() - 1) {
+    mSlots.assign(quint64(muSlotsX) * muSlotsY, Slot{0, 0, false});
+
+    // 页表初始全部指向槽位0中的最粗层级页，该页同步解码，第一次取出时放入槽位0
+    mPageTable.resize(quint64(tableCols()) * tableRows() * 4);
+    for(quint64 i = 0; i < mPageTable.size(); i += 4) {
+        mPageTable[i] = 0;
+        mPageTable[i + 1] = 0;
+        mPageTable[i + 2] = quint8(muTopLevel);
+        mPageTable[i + 3] = 255;
+    }
+    mReady.push_back(Page{muTopLevel, 0, 0, 0, mPyramid.readPage(muTopLevel, 0, 0)});
+    mLoading.insert(pageKey(muTopLevel, 0, 0));
+
+    mLoadThread = std::thread(&VirtualTexture::loadLoop, this);
+}
+
+VirtualTexture::~VirtualTexture() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mbStopping = true;
+    }
+    mLoadCondition.notify_all();
+    mLoadThread.join();
+}
+
+const OrthoPyramid &VirtualTexture::pyramid() const {
+    return mPyramid;
+}
+
+quint32 VirtualTexture::slotsX() const {
+    return muSlotsX;
+}
+
+quint32 VirtualTexture::slotsY() const {
+    return muSlotsY;
+}
+
+const std::vector<quint8> &VirtualTexture::pageTable() const {
+    return mPageTable;
+}
+
+quint32 VirtualTexture::tableCols() const {
+    return mPyramid.level(0).pagesX;
+}
+
+quint32 VirtualTexture::tableRows() const {
+    return mPyramid.level(0).pagesY;
+}
+
+bool VirtualTexture::takeDirtyTableRows(quint32 &rowBegin, quint32 &rowEnd) {
+    if(muDirtyRowBegin >= muDirtyRowEnd) return false;
+    rowBegin = muDirtyRowBegin;
+    rowEnd = muDirtyRowEnd;
+    muDirtyRowBegin = muDirtyRowEnd = 0;
+    return true;
+}
+
+void VirtualTexture::beginFrame() {
+    ++muFrame;
+    mMissing.clear();
+}
+
+void VirtualTexture::requestRect(quint32 level, double x0, double y0, double x1, double y1) {
+    // 限制在影像范围内，结束坐标不含
+    double maxX = std::nextafter(double(mPyramid.width()), 0.0);
+    double maxY = std::nextafter(double(mPyramid.height()), 0.0);
+    x0 = std::clamp(x0, 0.0, maxX), x1 = std::clamp(x1, x0, maxX);
+    y0 = std::clamp(y0, 0.0, maxY), y1 = std::clamp(y1, y0, maxY);
+
+    quint32 px0, px1, py0, py1;
+    for(level = std::min(level, muTopLevel); ; ++level) {
+        double pagePixels = double(quint64(OrthoPyramid::PAGE_SIZE) << level);
+        px0 = quint32(x0 / pagePixels), px1 = quint32(x1 / pagePixels);
+        py0 = quint32(y0 / pagePixels), py1 = quint32(y1 / pagePixels);
+        if(quint64(px1 - px0 + 1) * (py1 - py0 + 1) <= MAX_PAGES_PER_REQUEST || level == muTopLevel) break;
+    }
+
+    for(quint32 y = py0; y <= py1; ++y) {
+        for(quint32 x = px0; x <= px1; ++x) touch(level, x, y);
+    }
+}
+
+void VirtualTexture::endFrame() {
+    // 先加载粗层级，使细层级页到达之前就有可用的上级页
+    std::vector<std::pair<quint32, quint64>> missing;
+    missing.reserve(mMissing.size());
+    for(const auto& [key, level] : mMissing) missing.emplace_back(level, key);
+    std::sort(missing.begin(), missing.end(), std::greater<>());
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        // 丢弃本帧不再需要的已解码页，CPU端只保留本帧请求的页(最粗层级页除外)
+        for(auto it = mReady.begin(); it != mReady.end();) {
+            quint64 key = pageKey(it->level, it->x, it->y);
+            if(it->level == muTopLevel || mMissing.count(key)) {
+                ++it;
+            } else {
+                mLoading.erase(key);
+                it = mReady.erase(it);
+            }
+        }
+        mLoadQueue.clear();
+        for(const auto& item : missing) {
+            if(mLoading.count(item.second) || mFailed.count(item.second)) continue;
+            mLoadQueue.push_back(item.second);
+        }
+    }
+    mLoadCondition.notify_one();
+}
+
+void VirtualTexture::takeReadyPages(int maxPages, std::vector<Page> &pages) {
+    pages.clear();
+    std::vector<Page> ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        while(int(ready.size()) < maxPages && !mReady.empty()) {
+            Page& page = mReady.front();
+            mLoading.erase(pageKey(page.level, page.x, page.y));
+            ready.push_back(std::move(page));
+            mReady.pop_front();
+        }
+    }
+
+    for(Page& page : ready) {
+        quint64 key = pageKey(page.level, page.x, page.y);
+        if(mResident.count(key)) continue;
+
+        // 最粗层级页固定使用槽位0
+        quint32 slot = page.level == muTopLevel ? 0 : allocateSlot();
+        if(slot == mSlots.size()) {
+            ++muDropped;
+            continue;
+        }
+        mSlots[slot] = Slot{key, muFrame, true};
+        mResident[key] = slot;
+        // 只替换指向更粗层级页的页表项
+        updateTable(page.level, page.x, page.y, slot, page.level, [&](const quint8 * pEntry) {
+            return pEntry[2] > page.level;
+        });
+        page.slot = slot;
+        ++muLoaded;
+        pages.push_back(std::move(page));
+    }
+}
+
+bool VirtualTexture::hasPendingPages() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return !mLoadQueue.empty() || !mLoading.empty();
+}
+
+VirtualTexture::Stats VirtualTexture::stats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return Stats{mSlots.size(), mResident.size(), mLoadQueue.size() + mLoading.size(),
+                 muLoaded, muEvicted, muDropped};
+}
+
+quint64 VirtualTexture::pageKey(quint32 level, quint32 x, quint32 y) {
+    return (quint64(level) << 48) | (quint64(y) << 24) | x;
+}
+
+void VirtualTexture::touch(quint32 level, quint32 x, quint32 y) {
+    // 同时访问所有上级页，遇到本帧已处理过的页即停止
+    for(; level <= muTopLevel; ++level, x /= 2, y /= 2) {
+        quint64 key = pageKey(level, x, y);
+        auto it = mResident.find(key);
+        if(it != mResident.end()) {
+            Slot& slot = mSlots[it->second];
+            if(slot.lastUsedFrame == muFrame) return;
+            slot.lastUsedFrame = muFrame;
+        } else if(!mMissing.emplace(key, level).second) {
+            return;
+        }
+    }
+}
+
+quint32 VirtualTexture::allocateSlot() {
+    // 优先使用空槽位，否则淘汰本帧未使用的最久未使用页
+    quint32 oldest = quint32(mSlots.size());
+    for(quint32 i = 1; i < mSlots.size(); ++i) {
+        const Slot& slot = mSlots[i];
+        if(!slot.occupied) return i;
+        if(slot.lastUsedFrame < muFrame &&
+                (oldest == mSlots.size() || slot.lastUsedFrame < mSlots[oldest].lastUsedFrame)) {
+            oldest = i;
+        }
+    }
+    if(oldest < mSlots.size()) evictSlot(oldest);
+    return oldest;
+}
+
+void VirtualTexture::evictSlot(quint32 slot) {
+    quint64 key = mSlots[slot].key;
+    quint32 level = quint32(key >> 48), y = quint32((key >> 24) & 0xFFFFFF), x = quint32(key & 0xFFFFFF);
+
+    // 指向该页的页表项改为指向最近的驻留上级页，最粗层级页常驻，总能找到
+    quint32 ancestorSlot = 0, ancestorLevel = muTopLevel;
+    for(quint32 l = level + 1, ax = x / 2, ay = y / 2; l <= muTopLevel; ++l, ax /= 2, ay /= 2) {
+        auto it = mResident.find(pageKey(l, ax, ay));
+        if(it != mResident.end()) {
+            ancestorSlot = it->second;
+            ancestorLevel = l;
+            break;
+        }
+    }
+    quint8 slotX = quint8(slot % muSlotsX), slotY = quint8(slot / muSlotsX);
+    updateTable(level, x, y, ancestorSlot, ancestorLevel, [&](const quint8 * pEntry) {
+        return pEntry[0] == slotX && pEntry[1] == slotY && pEntry[2] == level;
+    });
+
+    mResident.erase(key);
+    mSlots[slot].occupied = false;
+    ++muEvicted;
+}
+
+template<typename Predicate>
+void VirtualTexture::updateTable(quint32 level, quint32 x, quint32 y, quint32 slot,
+                                 quint32 entryLevel, Predicate shouldUpdate) {
+    quint64 cols = tableCols(), rows = tableRows();
+    quint64 x0 = quint64(x) << level, x1 = std::min(cols, quint64(x + 1) << level);
+    quint64 y0 = quint64(y) << level, y1 = std::min(rows, quint64(y + 1) << level);
+    if(x0 >= x1 || y0 >= y1) return;
+
+    bool changed = false;
+    for(quint64 row = y0; row < y1; ++row) {
+        quint8* pEntry = mPageTable.data() + (row * cols + x0) * 4;
+        for(quint64 col = x0; col < x1; ++col, pEntry += 4) {
+            if(!shouldUpdate(pEntry)) continue;
+            pEntry[0] = quint8(slot % muSlotsX);
+            pEntry[1] = quint8(slot / muSlotsX);
+            pEntry[2] = quint8(entryLevel);
+            changed = true;
+        }
+    }
+
+    if(!changed) return;
+    if(muDirtyRowBegin >= muDirtyRowEnd) {
+        muDirtyRowBegin = quint32(y0), muDirtyRowEnd = quint32(y1);
+    } else {
+        muDirtyRowBegin = std::min(muDirtyRowBegin, quint32(y0));
+        muDirtyRowEnd = std::max(muDirtyRowEnd, quint32(y1));
+    }
+}
+
+void VirtualTexture::loadLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while(true) {
+        mLoadCondition.wait(lock, [this]() {
+            return mbStopping || !mLoadQueue.empty();
+        });
+        if(mbStopping) return;
+
+        quint64 key = mLoadQueue.front();
+        mLoadQueue.pop_front();
+        mLoading.insert(key);
+        lock.unlock();
+
+        Page page{quint32(key >> 48), quint32(key & 0xFFFFFF), quint32((key >> 24) & 0xFFFFFF), 0, QImage()};
+        bool decoded = true;
+        try {
+            page.image = mPyramid.readPage(page.level, page.x, page.y);
+        } catch (const char*) {
+            decoded = false;
+        }
+
+        lock.lock();
+        if(decoded) {
+            mReady.push_back(std::move(page));
+        } else {
+            mLoading.erase(key);
+            mFailed.insert(key);
+        }
+    }
+}
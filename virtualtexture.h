@@ -0,0 +1,179 @@
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "orthopyramid.h"
+
+/**
+ * @brief The VirtualTexture class
+ *
+ * 超大正射影像的虚拟纹理驻留管理，不依赖OpenGL上下文。
+ * 物理页缓存为 slotsX * slotsY 个固定槽位，每帧按可见地形节点请求所需层级的页，
+ * 缺失的页由后台线程从页金字塔解码，再由渲染器每帧上传有限数量的页；
+ * 槽位用尽时淘汰最久未使用的页，最粗层级的单页常驻，保证任何位置都有可用的页。
+ *
+ * 页表按第0级页排列，每项(RGBA8)记录覆盖该位置的最精细驻留页：槽位列号、槽位行号、层级。
+ * 除构造与析构外只能在同一线程(GUI线程)中调用。
+ */
+class VirtualTexture {
+public:
+    // 单次请求的最大页数，超出时改用更粗的层级
+    static const quint64 MAX_PAGES_PER_REQUEST = 16;
+
+    /**
+     * @brief The Page struct 已解码并分配槽位、等待上传的页
+     */
+    struct Page {
+        quint32 level;
+        quint32 x;
+        quint32 y;
+        // 槽位序号，槽位列号为 slot % slotsX，行号为 slot / slotsX
+        quint32 slot;
+        // PAGE_SIZE * PAGE_SIZE 的RGB888图像
+        QImage image;
+    };
+
+    /**
+     * @brief The Stats struct 驻留统计
+     */
+    struct Stats {
+        quint64 slots;
+        quint64 residentPages;
+        // 排队与解码中的页
+        quint64 pendingPages;
+        quint64 loadedPages;
+        quint64 evictedPages;
+        // 槽位全被本帧使用而未能放入的页
+        quint64 droppedPages;
+    };
+
+public:
+    /**
+     * @param pyramid 页金字塔
+     * @param slotsX 物理页缓存每行槽位数(不超过256)
+     * @param slotsY 物理页缓存每列槽位数(不超过256)
+     */
+    VirtualTexture(OrthoPyramid pyramid, quint32 slotsX, quint32 slotsY);
+    ~VirtualTexture();
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    const OrthoPyramid& pyramid() const;
+    quint32 slotsX() const;
+    quint32 slotsY() const;
+
+    /**
+     * @brief pageTable 获取页表，tableCols * tableRows 项，每项4字节
+     * @return
+     */
+    const std::vector<quint8>& pageTable() const;
+    quint32 tableCols() const;
+    quint32 tableRows() const;
+
+    /**
+     * @brief takeDirtyTableRows 获取并清除自上次调用以来修改过的页表行范围
+     * @param rowBegin 起始行
+     * @param rowEnd 结束行(不含)
+     * @return 没有修改时为false
+     */
+    bool takeDirtyTableRows(quint32& rowBegin, quint32& rowEnd);
+
+    /**
+     * @brief beginFrame 开始收集本帧请求
+     */
+    void beginFrame();
+
+    /**
+     * @brief requestRect 请求覆盖影像矩形范围的页及其所有上级页
+     * @param level 期望的层级，页数超过 MAX_PAGES_PER_REQUEST 时自动加粗
+     * @param x0 起始列(第0级像素)
+     * @param y0 起始行(第0级像素，第0行为影像上边界)
+     * @param x1 结束列
+     * @param y1 结束行
+     */
+    void requestRect(quint32 level, double x0, double y0, double x1, double y1);
+
+    /**
+     * @brief endFrame 将本帧请求中尚未驻留的页按由粗到细的顺序交给后台线程，替换之前的队列
+     *
+     * 已解码但本帧未请求的页被丢弃。
+     */
+    void endFrame();
+
+    /**
+     * @brief takeReadyPages 取出已解码的页，分配槽位并更新页表
+     *
+     * 返回的页须在本帧上传到对应槽位，之后页表才指向它们。
+     * @param maxPages 最多取出的页数
+     * @param pages 输出的页(清空后写入)
+     */
+    void takeReadyPages(int maxPages, std::vector<Page>& pages);
+
+    /**
+     * @brief hasPendingPages 是否还有排队、解码中或等待上传的页
+     * @return
+     */
+    bool hasPendingPages() const;
+
+    Stats stats() const;
+
+private:
+    struct Slot {
+        quint64 key;
+        quint64 lastUsedFrame;
+        bool occupied;
+    };
+
+    static quint64 pageKey(quint32 level, quint32 x, quint32 y);
+    void touch(quint32 level, quint32 x, quint32 y);
+    quint32 allocateSlot();
+    void evictSlot(quint32 slot);
+    // 将页覆盖的页表项中满足条件的项指向给定槽位与层级
+    template<typename Predicate>
+    void updateTable(quint32 level, quint32 x, quint32 y, quint32 slot, quint32 entryLevel,
+                     Predicate shouldUpdate);
+    void loadLoop();
+
+private:
+    OrthoPyramid mPyramid;
+    quint32 muSlotsX;
+    quint32 muSlotsY;
+    quint32 muTopLevel;
+
+    // 页表与修改过的行范围
+    std::vector<quint8> mPageTable{};
+    quint32 muDirtyRowBegin{0};
+    quint32 muDirtyRowEnd{0};
+
+    // 槽位与驻留页(页键 -> 槽位)，槽位0为常驻的最粗层级页
+    std::vector<Slot> mSlots{};
+    std::unordered_map<quint64, quint32> mResident{};
+    quint64 muFrame{0};
+    // 本帧请求中尚未驻留的页(页键 -> 层级)
+    std::unordered_map<quint64, quint32> mMissing{};
+
+    quint64 muLoaded{0};
+    quint64 muEvicted{0};
+    quint64 muDropped{0};
+
+    // 后台解码，以下成员受mMutex保护
+    mutable std::mutex mMutex;
+    std::deque<quint64> mLoadQueue{};
+    // 解码中与已解码未取出的页
+    std::unordered_set<quint64> mLoading{};
+    std::deque<Page> mReady{};
+    // 解码失败的页，不再请求
+    std::unordered_set<quint64> mFailed{};
+    std::condition_variable mLoadCondition{};
+    bool mbStopping{false};
+    std::thread mLoadThread{};
+};
+
+#endif // VIRTUALTEXTURE_H